@@ -0,0 +1,902 @@
+#ifndef _Z_UDI_LIBZUI_H
+	#define _Z_UDI_LIBZUI_H
+
+	#include <stdint.h>
+	#include <zui.h>
+
+/**	EXPLANATION:
+ * libzui: a header-only reader for the UDI index, for the kernel and for
+ * host tools alike.
+ *
+ * It works in place over the committed bytes of the index files, whether
+ * they come from an mmap() of each file, from an mmap() of an index
+ * container, or from any other span of memory (e.g. a module loaded by the
+ * kernel's boot loader). Nothing is copied or allocated: records are
+ * handed out as const pointers into the span, arrays of records as
+ * sArray<T>s that can be iterated over with plain pointers, and strings as
+ * sString views with their lengths.
+ *
+ * Every offset and count read from the index is checked against the size
+ * of the file it points into before it is followed, and an offset which
+ * doesn't fit comes back as an empty sArray (or sString, or NULL) that is
+ * marked invalid. A reader therefore never strays outside of the spans it
+ * was given, however corrupt the index is.
+ *
+ * open() also checks the checksum of the index header, and
+ * openContainer() that of the container header, since they are small.
+ * verify() checks every file against its checksum (see zui::crc32c()),
+ * which reads the whole index; a loader which can't otherwise trust the
+ * index it was handed calls it once, before anything else.
+ *
+ * Records are used in place, so the index has to be in the host's byte
+ * order, and each span has to start on an 8 byte boundary (the index
+ * files' records are all naturally aligned within their files). open()
+ * refuses an index which isn't. It uses nothing from the C library, so it
+ * can be built under __ZAMBESII_KERNEL_SOURCE__ as is.
+ **/
+namespace zui
+{
+namespace reader
+{
+	enum statusE {
+		STATUS_OK=0, STATUS_TRUNCATED, STATUS_BAD_MAGIC,
+		STATUS_BAD_BYTE_ORDER, STATUS_BAD_VERSION, STATUS_MISALIGNED,
+		STATUS_CORRUPT, STATUS_BAD_CHECKSUM };
+
+	// Spans and records within them must be aligned to this.
+	#define ZUI_READER_ALIGNMENT		(8)
+
+	// The index files, in the order of zui::sHeader::fileSizes.
+	enum fileE {
+		FILE_DRIVERS=container::SECTION_DRIVERS,
+		FILE_DATA=container::SECTION_DATA,
+		FILE_DEVICES=container::SECTION_DEVICES,
+		FILE_STRINGS=container::SECTION_STRINGS,
+		FILE_RANKS=container::SECTION_RANKS,
+		FILE_PROVISIONS=container::SECTION_PROVISIONS,
+		N_FILES=container::SECTION_N_TYPES };
+
+	/* A NUL-terminated string within the string file. str[len] is always
+	 * the terminator, so str can also be handed to C string functions.
+	 **/
+	struct sString
+	{
+		sString(void) : str(0), len(0), ok(false) {}
+		sString(const char *_str, uint32_t _len)
+		: str(_str), len(_len), ok(true)
+		{}
+
+		bool valid(void) const { return ok; }
+		const char *data(void) const { return str; }
+		uint32_t length(void) const { return len; }
+
+		bool equals(const char *s) const
+		{
+			if (!ok) { return false; };
+			for (uint32_t i=0; i<len; i++)
+			{
+				if (s[i] != str[i]) { return false; };
+			};
+
+			return s[len] == '\0';
+		}
+
+		bool equals(const sString &s) const
+		{
+			if (!ok || !s.ok || len != s.len) { return false; };
+			for (uint32_t i=0; i<len; i++)
+			{
+				if (s.str[i] != str[i]) { return false; };
+			};
+
+			return true;
+		}
+
+		const char	*str;
+		uint32_t	len;
+		bool		ok;
+	};
+
+	/* A run of records of type T, packed end to end. begin() and end() are
+	 * plain pointers, so a range-based for loop walks the records. An
+	 * invalid array is also empty.
+	 **/
+	template <class T>
+	struct sArray
+	{
+		sArray(void) : items(0), n(0), ok(false) {}
+		sArray(const T *_items, uint32_t _n)
+		: items(_items), n(_n), ok(true)
+		{}
+
+		bool valid(void) const { return ok; }
+		uint32_t size(void) const { return n; }
+		bool empty(void) const { return n == 0; }
+		const T *begin(void) const { return items; }
+		const T *end(void) const { return items + n; }
+
+		// Returns NULL if i is out of range.
+		const T *at(uint32_t i) const
+			{ return (i < n) ? &items[i] : 0; }
+
+		// Records [first, first + count), clipped to the array.
+		sArray<T> slice(uint32_t first, uint32_t count) const
+		{
+			if (!ok || first > n) { return sArray<T>(); };
+			if (count > n - first) { count = n - first; };
+			return sArray<T>(items + first, count);
+		}
+
+		const T		*items;
+		uint32_t	n;
+		bool		ok;
+	};
+
+	class sIndex
+	{
+	public:
+		sIndex(void) { close(); }
+
+		void close(void)
+		{
+			for (int i=0; i<N_FILES; i++)
+			{
+				files[i] = 0;
+				sizes[i] = 0;
+			};
+
+			h = 0;
+		}
+
+		/* Opens an index from a span for each of its files, in
+		 * container::sectionTypeE order. Bytes past each file's
+		 * committed size (see zui::sHeader::fileSizes) are ignored.
+		 **/
+		statusE open(
+			const void *const _files[N_FILES],
+			const uint32_t _sizes[N_FILES]
+			)
+		{
+			close();
+			for (int i=0; i<N_FILES; i++)
+			{
+				if (_sizes[i] > 0 && _files[i] == 0)
+					{ return STATUS_CORRUPT; };
+
+				files[i] = (const uint8_t *)_files[i];
+				sizes[i] = _sizes[i];
+			};
+
+			return checkHeader();
+		}
+
+		// Opens an index from the whole of an index container.
+		statusE openContainer(const void *base, uint32_t size)
+		{
+			const container::sHeader	*ch;
+			const container::sSection	*s;
+			const uint8_t			*b;
+
+			close();
+			b = (const uint8_t *)base;
+			if (size < sizeof(*ch)) { return STATUS_TRUNCATED; };
+			if (!isAligned(b)) { return STATUS_MISALIGNED; };
+
+			ch = (const container::sHeader *)b;
+			for (uint32_t i=0; i<sizeof(ch->magic); i++)
+			{
+				if (ch->magic[i] != ZUI_CONTAINER_MAGIC[i])
+					{ return STATUS_BAD_MAGIC; };
+			};
+
+			if (!isHostOrder(ch->endianness))
+				{ return STATUS_BAD_BYTE_ORDER; };
+
+			if (ch->majorVersion != ZUI_VERSION_MAJOR
+				|| ch->minorVersion != ZUI_VERSION_MINOR)
+			{
+				return STATUS_BAD_VERSION;
+			};
+
+			if (ch->fileSize > size) { return STATUS_TRUNCATED; };
+			if (ch->nSections < N_FILES
+				|| ch->sectionTableOff % sizeof(uint32_t) != 0
+				|| ch->sectionTableOff > ch->fileSize
+				|| (uint64_t)ch->nSections * sizeof(*s)
+					> ch->fileSize - ch->sectionTableOff)
+			{
+				return STATUS_CORRUPT;
+			};
+
+			s = (const container::sSection *)
+				&b[ch->sectionTableOff];
+			if (ch->checksum
+				!= container::checksum(ch, s, ch->nSections))
+			{
+				return STATUS_BAD_CHECKSUM;
+			};
+
+			for (int i=0; i<N_FILES; i++)
+			{
+				if (s[i].type != (uint32_t)i
+					|| s[i].offset > ch->fileSize
+					|| s[i].length
+						> ch->fileSize - s[i].offset)
+				{
+					return STATUS_CORRUPT;
+				};
+
+				files[i] = &b[s[i].offset];
+				sizes[i] = s[i].length;
+			};
+
+			return checkHeader();
+		}
+
+		const zui::sHeader *header(void) const { return h; }
+
+		/* Checks the committed contents of every file against its
+		 * checksum in the index header. "table" is as for
+		 * zui::crc32c().
+		 **/
+		statusE verify(const sCrc32cTable *table) const
+		{
+			uint32_t	start, crc;
+
+			if (h == 0) { return STATUS_CORRUPT; };
+
+			for (int i=0; i<N_FILES; i++)
+			{
+				// The header has a checksum of its own.
+				start = (i == FILE_DRIVERS) ? sizeof(*h) : 0;
+				crc = crc32c(
+					0, files[i] + start, sizes[i] - start,
+					table);
+
+				if (crc != h->fileChecksums[i])
+					{ return STATUS_BAD_CHECKSUM; };
+			};
+
+			return STATUS_OK;
+		}
+
+		const uint8_t *file(fileE f) const { return files[f]; }
+		uint32_t fileSize(fileE f) const { return sizes[f]; }
+
+		/* Returns the "n" records of type T at "offset" in file "f", or
+		 * an invalid array if they aren't all within the file, or
+		 * aren't aligned.
+		 **/
+		template <class T>
+		sArray<T> records(fileE f, uint32_t offset, uint32_t n) const
+		{
+			if (offset > sizes[f]
+				|| (uint64_t)n * sizeof(T) > sizes[f] - offset
+				|| offset % alignof(T) != 0)
+			{
+				return sArray<T>();
+			};
+
+			return sArray<T>((const T *)&files[f][offset], n);
+		}
+
+		template <class T>
+		const T *record(fileE f, uint32_t offset) const
+			{ return records<T>(f, offset, 1).at(0); }
+
+		// The string at "offset" in strings.zudi-index.
+		sString string(uint32_t offset) const
+		{
+			const uint8_t	*s=files[FILE_STRINGS];
+			uint32_t	size=sizes[FILE_STRINGS];
+
+			for (uint32_t i=offset; i<size; i++)
+			{
+				if (s[i] == '\0')
+				{
+					return sString(
+						(const char *)&s[offset],
+						i - offset);
+				};
+			};
+
+			return sString();
+		}
+
+		/* Drivers and metalanguage libraries. Those with
+		 * ZUI_DRIVER_FLAGS_REMOVED set are still in the array, and
+		 * should be skipped.
+		 **/
+		sArray<driver::sHeader> drivers(void) const
+		{
+			return records<driver::sHeader>(
+				FILE_DRIVERS, sizeof(zui::sHeader),
+				(sizes[FILE_DRIVERS]
+					- sizeof(zui::sHeader))
+					/ sizeof(driver::sHeader));
+		}
+
+		// Returns the live driver with the given ID, or NULL.
+		const driver::sHeader *findDriver(uint32_t id) const
+		{
+			sArray<driver::sHeader>		d=drivers();
+
+			for (const driver::sHeader *i=d.begin(); i<d.end(); i++)
+			{
+				if (i->id == id
+					&& !(i->flags
+						& ZUI_DRIVER_FLAGS_REMOVED))
+				{
+					return i;
+				};
+			};
+
+			return 0;
+		}
+
+		/* The records of a driver, each in the file that the index
+		 * compiler puts them in.
+		 **/
+		sArray<device::sHeader> devices(const driver::sHeader *d) const
+		{
+			return records<device::sHeader>(
+				FILE_DEVICES,
+				d->deviceFileOffset, d->nDevices);
+		}
+
+		sArray<rank::sHeader> ranks(const driver::sHeader *d) const
+		{
+			return records<rank::sHeader>(
+				FILE_RANKS,
+				d->rankFileOffset, d->nRanks);
+		}
+
+		sArray<driver::sProvision> provisions(
+			const driver::sHeader *d
+			) const
+		{
+			return records<driver::sProvision>(
+				FILE_PROVISIONS,
+				d->provisionFileOffset, d->nProvisions);
+		}
+
+		#define ZUI_READER_DATA_ARRAY(__type, __name, __off, __n) \
+			sArray<driver::__type> __name(			\
+				const driver::sHeader *d		\
+				) const					\
+			{						\
+				return records<driver::__type>(		\
+					FILE_DATA,			\
+					d->__off, d->__n);		\
+			}
+
+		ZUI_READER_DATA_ARRAY(
+			sRequirement, requirements,
+			requirementsOffset, nRequirements)
+		ZUI_READER_DATA_ARRAY(
+			sMetalanguage, metalanguages,
+			metalanguagesOffset, nMetalanguages)
+		ZUI_READER_DATA_ARRAY(
+			sChildBop, childBops, childBopsOffset, nChildBops)
+		ZUI_READER_DATA_ARRAY(
+			sParentBop, parentBops, parentBopsOffset, nParentBops)
+		ZUI_READER_DATA_ARRAY(
+			sInternalBop, internalBops,
+			internalBopsOffset, nInternalBops)
+		ZUI_READER_DATA_ARRAY(
+			sModule, modules, modulesOffset, nModules)
+		ZUI_READER_DATA_ARRAY(
+			sRegion, regions, regionsOffset, nRegions)
+		ZUI_READER_DATA_ARRAY(
+			sMessage, messages, messagesOffset, nMessages)
+		ZUI_READER_DATA_ARRAY(
+			sDisasterMessage, disasterMessages,
+			disasterMessagesOffset, nDisasterMessages)
+		ZUI_READER_DATA_ARRAY(
+			sMessageFile, messageFiles,
+			messageFilesOffset, nMessageFiles)
+		ZUI_READER_DATA_ARRAY(
+			sReadableFile, readableFiles,
+			readableFilesOffset, nReadableFiles)
+
+		#undef ZUI_READER_DATA_ARRAY
+
+		sArray<device::sAttrData> attributes(
+			const device::sHeader *dev
+			) const
+		{
+			return records<device::sAttrData>(
+				FILE_DATA,
+				dev->dataOff, dev->nAttributes);
+		}
+
+		sArray<rank::sRankAttr> attributes(
+			const rank::sHeader *rank
+			) const
+		{
+			return records<rank::sRankAttr>(
+				FILE_DATA,
+				rank->dataOff, rank->nAttributes);
+		}
+
+		// The driver's locale directory; see driver::sMessageLocale.
+		sArray<driver::sMessageLocale> messageLocales(
+			const driver::sHeader *d
+			) const
+		{
+			const driver::sMessageLocaleDir	*dir;
+
+			if (d->messageLocalesOffset == 0)
+				{ return sArray<driver::sMessageLocale>(); };
+
+			dir = record<driver::sMessageLocaleDir>(
+				FILE_DATA, d->messageLocalesOffset);
+
+			if (dir == 0)
+				{ return sArray<driver::sMessageLocale>(); };
+
+			return records<driver::sMessageLocale>(
+				FILE_DATA,
+				d->messageLocalesOffset + sizeof(*dir),
+				dir->nLocales);
+		}
+
+		/* The driver's entry for the locale with the given name and
+		 * driver::localeHash(), or NULL if it has no messages in it.
+		 **/
+		const driver::sMessageLocale *findLocale(
+			const driver::sHeader *d, const char *name,
+			uint32_t hash
+			) const
+		{
+			sArray<driver::sMessageLocale>	locs;
+
+			locs = messageLocales(d);
+
+			for (const driver::sMessageLocale *l=locs.begin();
+				l<locs.end(); l++)
+			{
+				if (l->nameHash == hash
+					&& string(l->nameOff).equals(name))
+				{
+					return l;
+				};
+			};
+
+			return 0;
+		}
+
+		/* The first of a locale's messages with the given index (see
+		 * sHeader::messageIndex and nameIndex), or NULL. It is found
+		 * through the locale's message table, or if it has none, by a
+		 * binary search of its records.
+		 **/
+		const driver::sMessage *findMessage(
+			const driver::sHeader *d,
+			const driver::sMessageLocale *loc, uint16_t index
+			) const
+		{
+			sArray<driver::sMessage>	msgs;
+			const driver::sMessageTable	*t;
+			sArray<uint16_t>		slots;
+			uint32_t			lo, hi, mid;
+
+			msgs = messages(d).slice(
+				loc->firstMessage, loc->nMessages);
+			if (loc->tableOffset != 0)
+			{
+				t = record<driver::sMessageTable>(
+					FILE_DATA, loc->tableOffset);
+
+				if (t == 0) { return 0; };
+
+				slots = records<uint16_t>(
+					FILE_DATA,
+					loc->tableOffset + sizeof(*t),
+					t->nSlots);
+
+				if (!slots.valid()) { return 0; };
+				return msgs.at(driver::messageTableSlot(
+					t, slots.items, index));
+			};
+
+			for (lo=0, hi=msgs.n; lo < hi; )
+			{
+				mid = lo + (hi - lo) / 2;
+				if (msgs.items[mid].index < index)
+					{ lo = mid + 1; }
+				else { hi = mid; };
+			};
+
+			return (lo < msgs.n && msgs.items[lo].index == index)
+				? &msgs.items[lo] : 0;
+		}
+
+		/* The message with the given index in the preferred locale
+		 * (from findLocale(); NULL for none), or failing that, in the
+		 * "C" locale.
+		 **/
+		const driver::sMessage *findLocalizedMessage(
+			const driver::sHeader *d,
+			const driver::sMessageLocale *preferred, uint16_t index
+			) const
+		{
+			sArray<driver::sMessageLocale>	locs;
+			const driver::sMessage		*msg;
+
+			if (preferred != 0)
+			{
+				msg = findMessage(d, preferred, index);
+				if (msg != 0) { return msg; };
+			};
+
+			locs = messageLocales(d);
+
+			// The "C" locale's entry is always the first.
+			if (locs.empty() || &locs.items[0] == preferred
+				|| !string(locs.items[0].nameOff).equals(
+					ZUI_LOCALE_DEFAULT))
+			{
+				return 0;
+			};
+
+			return findMessage(d, &locs.items[0], index);
+		}
+
+		/* The text of a message. Unless the driver's messages are
+		 * compressed, it is a view into the string file. Otherwise its
+		 * block is decompressed into "scratch", which should be at
+		 * least ZUI_MESSAGE_BLOCK_MAXLEN bytes, and the view points
+		 * into that.
+		 **/
+		sString messageText(
+			const driver::sHeader *d, const driver::sMessage *msg,
+			uint8_t *scratch, uint32_t scratchSize
+			) const
+		{
+			const driver::sMessageBlock	*b;
+			sArray<uint8_t>			payload;
+			uint32_t			len;
+
+			if (!(d->flags & ZUI_DRIVER_FLAGS_COMPRESSED_MESSAGES))
+				{ return string(msg->messageOff); };
+
+			b = record<driver::sMessageBlock>(
+				FILE_DATA, msg->messageOff);
+
+			if (b == 0 || b->length > scratchSize)
+				{ return sString(); };
+
+			len = (b->compressedLength != 0)
+				? b->compressedLength : b->length;
+
+			payload = records<uint8_t>(
+				FILE_DATA,
+				msg->messageOff + sizeof(*b), len);
+
+			if (!payload.valid()) { return sString(); };
+
+			if (b->compressedLength == 0)
+			{
+				for (uint32_t i=0; i<len; i++)
+					{ scratch[i] = payload.items[i]; };
+			}
+			else if (lz::decompress(
+				payload.items, len, scratch, b->length)
+				!= (int32_t)b->length)
+			{
+				return sString();
+			};
+
+			for (uint32_t i=msg->textOff; i<b->length; i++)
+			{
+				if (scratch[i] == '\0')
+				{
+					return sString(
+						(const char *)
+							&scratch[msg->textOff],
+						i - msg->textOff);
+				};
+			};
+
+			return sString();
+		}
+
+		// The name with the given ID in the attribute name dictionary.
+		sString attrName(uint32_t id) const
+		{
+			const sAttrNameDict	*dict=attrNameDict();
+			sArray<uint32_t>	nameOffs;
+
+			if (dict == 0) { return sString(); };
+
+			nameOffs = records<uint32_t>(
+				FILE_DEVICES,
+				h->attrNamesOff + sizeof(*dict)
+					+ (dict->nBuckets + dict->nNames)
+						* sizeof(uint32_t),
+				dict->nNames);
+
+			if (nameOffs.at(id) == 0) { return sString(); };
+			return string(*nameOffs.at(id));
+		}
+
+		/* Looks a name up through the dictionary's perfect hash.
+		 * Returns false if the name isn't in the index.
+		 **/
+		bool findAttrName(const char *name, uint16_t *id) const
+		{
+			const sAttrNameDict	*dict=attrNameDict();
+			const uint32_t		*seed, *slotId;
+			uint32_t		off;
+
+			if (dict == 0 || dict->nNames == 0
+				|| dict->nBuckets == 0)
+			{
+				return false;
+			};
+
+			off = h->attrNamesOff + sizeof(*dict);
+			seed = records<uint32_t>(
+				FILE_DEVICES, off, dict->nBuckets)
+				.at(attrNameHash(name) % dict->nBuckets);
+
+			if (seed == 0) { return false; };
+
+			slotId = records<uint32_t>(
+				FILE_DEVICES,
+				off + dict->nBuckets * sizeof(uint32_t),
+				dict->nNames)
+				.at(attrNameSlot(name, *seed, dict->nNames));
+
+			if (slotId == 0 || !attrName(*slotId).equals(name))
+				{ return false; };
+
+			*id = *slotId;
+			return true;
+		}
+
+		/* The entries of the device match table's bucket for the given
+		 * hash (see device::matchHash()). Each one is only a
+		 * candidate; its device's attributes must still be compared.
+		 **/
+		sArray<device::sMatchEntry> matchCandidates(uint32_t hash) const
+		{
+			const device::sMatchTable	*t;
+			sArray<uint32_t>		starts;
+			uint32_t			b;
+
+			if (h->matchTableLen == 0)
+				{ return sArray<device::sMatchEntry>(); };
+
+			t = record<device::sMatchTable>(
+				FILE_DEVICES, h->matchTableOff);
+
+			if (t == 0 || t->nBuckets == 0
+				|| (t->nBuckets & (t->nBuckets - 1)))
+			{
+				return sArray<device::sMatchEntry>();
+			};
+
+			starts = records<uint32_t>(
+				FILE_DEVICES,
+				h->matchTableOff + sizeof(*t), t->nBuckets + 1);
+
+			b = hash & (t->nBuckets - 1);
+			if (!starts.valid()
+				|| starts.items[b] > starts.items[b + 1])
+			{
+				return sArray<device::sMatchEntry>();
+			};
+
+			return records<device::sMatchEntry>(
+				FILE_DEVICES,
+				h->matchTableOff + sizeof(*t)
+					+ (t->nBuckets + 1) * sizeof(uint32_t),
+				t->nEntries)
+				.slice(
+					starts.items[b],
+					starts.items[b + 1] - starts.items[b]);
+		}
+
+		// The device whose sHeader is at "deviceOff".
+		const device::sHeader *device(uint32_t deviceOff) const
+		{
+			return record<device::sHeader>(
+				FILE_DEVICES, deviceOff);
+		}
+
+		/* The columnar attribute table. The column accessors return
+		 * the nRows elements of each column; the columns' padding is
+		 * within the file as well, so vector loads may run up to the
+		 * end of the padding.
+		 **/
+		const device::sAttrColumns *attrColumns(void) const
+		{
+			if (h->attrColumnsLen < sizeof(device::sAttrColumns))
+				{ return 0; };
+
+			return record<device::sAttrColumns>(
+				FILE_DEVICES, h->attrColumnsOff);
+		}
+
+		#define ZUI_READER_COLUMN(__type, __name, __off)	\
+			sArray<__type> __name(void) const		\
+			{						\
+				const device::sAttrColumns *t=attrColumns(); \
+									\
+				if (t == 0) { return sArray<__type>(); }; \
+				return records<__type>(			\
+					FILE_DEVICES,			\
+					h->attrColumnsOff + t->__off,	\
+					t->nRows);			\
+			}
+
+		ZUI_READER_COLUMN(uint32_t, attrColumnNameIds, nameIdsOff)
+		ZUI_READER_COLUMN(uint32_t, attrColumnValues, valuesOff)
+		ZUI_READER_COLUMN(uint32_t, attrColumnDeviceOffs, deviceOffsOff)
+		ZUI_READER_COLUMN(uint8_t, attrColumnTypes, typesOff)
+
+		#undef ZUI_READER_COLUMN
+
+		/* The provision directory entries whose nameHash is that of
+		 * "name". Their names must still be compared.
+		 **/
+		sArray<driver::sProvisionDirEntry> providers(
+			const char *name
+			) const
+		{
+			sArray<driver::sProvisionDirEntry>	dir;
+			uint32_t				hash, lo, hi;
+			uint32_t				mid, end;
+
+			dir = records<driver::sProvisionDirEntry>(
+				FILE_PROVISIONS,
+				h->provisionDirOff,
+				h->provisionDirLen
+					/ sizeof(driver::sProvisionDirEntry));
+
+			hash = driver::provisionHash(name);
+			for (lo=0, hi=dir.n; lo < hi; )
+			{
+				mid = lo + (hi - lo) / 2;
+				if (dir.items[mid].nameHash < hash)
+					{ lo = mid + 1; }
+				else { hi = mid; };
+			};
+
+			for (end=lo;
+				end < dir.n && dir.items[end].nameHash == hash;
+				end++)
+			{};
+
+			return dir.slice(lo, end - lo);
+		}
+
+		/* The requirement closure of a driver: the IDs of the drivers
+		 * to load, in order, ending with the driver itself.
+		 **/
+		const driver::sClosure *closure(uint32_t driverId) const
+		{
+			sArray<driver::sClosure>	c=closures();
+			uint32_t			lo, hi, mid;
+
+			for (lo=0, hi=c.n; lo < hi; )
+			{
+				mid = lo + (hi - lo) / 2;
+				if (c.items[mid].driverId == driverId)
+					{ return &c.items[mid]; };
+
+				if (c.items[mid].driverId < driverId)
+					{ lo = mid + 1; }
+				else { hi = mid; };
+			};
+
+			return 0;
+		}
+
+		sArray<uint32_t> closureIds(const driver::sClosure *c) const
+		{
+			const driver::sClosureTable	*t=closureTable();
+
+			if (t == 0) { return sArray<uint32_t>(); };
+
+			return records<uint32_t>(
+				FILE_PROVISIONS,
+				h->closureTableOff + sizeof(*t)
+					+ t->nDrivers
+						* sizeof(driver::sClosure),
+				t->nIds)
+				.slice(c->idsIndex, c->nIds);
+		}
+
+	private:
+		static bool isAligned(const void *p)
+			{ return (uintptr_t)p % ZUI_READER_ALIGNMENT == 0; }
+
+		static bool isHostOrder(const char *endianness)
+		{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+			return endianness[0] == 'l' && endianness[1] == 'e'
+				&& endianness[2] == '\0';
+#else
+			return endianness[0] == 'b' && endianness[1] == 'e'
+				&& endianness[2] == '\0';
+#endif
+		}
+
+		statusE checkHeader(void)
+		{
+			const zui::sHeader	*hdr;
+
+			for (int i=0; i<N_FILES; i++)
+			{
+				if (!isAligned(files[i]))
+					{ return STATUS_MISALIGNED; };
+			};
+
+			if (sizes[FILE_DRIVERS] < sizeof(*hdr))
+				{ return STATUS_TRUNCATED; };
+
+			hdr = (const zui::sHeader *)files[FILE_DRIVERS];
+			if (!isHostOrder(hdr->endianness))
+				{ return STATUS_BAD_BYTE_ORDER; };
+
+			if (hdr->majorVersion != ZUI_VERSION_MAJOR
+				|| hdr->minorVersion != ZUI_VERSION_MINOR)
+			{
+				return STATUS_BAD_VERSION;
+			};
+
+			if (hdr->headerChecksum != headerChecksum(hdr))
+				{ return STATUS_BAD_CHECKSUM; };
+
+			for (int i=0; i<N_FILES; i++)
+			{
+				if (hdr->fileSizes[i] > sizes[i])
+					{ return STATUS_TRUNCATED; };
+
+				sizes[i] = hdr->fileSizes[i];
+			};
+
+			h = hdr;
+			return STATUS_OK;
+		}
+
+		const sAttrNameDict *attrNameDict(void) const
+		{
+			if (h->attrNamesLen < sizeof(sAttrNameDict))
+				{ return 0; };
+
+			return record<sAttrNameDict>(
+				FILE_DEVICES, h->attrNamesOff);
+		}
+
+		const driver::sClosureTable *closureTable(void) const
+		{
+			if (h->closureTableLen < sizeof(driver::sClosureTable))
+				{ return 0; };
+
+			return record<driver::sClosureTable>(
+				FILE_PROVISIONS, h->closureTableOff);
+		}
+
+		sArray<driver::sClosure> closures(void) const
+		{
+			const driver::sClosureTable	*t=closureTable();
+
+			if (t == 0) { return sArray<driver::sClosure>(); };
+
+			return records<driver::sClosure>(
+				FILE_PROVISIONS,
+				h->closureTableOff + sizeof(*t), t->nDrivers);
+		}
+
+		const uint8_t		*files[N_FILES];
+		uint32_t		sizes[N_FILES];
+		const zui::sHeader	*h;
+	};
+}
+}
+
+#endif
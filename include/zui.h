@@ -5,13 +5,35 @@
 	#include <udi.h>
 	#undef UDI_VERSION
 	#include <stdint.h>
+	#if defined(__SSE4_2__) && defined(__x86_64__)
+		#include <nmmintrin.h>
+	#elif defined(__ARM_FEATURE_CRC32) && defined(__aarch64__)
+		#include <arm_acle.h>
+	#endif
 
 /**	EXPLANATION:
  * This header is contained in all UDI index files. The kernel uses it to
  * quickly gain information about the whole of the index at a glance. Versioning
  * of the struct layouts used is also included for forward expansion.
+ *
+ * Since format version 2, every on-disk record has a fixed size with no
+ * compiler-inserted padding: fields are ordered from widest to narrowest,
+ * and any slack is an explicit "reserved" field which is always zero. Every
+ * record's size is a multiple of 4 (of 8 for those with 64-bit fields), so
+ * that records which are packed end to end stay naturally aligned, and a
+ * reader can use them through a plain pointer cast into a mapping of the
+ * index. The sizes are checked at the bottom of this file.
  **/
 
+#if !defined(__ZAMBESII_KERNEL_SOURCE__)
+// Output buffer that the index compiler's record writers append to.
+struct sectionS;
+#endif
+
+#define ZUI_VERSION_MAJOR		(2)
+#define ZUI_VERSION_MINOR		(11)
+#define ZUI_HEADER_MAX_NFILES		(12)
+
 #define ZUI_MESSAGE_MAXLEN		(150)
 #define ZUI_FILENAME_MAXLEN		(64)
 
@@ -21,28 +43,345 @@ namespace zui
 	{
 		// Version of the record format used in this index file.
 		// "endianness" is a NULL-terminated string of either "le" or "be".
+		// Every multi-byte field in the index is in that byte order.
 		char		endianness[4];
 		uint16_t	majorVersion, minorVersion;
 		uint32_t	nRecords, nextDriverId;
 		uint32_t	nSupportedDevices, nSupportedMetas;
-		uint8_t		reserved[60];
+		/* Committed size of each index file, in the order the index
+		 * compiler lists them. Bytes past these sizes belong to an update
+		 * that never committed.
+		 **/
+		uint32_t	fileSizes[ZUI_HEADER_MAX_NFILES];
+		/* Location of the device match table within devices.zudi-index
+		 * (see device::sMatchTable). It is always at the end of the
+		 * file; matchTableLen is 0 if there is none.
+		 **/
+		uint32_t	matchTableOff, matchTableLen;
+		/* Location of the columnar attribute table, which follows the
+		 * match table (see device::sAttrColumns).
+		 **/
+		uint32_t	attrColumnsOff, attrColumnsLen;
+		/* Location of the attribute name dictionary, which follows the
+		 * columnar attribute table (see sAttrNameDict).
+		 **/
+		uint32_t	attrNamesOff, attrNamesLen;
+		/* Location of the provision directory within
+		 * provisions.zudi-index (see driver::sProvisionDirEntry), and
+		 * of the requirement closure table that follows it (see
+		 * driver::sClosureTable). They are always at the end of the
+		 * file; a length is 0 if there is no such table.
+		 **/
+		uint32_t	provisionDirOff, provisionDirLen;
+		uint32_t	closureTableOff, closureTableLen;
+		/* CRC32C (see crc32c()) of the committed contents of each
+		 * index file, in the same order as fileSizes. That of
+		 * drivers.zudi-index starts right after this header, which
+		 * has its own headerChecksum; see headerChecksum().
+		 **/
+		uint32_t	fileChecksums[ZUI_HEADER_MAX_NFILES];
+		uint32_t	headerChecksum, reserved;
+	};
+
+	// FNV-1a, continued from "hash". Start from 2166136261.
+	static inline uint32_t hashBytes(
+		uint32_t hash, const void *data, uint32_t len
+		)
+	{
+		const uint8_t	*p=(const uint8_t *)data;
+
+		for (uint32_t i=0; i<len; i++)
+		{
+			hash ^= p[i];
+			hash *= 16777619u;
+		};
+
+		return hash;
+	}
+
+	/**	EXPLANATION:
+	 * CRC32C (the Castagnoli polynomial, as in iSCSI and ext4). The
+	 * index header holds one for each index file and one for itself, so
+	 * that a loader can tell a truncated or corrupt index from a good one
+	 * before it follows any offset in it.
+	 *
+	 * crc32c() continues a checksum from "crc", which is 0 to start
+	 * with, like zlib's crc32(). If the code is built for a CPU with the
+	 * CRC32C instruction (SSE4.2 on x86-64, the CRC extension on ARMv8),
+	 * it runs 8 bytes at a time through that. Otherwise it uses the
+	 * slicing-by-8 tables in "table", which the caller fills in once with
+	 * crc32cInitTable(), or, if "table" is NULL, goes a bit at a time,
+	 * which is only fit for short runs such as the headers.
+	 **/
+	#define ZUI_CRC32C_POLY			(0x82F63B78u)
+
+	// Runs the CRC on through the 8 bits of its low byte.
+	static inline uint32_t crc32cByte(uint32_t c)
+	{
+		for (int j=0; j<8; j++)
+			{ c = (c >> 1) ^ ((c & 1) ? ZUI_CRC32C_POLY : 0); };
+
+		return c;
+	}
+
+	struct sCrc32cTable
+	{
+		uint32_t	t[8][256];
+	};
+
+	static inline void crc32cInitTable(sCrc32cTable *table)
+	{
+		uint32_t	(*t)[256]=table->t;
+
+		for (uint32_t i=0; i<256; i++) { t[0][i] = crc32cByte(i); };
+
+		for (uint32_t i=0; i<256; i++)
+		{
+			for (int j=1; j<8; j++)
+			{
+				t[j][i] = (t[j - 1][i] >> 8)
+					^ t[0][t[j - 1][i] & 0xFF];
+			};
+		};
+	}
+
+	// Takes and returns the inverted CRC.
+	static inline uint32_t crc32cSlice8(
+		uint32_t crc, const uint8_t *p, uint32_t len,
+		const sCrc32cTable *table
+		)
+	{
+		const uint32_t	(*t)[256]=table->t;
+		uint32_t	lo, hi;
+
+		for (; len >= 8; p += 8, len -= 8)
+		{
+			lo = crc ^ ((uint32_t)p[0] | (uint32_t)p[1] << 8
+				| (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24);
+
+			hi = (uint32_t)p[4] | (uint32_t)p[5] << 8
+				| (uint32_t)p[6] << 16 | (uint32_t)p[7] << 24;
+
+			crc = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF]
+				^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24]
+				^ t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF]
+				^ t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+		};
+
+		for (; len > 0; p++, len--)
+			{ crc = (crc >> 8) ^ t[0][(crc ^ *p) & 0xFF]; };
+
+		return crc;
+	}
+
+	static inline uint32_t crc32c(
+		uint32_t crc, const void *data, uint32_t len,
+		const sCrc32cTable *table
+		)
+	{
+		const uint8_t	*p=(const uint8_t *)data;
+
+		crc = ~crc;
+#if defined(__SSE4_2__) && defined(__x86_64__)
+		uint64_t	word;
+
+		(void)table;
+		for (; len >= 8; p += 8, len -= 8)
+		{
+			__builtin_memcpy(&word, p, sizeof(word));
+			crc = (uint32_t)_mm_crc32_u64(crc, word);
+		};
+
+		for (; len > 0; p++, len--) { crc = _mm_crc32_u8(crc, *p); };
+#elif defined(__ARM_FEATURE_CRC32) && defined(__aarch64__) \
+	&& __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		uint64_t	word;
+
+		(void)table;
+		for (; len >= 8; p += 8, len -= 8)
+		{
+			__builtin_memcpy(&word, p, sizeof(word));
+			crc = __crc32cd(crc, word);
+		};
+
+		for (; len > 0; p++, len--) { crc = __crc32cb(crc, *p); };
+#else
+		if (table != 0) { return ~crc32cSlice8(crc, p, len, table); };
+
+		for (; len > 0; p++, len--) { crc = crc32cByte(crc ^ *p); };
+#endif
+		return ~crc;
+	}
+
+	/* Checksum of an index header as it is stored, with headerChecksum
+	 * taken as 0.
+	 **/
+	static inline uint32_t headerChecksum(const sHeader *h)
+	{
+		const uint8_t	*p=(const uint8_t *)h;
+		uint32_t	off, crc, zero=0;
+
+		off = (uint32_t)((const uint8_t *)&h->headerChecksum - p);
+		crc = crc32c(0, p, off, 0);
+		crc = crc32c(crc, &zero, sizeof(zero), 0);
+		off += sizeof(zero);
+		return crc32c(crc, &p[off], sizeof(*h) - off, 0);
+	}
+
+	/**	EXPLANATION:
+	 * Decoder for the small LZ77 codec that compressed message blocks
+	 * are stored in (see driver::sMessageBlock). It has no dependencies,
+	 * so the kernel can use it as is.
+	 *
+	 * The compressed data is a series of sequences. Each one starts with
+	 * a token byte: its high nibble is the number of literal bytes that
+	 * follow, and its low nibble is the length of the match that comes
+	 * after them, minus 4. A nibble of 15 is followed by more bytes to
+	 * add to it, up to and including the first one that isn't 255. After
+	 * the literals comes the 16 bit distance back to the match, least
+	 * significant byte first, then the match length's extra bytes. The
+	 * last sequence ends after its literals, and has no match.
+	 **/
+	namespace lz
+	{
+		#define ZUI_LZ_MIN_MATCH		(4)
+
+		// Returns the decoded length, or -1 if "src" is invalid.
+		static inline int32_t decompress(
+			const uint8_t *src, uint32_t srcLen,
+			uint8_t *dst, uint32_t dstLen
+			)
+		{
+			const uint8_t	*end=src + srcLen;
+			uint32_t	out=0, len, dist;
+			uint8_t		token, b;
+
+			while (src < end)
+			{
+				token = *src++;
+				len = token >> 4;
+				if (len == 15)
+				{
+					do {
+						if (src >= end) { return -1; };
+						b = *src++;
+						len += b;
+					} while (b == 255);
+				};
+
+				if (len > (uint32_t)(end - src)
+					|| len > dstLen - out)
+				{
+					return -1;
+				};
+
+				for (; len > 0; len--) { dst[out++] = *src++; };
+				if (src == end) { break; };
+
+				if (end - src < 2) { return -1; };
+				dist = src[0] | (src[1] << 8);
+				src += 2;
+
+				len = (token & 15) + ZUI_LZ_MIN_MATCH;
+				if ((token & 15) == 15)
+				{
+					do {
+						if (src >= end) { return -1; };
+						b = *src++;
+						len += b;
+					} while (b == 255);
+				};
+
+				if (dist == 0 || dist > out
+					|| len > dstLen - out)
+				{
+					return -1;
+				};
+
+				// The match may overlap the bytes it produces.
+				for (; len > 0; len--, out++)
+					{ dst[out] = dst[out - dist]; };
+			};
+
+			return out;
+		}
+	}
+
+	/**	EXPLANATION:
+	 * Attribute name dictionary. Device and rank attributes come from a
+	 * small vocabulary of names ("bus_type", "pci_vendor_id", ...), so
+	 * each distinct name gets a small integer ID, and the attribute
+	 * records store the ID rather than the name. Comparing two attribute
+	 * names is then an integer compare.
+	 *
+	 * The dictionary is an sAttrNameDict, followed by nBuckets uint32_t
+	 * seeds, then nNames uint32_t slots, then nNames uint32_t name
+	 * offsets (in strings.zudi-index), indexed by name ID. The ID of a
+	 * name is found through a minimal perfect hash: its bucket is
+	 * attrNameHash() % nBuckets, and its slot is
+	 * attrNameSlot(name, seeds[bucket], nNames). slots[slot] is the ID
+	 * of the only name which can be in that slot; the name at its
+	 * offset has to be compared, since a name which isn't in the
+	 * dictionary lands in some slot as well.
+	 *
+	 * IDs are handed out in the order the names are first seen, and
+	 * never change as drivers are added to or removed from the index, so
+	 * the names of removed drivers stay in the dictionary. A "-r"
+	 * compaction hands out the IDs afresh.
+	 **/
+	#define ZUI_ATTR_NAME_MAX_NIDS		(65536)
+	struct sAttrNameDict
+	{
+		uint32_t	nNames, nBuckets;
 	};
 
+	// The hash of the name, including its terminator.
+	static inline uint32_t attrNameHash(const char *attrName)
+	{
+		uint32_t	nameLen=0;
+
+		while (attrName[nameLen] != '\0') { nameLen++; };
+		return hashBytes(2166136261u, attrName, nameLen + 1);
+	}
+
+	static inline uint32_t attrNameSlot(
+		const char *attrName, uint32_t seed, uint32_t nNames
+		)
+	{
+		uint32_t	hash=2166136261u ^ seed, nameLen=0;
+
+		while (attrName[nameLen] != '\0') { nameLen++; };
+		hash = hashBytes(hash, attrName, nameLen + 1);
+		// FNV-1a's low bits are weak; mix them before reducing.
+		hash ^= hash >> 16;
+		hash *= 0x85EBCA6Bu;
+		hash ^= hash >> 13;
+		hash *= 0xC2B2AE35u;
+		hash ^= hash >> 16;
+		return hash % nNames;
+	}
+
 	namespace device
 	{
 		struct sHeader
 		{
-			uint32_t	driverId;
+			uint32_t	driverId, dataOff;
 			uint16_t	index;
 			uint16_t	messageIndex, metaIndex;
-			uint8_t		nAttributes;
-			uint32_t	dataOff;
+			uint8_t		nAttributes, reserved;
 		};
 
+		/* For STRING and ARRAY8 attributes, attr_valueOff is the
+		 * offset of the value in strings.zudi-index. BOOLEAN and
+		 * UBIT32 values are stored in attr_valueOff itself.
+		 * attr_nameId is the ID of the attribute's name in the
+		 * attribute name dictionary (see sAttrNameDict).
+		 **/
 		struct sAttrData
 		{
+			uint32_t	attr_valueOff;
+			uint16_t	attr_nameId;
 			uint8_t		attr_type, attr_length;
-			uint32_t	attr_nameOff, attr_valueOff;
 		};
 
 		struct _sAttrData
@@ -50,21 +389,127 @@ namespace zui
 		public udi_instance_attr_list_t
 		{
 #if !defined(__ZAMBESII_KERNEL_SOURCE__)
-			int writeOut(FILE *outfile, FILE *stringfile);
+			int writeOut(sectionS *dataS, sectionS *stringS);
 #endif
 		};
 
-		#define ZUI_DEVICE_MAX_NATTRS		(20)
 		struct _sDevice
 		{
 #if !defined(__ZAMBESII_KERNEL_SOURCE__)
 			int  writeOut(
-				FILE *headerfile, FILE *datafile,
-				FILE *strings);
+				sectionS *headerS, sectionS *dataS,
+				sectionS *stringS);
 #endif
 
 			struct sHeader		h;
-			struct _sAttrData	d[ZUI_DEVICE_MAX_NATTRS];
+			// h.nAttributes of them, in the driver's arena.
+			struct _sAttrData	*d;
+		};
+
+		/**	EXPLANATION:
+		 * Device match table. Every attribute of every device line is
+		 * entered under the hash of its (metalanguage, attribute name,
+		 * attribute value) tuple, so that an enumerated device can be
+		 * matched against the index by probing for one of its
+		 * attributes (e.g. pci_device_id) rather than by scanning
+		 * every device record.
+		 *
+		 * The table is an sMatchTable, followed by nBuckets + 1
+		 * uint32_t bucket starts, followed by nEntries sMatchEntry
+		 * records grouped by bucket. The entries of bucket
+		 * "hash & (nBuckets - 1)" are entries[start[b]] up to, but
+		 * not including, entries[start[b + 1]]. nBuckets is a power of
+		 * two, and at least nEntries, so a bucket rarely holds more
+		 * than one or two entries.
+		 *
+		 * deviceOff is the offset of the device's sHeader within
+		 * devices.zudi-index. Different tuples can have the same hash,
+		 * so each candidate's attributes must still be compared. The
+		 * entries of drivers removed by "--sync" are dropped.
+		 **/
+		struct sMatchTable
+		{
+			uint32_t	nBuckets, nEntries;
+		};
+
+		struct sMatchEntry
+		{
+			uint32_t	hash, deviceOff;
+		};
+
+		/* The value is hashed as it would appear in a STRING or ARRAY8
+		 * attribute: the bytes of the string without its terminator,
+		 * or of the array. BOOLEAN and UBIT32 values are hashed as
+		 * four bytes, least significant first; see
+		 * matchHashScalar().
+		 **/
+		static inline uint32_t matchHash(
+			const char *meta, const char *attrName, uint8_t attrType,
+			const void *value, uint32_t valueLen
+			)
+		{
+			uint32_t	hash=2166136261u;
+			uint32_t	metaLen=0, nameLen=0;
+
+			while (meta[metaLen] != '\0') { metaLen++; };
+			while (attrName[nameLen] != '\0') { nameLen++; };
+
+			hash = hashBytes(hash, meta, metaLen + 1);
+			hash = hashBytes(hash, attrName, nameLen + 1);
+			hash = hashBytes(hash, &attrType, 1);
+			return hashBytes(hash, value, valueLen);
+		}
+
+		static inline uint32_t matchHashScalar(
+			const char *meta, const char *attrName, uint8_t attrType,
+			uint32_t value
+			)
+		{
+			uint8_t		bytes[4];
+
+			for (int i=0; i<4; i++) { bytes[i] = value >> (i * 8); };
+			return matchHash(meta, attrName, attrType, bytes, 4);
+		}
+
+		/**	EXPLANATION:
+		 * Columnar attribute table. The attributes of every device
+		 * line are also kept one column per field, so that a matcher
+		 * can compare the value of an enumerated device's attribute
+		 * against every candidate with vector compares, instead of
+		 * walking sAttrData records one by one.
+		 *
+		 * The table is an sAttrColumns, followed by its columns, each
+		 * holding nRows elements. Row i of the table is made up of
+		 * element i of every column:
+		 *	nameIds:	the attribute's name ID (see
+		 *			sAttrNameDict), as a uint32_t.
+		 *	values:		the attribute's value, as in
+		 *			sAttrData::attr_valueOff.
+		 *	deviceOffs:	the offset of the device's sHeader within
+		 *			devices.zudi-index.
+		 *	types:		the attribute's type, one byte per row.
+		 *
+		 * The column offsets are from the start of the sAttrColumns.
+		 * The table starts on a ZUI_ATTR_COLUMNS_ALIGNMENT boundary
+		 * within the file, and every column is zero padded to a
+		 * multiple of it, so a reader may load whole vectors up to the
+		 * end of the padding, as long as it ignores lanes past nRows.
+		 *
+		 * Rows are sorted by name ID, then by type, value and device,
+		 * so the rows of one attribute name are a single run which can
+		 * be found by a binary search of nameIds. Only BOOLEAN and
+		 * UBIT32 values can be compared directly: those of STRING and
+		 * ARRAY8 attributes are string offsets, and the same bytes can
+		 * be at more than one offset. The metalanguage isn't part of
+		 * the row, so a matching row's device must still be checked.
+		 **/
+		#define ZUI_ATTR_COLUMNS_ALIGNMENT	(32)
+		struct sAttrColumns
+		{
+			uint32_t	nRows;
+			uint32_t	nameIdsOff, valuesOff, deviceOffsOff,
+					typesOff;
+			uint32_t	reserved[3];
 		};
 	}
 
@@ -75,30 +520,56 @@ namespace zui
 	{
 		enum typeE	{ DRIVERTYPE_DRIVER, DRIVERTYPE_METALANGUAGE };
 
+		// The driver has been removed from the index; skip it.
+		#define ZUI_DRIVER_FLAGS_REMOVED	(1<<0)
+		// Every string the driver refers to is in its string extent.
+		#define ZUI_DRIVER_FLAGS_CONTIGUOUS	(1<<1)
+		// The driver's messages are in sMessageBlocks.
+		#define ZUI_DRIVER_FLAGS_COMPRESSED_MESSAGES	(1<<2)
+
+		/**	EXPLANATION:
+		 * Match filter. Every driver header carries a bloom filter of
+		 * ZUI_MATCH_FILTER_NBITS bits, over the (attribute name,
+		 * value) pairs of the driver's device lines and the names of
+		 * its metalanguages. Each key sets ZUI_MATCH_FILTER_NPROBES
+		 * bits; bit n is bit (n % 32) of matchFilter[n / 32].
+		 *
+		 * While enumerating a child, a matcher can test the child's
+		 * metalanguage and its attributes against the filters of the
+		 * driver headers alone: a driver none of whose device lines
+		 * share an attribute with the child, or which doesn't use the
+		 * child's metalanguage, can't match it, and is passed over
+		 * without touching devices.zudi-index or strings.zudi-index.
+		 * A hit is only a maybe; the driver's devices must still be
+		 * compared. A driver with very many device lines fills its
+		 * filter up, and then passes every test.
+		 *
+		 * The keys are hashed with matchFilterAttrHash() and
+		 * matchFilterMetaHash(). An attribute's value is hashed as in
+		 * device::matchHash().
+		 **/
+		#define ZUI_MATCH_FILTER_NBITS		(512)
+		#define ZUI_MATCH_FILTER_NPROBES	(4)
+		#define ZUI_MATCH_FILTER_NWORDS		(ZUI_MATCH_FILTER_NBITS / 32)
+
 		struct sHeader
 		{
+			/* contentHash is a hash of the udiprops the driver was
+			 * compiled from, and sourcePathOff is the offset of that
+			 * file's path within strings.zudi-index. They let a
+			 * re-index skip drivers whose udiprops haven't changed.
+			 **/
+			uint64_t	contentHash;
+
 			// TODO: Add support for custom attributes.
 			uint32_t	id, type;
-			uint16_t	nameIndex, supplierIndex, contactIndex,
-			// Category index is only valid for meta libs, not drivers.
-					categoryIndex;
-			char		shortName[ZUI_DRIVER_SHORTNAME_MAXLEN];
-			char		releaseString[ZUI_DRIVER_RELEASE_MAXLEN];
-			char		releaseStringIndex;
 			uint32_t	requiredUdiVersion;
-			char		basePath[ZUI_DRIVER_BASEPATH_MAXLEN];
 
 			/* dataFileOffset is the offset within data.zudi-index.
 			 * rankFileOffset is the offset within ranks.zudi-index.
 			 **/
 			uint32_t	dataFileOffset, rankFileOffset,
 					deviceFileOffset, provisionFileOffset;
-			uint8_t		nMetalanguages, nChildBops, nParentBops,
-					nInternalBops,
-					nModules, nRequirements,
-					nMessages, nDisasterMessages,
-					nMessageFiles, nReadableFiles, nRegions,
-					nDevices, nRanks, nProvisions;
 
 			uint32_t	requirementsOffset, metalanguagesOffset,
 					childBopsOffset, parentBopsOffset,
@@ -106,14 +577,123 @@ namespace zui
 					regionsOffset, messagesOffset,
 					disasterMessagesOffset,
 					messageFilesOffset, readableFilesOffset;
+
+			uint32_t	sourcePathOff, flags;
+
+			/* Extents of the driver's own records: everything
+			 * written for it into data.zudi-index starts at
+			 * dataFileOffset and takes up dataFileLength bytes,
+			 * and the strings it was the first to use are in
+			 * [stringFileOffset, +stringFileLength) of
+			 * strings.zudi-index. If it was indexed with
+			 * "--contiguous", ZUI_DRIVER_FLAGS_CONTIGUOUS is
+			 * set, and all of its strings are in that extent; the
+			 * driver can then be read in with one readahead of
+			 * each, rather than faulting in pages shared with
+			 * other drivers.
+			 **/
+			uint32_t	dataFileLength;
+			uint32_t	stringFileOffset, stringFileLength;
+			// See sMessageLocale. 0 if the driver has no messages.
+			uint32_t	messageLocalesOffset;
+			uint32_t	matchFilter[ZUI_MATCH_FILTER_NWORDS];
+
+			uint16_t	nameIndex, supplierIndex, contactIndex,
+			// Category index is only valid for meta libs, not drivers.
+					categoryIndex,
+					releaseStringIndex;
+
+			uint8_t		nMetalanguages, nChildBops, nParentBops,
+					nInternalBops,
+					nModules, nRequirements,
+					nMessages, nDisasterMessages,
+					nMessageFiles, nReadableFiles, nRegions,
+					nDevices, nRanks, nProvisions;
+
+			char		shortName[ZUI_DRIVER_SHORTNAME_MAXLEN];
+			char		releaseString[ZUI_DRIVER_RELEASE_MAXLEN];
+			char		basePath[ZUI_DRIVER_BASEPATH_MAXLEN];
 		};
 
-		#define ZUI_DRIVER_MAX_NREQUIREMENTS		(16)
-		#define ZUI_DRIVER_MAX_NMETALANGUAGES		(16)
-		#define ZUI_DRIVER_MAX_NCHILD_BOPS		(12)
-		#define ZUI_DRIVER_MAX_NPARENT_BOPS		(8)
-		#define ZUI_DRIVER_MAX_NINTERNAL_BOPS		(24)
-		#define ZUI_DRIVER_MAX_NMODULES		(16)
+		static inline uint32_t matchFilterAttrHash(
+			const char *attrName, uint8_t attrType,
+			const void *value, uint32_t valueLen
+			)
+		{
+			uint32_t	hash=2166136261u, nameLen=0;
+
+			while (attrName[nameLen] != '\0') { nameLen++; };
+
+			hash = hashBytes(hash, attrName, nameLen + 1);
+			hash = hashBytes(hash, &attrType, 1);
+			return hashBytes(hash, value, valueLen);
+		}
+
+		static inline uint32_t matchFilterAttrHashScalar(
+			const char *attrName, uint8_t attrType, uint32_t value
+			)
+		{
+			uint8_t		bytes[4];
+
+			for (int i=0; i<4; i++) { bytes[i] = value >> (i * 8); };
+			return matchFilterAttrHash(
+				attrName, attrType, bytes, 4);
+		}
+
+		static inline uint32_t matchFilterMetaHash(const char *meta)
+		{
+			// No attribute type is 0xFF, so this is never a pair's.
+			const uint8_t	tag=0xFF;
+			uint32_t	hash=2166136261u, metaLen=0;
+
+			while (meta[metaLen] != '\0') { metaLen++; };
+
+			hash = hashBytes(hash, meta, metaLen + 1);
+			return hashBytes(hash, &tag, 1);
+		}
+
+		/* The probes of a key are spread by double hashing, with the
+		 * step taken from a remix of the key's hash.
+		 **/
+		static inline uint32_t matchFilterStep(uint32_t hash)
+		{
+			hash ^= hash >> 16;
+			hash *= 0x85EBCA6Bu;
+			hash ^= hash >> 13;
+			return hash | 1;
+		}
+
+		static inline void matchFilterAdd(
+			uint32_t *filter, uint32_t hash
+			)
+		{
+			uint32_t	step=matchFilterStep(hash), bit;
+
+			for (int i=0; i<ZUI_MATCH_FILTER_NPROBES; i++)
+			{
+				bit = (hash + i * step)
+					% ZUI_MATCH_FILTER_NBITS;
+				filter[bit / 32] |= 1u << (bit % 32);
+			};
+		}
+
+		// False if the key is certainly not in the filter.
+		static inline bool matchFilterTest(
+			const uint32_t *filter, uint32_t hash
+			)
+		{
+			uint32_t	step=matchFilterStep(hash), bit;
+
+			for (int i=0; i<ZUI_MATCH_FILTER_NPROBES; i++)
+			{
+				bit = (hash + i * step)
+					% ZUI_MATCH_FILTER_NBITS;
+				if (!(filter[bit / 32] & (1u << (bit % 32))))
+					{ return false; };
+			};
+
+			return true;
+		}
 
 		#define ZUI_DRIVER_METALANGUAGE_MAXLEN		(32)
 		#define ZUI_DRIVER_REQUIREMENT_MAXLEN		\
@@ -128,7 +708,7 @@ namespace zui
 		struct _sRequirement
 		{
 #if !defined(__ZAMBESII_KERNEL_SOURCE__)
-			int writeOut(FILE *dataF, FILE *stringF);
+			int writeOut(sectionS *dataS, sectionS *stringS);
 #endif
 
 			uint32_t	version;
@@ -137,14 +717,14 @@ namespace zui
 
 		struct sMetalanguage
 		{
-			uint16_t	index;
 			uint32_t	nameOff;
+			uint16_t	index, reserved;
 		};
 
 		struct _sMetalanguage
 		{
 #if !defined(__ZAMBESII_KERNEL_SOURCE__)
-			int writeOut(FILE *dataF, FILE *stringF);
+			int writeOut(sectionS *dataS, sectionS *stringS);
 #endif
 
 			uint16_t	index;
@@ -153,7 +733,7 @@ namespace zui
 
 		struct sChildBop
 		{
-			uint16_t	metaIndex, regionIndex, opsIndex;
+			uint16_t	metaIndex, regionIndex, opsIndex, reserved;
 		};
 
 		struct sParentBop
@@ -165,19 +745,20 @@ namespace zui
 		struct sInternalBop
 		{
 			uint16_t	metaIndex, regionIndex,
-					opsIndex0, opsIndex1, bindCbIndex;
+					opsIndex0, opsIndex1, bindCbIndex,
+					reserved;
 		};
 
 		struct sModule
 		{
-			uint16_t	index;
 			uint32_t	fileNameOff;
+			uint16_t	index, reserved;
 		};
 
 		struct _sModule
 		{
 #if !defined(__ZAMBESII_KERNEL_SOURCE__)
-			int writeOut(FILE *dataF, FILE *stringF);
+			int writeOut(sectionS *dataS, sectionS *stringS);
 #endif
 
 			uint16_t	index;
@@ -198,45 +779,159 @@ namespace zui
 		struct sRegion
 		{
 #if !defined(__ZAMBESII_KERNEL_SOURCE__)
-			int writeOut(FILE *dataF, FILE *stringF);
+			int writeOut(sectionS *dataS, sectionS *stringS);
 #endif
 
-			uint32_t	driverId;
+			uint32_t	driverId, flags;
 			uint16_t	index, moduleIndex;
 			uint8_t		priority;
 			uint8_t		latency;
-			uint32_t	flags;
+			uint16_t	reserved;
 		};
 
+		/* Normally messageOff is the offset of the message's text in
+		 * strings.zudi-index, and textOff is 0. If the driver has
+		 * ZUI_DRIVER_FLAGS_COMPRESSED_MESSAGES, messageOff is the
+		 * offset in data.zudi-index of the sMessageBlock that holds the
+		 * text, and textOff is where the text starts in the block once
+		 * it is decompressed.
+		 **/
 		struct sMessage
 		{
-			uint32_t	driverId;
-			uint16_t	index;
-			uint32_t	messageOff;
+			uint32_t	driverId, messageOff;
+			uint16_t	index, textOff;
+		};
+
+		/**	EXPLANATION:
+		 * Message locales. The "locale" lines of a udiprops file set
+		 * the locale of the messages that follow them, up to the next
+		 * one; messages before the first are in the "C" locale. A
+		 * driver's sMessage records are grouped by locale, and the
+		 * records of each locale are sorted by index (messages with
+		 * the same index stay in source order).
+		 *
+		 * The driver's locale directory, at messageLocalesOffset in
+		 * data.zudi-index, is an sMessageLocaleDir, followed by an
+		 * sMessageLocale for each locale: the "C" locale's first, if
+		 * the driver has any messages in it, then the others sorted
+		 * by nameHash (see localeHash()). A locale's messages are
+		 * records [firstMessage, +nMessages) of the driver's.
+		 *
+		 * A reader hashes its preferred locale once, picks each
+		 * driver's entry for it from the directory, and falls back to
+		 * the "C" locale's entry for messages that aren't translated.
+		 * Different names can have the same hash, so the name at
+		 * nameOff (in strings.zudi-index) must still be compared.
+		 **/
+		#define ZUI_LOCALE_MAXLEN		(32)
+		#define ZUI_LOCALE_DEFAULT		"C"
+
+		struct sMessageLocaleDir
+		{
+			uint16_t	nLocales, reserved;
+		};
+
+		struct sMessageLocale
+		{
+			uint32_t	nameHash, nameOff;
+			// See sMessageTable. 0 if the locale has none.
+			uint32_t	tableOffset;
+			uint16_t	firstMessage, nMessages;
+		};
+
+		static inline uint32_t localeHash(const char *name)
+		{
+			uint32_t	len=0;
+
+			while (name[len] != '\0') { len++; };
+			return hashBytes(2166136261u, name, len);
+		}
+
+		/**	EXPLANATION:
+		 * Message table. Each locale's messages have a dense table in
+		 * data.zudi-index, at tableOffset in its sMessageLocale, so
+		 * that the message named by a device's messageIndex, or by
+		 * the driver's nameIndex, is found in constant time.
+		 *
+		 * The table is an sMessageTable, followed by nSlots uint16_t
+		 * slots, zero padded to a multiple of 4 bytes. Slot i holds
+		 * the position, among the locale's sMessage records, of the
+		 * first message with index firstIndex + i, or
+		 * ZUI_MESSAGE_TABLE_NONE if there is none; see
+		 * messageTableSlot(). A locale whose message indexes are too
+		 * sparse for the table to be worth its size
+		 * (ZUI_MESSAGE_TABLE_MAX_NSLOTS()) has none, and its records
+		 * can be binary searched instead.
+		 **/
+		#define ZUI_MESSAGE_TABLE_NONE		(0xFFFF)
+		#define ZUI_MESSAGE_TABLE_MAX_NSLOTS(__nMessages)	\
+			((__nMessages) * 4 + 16)
+
+		struct sMessageTable
+		{
+			uint16_t	firstIndex, nSlots;
+		};
+
+		static inline uint16_t messageTableSlot(
+			const sMessageTable *table, const uint16_t *slots,
+			uint16_t index
+			)
+		{
+			if (index < table->firstIndex
+				|| index - table->firstIndex >= table->nSlots)
+			{
+				return ZUI_MESSAGE_TABLE_NONE;
+			};
+
+			return slots[index - table->firstIndex];
+		}
+
+		/**	EXPLANATION:
+		 * Compressed message block. With "--compress-messages", the
+		 * text of a driver's messages is packed, NUL-terminated, into
+		 * blocks of up to ZUI_MESSAGE_BLOCK_MAXLEN bytes, which are
+		 * compressed one by one (see zui::lz) and stored in
+		 * data.zudi-index right after the driver's sMessage records,
+		 * locale directory and message tables.
+		 * Any one message can be had by decompressing a single small
+		 * block, and the text of the messages, which is rarely needed,
+		 * stays out of strings.zudi-index.
+		 *
+		 * The header is followed by compressedLength bytes of
+		 * compressed data, or, if compressedLength is 0, by length
+		 * bytes of plain text. That is zero padded to a multiple of 4
+		 * bytes, to keep the records after it aligned. Disaster
+		 * messages are never compressed, so that they can be printed
+		 * with nothing more than a string lookup.
+		 **/
+		#define ZUI_MESSAGE_BLOCK_MAXLEN	(4096)
+		struct sMessageBlock
+		{
+			uint16_t	length, compressedLength;
 		};
 
 		struct _sMessage
 		{
 #if !defined(__ZAMBESII_KERNEL_SOURCE__)
-			int writeOut(FILE *dataF, FILE *stringF);
+			int writeOut(sectionS *dataS, sectionS *stringS);
 #endif
 
 			uint32_t	driverId;
 			uint16_t	index;
+			char		locale[ZUI_LOCALE_MAXLEN];
 			char		message[ZUI_MESSAGE_MAXLEN];
 		};
 
 		struct sDisasterMessage
 		{
-			uint32_t	driverId;
-			uint16_t	index;
-			uint32_t	messageOff;
+			uint32_t	driverId, messageOff;
+			uint16_t	index, reserved;
 		};
 
 		struct _sDisasterMessage
 		{
 #if !defined(__ZAMBESII_KERNEL_SOURCE__)
-			int writeOut(FILE *dataF, FILE *stringF);
+			int writeOut(sectionS *dataS, sectionS *stringS);
 #endif
 
 			uint32_t	driverId;
@@ -246,15 +941,14 @@ namespace zui
 
 		struct sMessageFile
 		{
-			uint32_t	driverId;
-			uint16_t	index;
-			uint32_t	fileNameOff;
+			uint32_t	driverId, fileNameOff;
+			uint16_t	index, reserved;
 		};
 
 		struct _sMessageFile
 		{
 #if !defined(__ZAMBESII_KERNEL_SOURCE__)
-			int writeOut(FILE *dataF, FILE *stringF);
+			int writeOut(sectionS *dataS, sectionS *stringS);
 #endif
 
 			uint32_t	driverId;
@@ -264,17 +958,18 @@ namespace zui
 
 		struct sReadableFile
 		{
-			uint16_t	driverId, index;
-			uint32_t	fileNameOff;
+			uint32_t	driverId, fileNameOff;
+			uint16_t	index, reserved;
 		};
 
 		struct _sReadableFile
 		{
 #if !defined(__ZAMBESII_KERNEL_SOURCE__)
-			int writeOut(FILE *dataF, FILE *stringF);
+			int writeOut(sectionS *dataS, sectionS *stringS);
 #endif
 
-			uint16_t	driverId, index;
+			uint32_t	driverId;
+			uint16_t	index;
 			char		fileName[ZUI_FILENAME_MAXLEN];
 		};
 
@@ -289,7 +984,7 @@ namespace zui
 		struct _sProvision
 		{
 #if !defined(__ZAMBESII_KERNEL_SOURCE__)
-			int writeOut(FILE *dataF, FILE *stringF);
+			int writeOut(sectionS *dataS, sectionS *stringS);
 #endif
 
 			uint32_t	driverId;
@@ -297,48 +992,104 @@ namespace zui
 			char		name[ZUI_PROVISION_NAME_MAXLEN];
 		};
 
-		struct sDriver
+		/**	EXPLANATION:
+		 * Provision directory: one entry for every "provides" line of
+		 * every live metalanguage library in the index, sorted by
+		 * nameHash (then driverId and version). A driver's
+		 * requirement is resolved by hashing its name with
+		 * provisionHash() and binary searching for it, instead of
+		 * comparing it against every provision record. Different
+		 * names can have the same hash, so the name at nameOff (in
+		 * strings.zudi-index) must still be compared.
+		 **/
+		struct sProvisionDirEntry
 		{
-			struct zui::driver::sHeader	h;
-			struct _sRequirement		requirements[
-				ZUI_DRIVER_MAX_NREQUIREMENTS];
+			uint32_t	nameHash, version, driverId, nameOff;
+		};
 
-			struct _sMetalanguage		metalanguages[
-				ZUI_DRIVER_MAX_NMETALANGUAGES];
+		static inline uint32_t provisionHash(const char *name)
+		{
+			uint32_t	len=0;
 
-			struct sChildBop		childBops[
-				ZUI_DRIVER_MAX_NCHILD_BOPS];
+			while (name[len] != '\0') { len++; };
+			return hashBytes(2166136261u, name, len);
+		}
 
-			struct sParentBop		parentBops[
-				ZUI_DRIVER_MAX_NPARENT_BOPS];
+		/**	EXPLANATION:
+		 * Requirement closure table: the load order of every live
+		 * driver and metalanguage library in the index, worked out
+		 * by the index compiler, so that the kernel can bring a
+		 * driver up by walking one array instead of chasing its
+		 * requirements through the provision directory at boot.
+		 *
+		 * The table is an sClosureTable, followed by nDrivers
+		 * sClosure records sorted by driverId, followed by nIds
+		 * uint32_t driver IDs. The closure of a driver is
+		 * ids[idsIndex] up to, but not including,
+		 * ids[idsIndex + nIds]: every library it needs, directly or
+		 * not, each listed after the libraries it needs in turn, and
+		 * finally the driver itself. Loading them in that order
+		 * satisfies every requirement before it is needed.
+		 *
+		 * A requirement is met by the live provider of the same name
+		 * with the highest version that is no lower than the one
+		 * required (the lowest driverId breaks ties). "udi" and
+		 * "udi_physio" are provided by the environment. If a
+		 * requirement can't be met, or the requirements loop, the
+		 * closure is still written as far as it goes, and flagged.
+		 **/
+		// Some requirement in the closure has no provider.
+		#define ZUI_CLOSURE_FLAGS_MISSING_PROVIDER	(1<<0)
+		// The requirements loop back on themselves.
+		#define ZUI_CLOSURE_FLAGS_CYCLE			(1<<1)
 
-			struct sInternalBop		internalBops[
-				ZUI_DRIVER_MAX_NINTERNAL_BOPS];
+		struct sClosureTable
+		{
+			uint32_t	nDrivers, nIds;
+		};
 
-			struct _sModule			modules[
-				ZUI_DRIVER_MAX_NMODULES];
+		struct sClosure
+		{
+			uint32_t	driverId, idsIndex, nIds;
+			uint16_t	flags, reserved;
+		};
+
+		/* The compiler's view of a driver. Each array holds as many
+		 * records as its count in h says, and lives in the arena of
+		 * the driver's parser context; they grow as the udiprops is
+		 * parsed.
+		 **/
+		struct sDriver
+		{
+			struct zui::driver::sHeader	h;
+			struct _sRequirement		*requirements;
+			struct _sMetalanguage		*metalanguages;
+			struct sChildBop		*childBops;
+			struct sParentBop		*parentBops;
+			struct sInternalBop		*internalBops;
+			struct _sModule			*modules;
 		};
 	}
 
 	namespace rank
 	{
-		#define ZUI_RANK_MAX_NATTRS		(ZUI_DEVICE_MAX_NATTRS)
 		struct sHeader
 		{
-			uint32_t	driverId;
+			uint32_t	driverId, dataOff;
 			uint8_t		nAttributes, rank;
-			uint32_t	dataOff;
+			uint16_t	reserved;
 		};
 
+		// nameId is as in device::sAttrData.
 		struct sRankAttr
 		{
-			uint32_t	nameOff;
+			uint16_t	nameId, reserved;
 		};
 
 		struct _sRankAttr
 		{
 #if !defined(__ZAMBESII_KERNEL_SOURCE__)
-			int writeOut(FILE *dataF, FILE *stringF);
+			int writeOut(sectionS *dataS, sectionS *stringS);
 #endif
 
 			char		name[UDI_MAX_ATTR_NAMELEN];
@@ -347,14 +1098,126 @@ namespace zui
 		struct _sRank
 		{
 #if !defined(__ZAMBESII_KERNEL_SOURCE__)
-			int writeOut(FILE *rankF, FILE *dataF, FILE *stringF);
+			int writeOut(
+				sectionS *rankS, sectionS *dataS,
+				sectionS *stringS);
 #endif
 
 			struct zui::rank::sHeader	h;
-			struct zui::rank::_sRankAttr	d[ZUI_RANK_MAX_NATTRS];
+			// h.nAttributes of them, in the driver's arena.
+			struct zui::rank::_sRankAttr	*d;
+		};
+	}
+
+	/**	EXPLANATION:
+	 * Single-file index container, written by "zudiindex -p". It holds
+	 * the committed contents of every index file as one section each, so
+	 * that a loader can bring in the whole index with one read or one
+	 * mmap().
+	 *
+	 * The file starts with a container::sHeader, followed by the section
+	 * table. Entry N of the table describes the section of type N, so
+	 * any section is found without a search. Every section starts on a
+	 * ZUI_CONTAINER_ALIGNMENT boundary; the gaps are zero filled. The
+	 * SECTION_DRIVERS section starts with the usual zui::sHeader.
+	 *
+	 * "endianness" is the same string as in zui::sHeader, and everything
+	 * after it is in that byte order.
+	 **/
+	#define ZUI_CONTAINER_MAGIC		"ZUDIPAK"
+	#define ZUI_CONTAINER_ALIGNMENT		(4096)
+	namespace container
+	{
+		// Same order as the index files.
+		enum sectionTypeE {
+			SECTION_DRIVERS=0, SECTION_DATA, SECTION_DEVICES,
+			SECTION_STRINGS, SECTION_RANKS, SECTION_PROVISIONS,
+			SECTION_N_TYPES };
+
+		struct sHeader
+		{
+			char		magic[8];
+			char		endianness[4];
+			uint16_t	majorVersion, minorVersion;
+			uint32_t	fileSize;
+			uint32_t	nSections, sectionTableOff;
+			// See checksum().
+			uint32_t	checksum;
 		};
+
+		struct sSection
+		{
+			uint32_t	type, alignment;
+			uint32_t	offset, length;
+		};
+
+		/* CRC32C of the container header as it is stored, with
+		 * "checksum" taken as 0, and of the nSections entries of the
+		 * section table after it. The sections themselves are covered
+		 * by the checksums in the index header.
+		 **/
+		static inline uint32_t checksum(
+			const sHeader *h, const sSection *table,
+			uint32_t nSections
+			)
+		{
+			const uint8_t	*p=(const uint8_t *)h;
+			uint32_t	off, crc, zero=0;
+
+			off = (uint32_t)((const uint8_t *)&h->checksum - p);
+			crc = crc32c(0, p, off, 0);
+			crc = crc32c(crc, &zero, sizeof(zero), 0);
+			return crc32c(
+				crc, table, nSections * sizeof(*table), 0);
+		}
 	}
+
+	// Sizes of the on-disk records. See the EXPLANATION at the top.
+	static_assert(sizeof(sHeader) == 168, "zui::sHeader size");
+	static_assert(sizeof(device::sHeader) == 16, "device::sHeader size");
+	static_assert(sizeof(device::sAttrData) == 8, "device::sAttrData size");
+	static_assert(
+		sizeof(device::sMatchTable) == 8, "device::sMatchTable size");
+	static_assert(
+		sizeof(device::sMatchEntry) == 8, "device::sMatchEntry size");
+	static_assert(
+		sizeof(device::sAttrColumns) == 32, "device::sAttrColumns size");
+	static_assert(sizeof(sAttrNameDict) == 8, "sAttrNameDict size");
+	static_assert(sizeof(driver::sHeader) == 368, "driver::sHeader size");
+	static_assert(sizeof(driver::sRequirement) == 8, "sRequirement size");
+	static_assert(sizeof(driver::sMetalanguage) == 8, "sMetalanguage size");
+	static_assert(sizeof(driver::sChildBop) == 8, "sChildBop size");
+	static_assert(sizeof(driver::sParentBop) == 8, "sParentBop size");
+	static_assert(sizeof(driver::sInternalBop) == 12, "sInternalBop size");
+	static_assert(sizeof(driver::sModule) == 8, "sModule size");
+	static_assert(sizeof(driver::sRegion) == 16, "sRegion size");
+	static_assert(sizeof(driver::sMessage) == 12, "sMessage size");
+	static_assert(
+		sizeof(driver::sMessageLocaleDir) == 4,
+		"sMessageLocaleDir size");
+	static_assert(
+		sizeof(driver::sMessageLocale) == 16, "sMessageLocale size");
+	static_assert(
+		sizeof(driver::sMessageTable) == 4, "sMessageTable size");
+	static_assert(
+		sizeof(driver::sMessageBlock) == 4, "sMessageBlock size");
+	static_assert(
+		sizeof(driver::sDisasterMessage) == 12, "sDisasterMessage size");
+	static_assert(sizeof(driver::sMessageFile) == 12, "sMessageFile size");
+	static_assert(sizeof(driver::sReadableFile) == 12, "sReadableFile size");
+	static_assert(sizeof(driver::sProvision) == 12, "sProvision size");
+	static_assert(
+		sizeof(driver::sProvisionDirEntry) == 16,
+		"sProvisionDirEntry size");
+	static_assert(
+		sizeof(driver::sClosureTable) == 8, "sClosureTable size");
+	static_assert(sizeof(driver::sClosure) == 16, "sClosure size");
+	static_assert(sizeof(rank::sHeader) == 12, "rank::sHeader size");
+	static_assert(sizeof(rank::sRankAttr) == 4, "rank::sRankAttr size");
+	static_assert(
+		sizeof(container::sHeader) == 32, "container::sHeader size");
+	static_assert(
+		sizeof(container::sSection) == 16, "container::sSection size");
 }
 
 #endif
-
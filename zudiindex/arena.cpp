@@ -0,0 +1,129 @@
+#include "zudipropsc.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+
+/**	EXPLANATION:
+ * Per-driver arena for the variable-length parts of a parsed driver: the
+ * requirements, metalanguages, bind ops and modules of its sDriver, and the
+ * attributes of its device and rank lines.
+ *
+ * Memory is carved out of zero filled blocks of ARENA_BLOCK_SIZE bytes (or of
+ * a block of its own, for anything bigger), and is only ever given back all
+ * at once by arena_free(), when the driver's parser context is released. So
+ * the memory used for a driver is proportional to what its udiprops actually
+ * says, rather than to fixed limits on how much it may say.
+ *
+ * Arrays grow by doubling. An array's capacity is never stored: it is a
+ * function of the number of elements in it (see arena_arrayCapacity()), so
+ * that the counts in the records' headers are all that need be kept. The
+ * space an array leaves behind when it grows isn't reused, which at most
+ * doubles what it takes up.
+ **/
+#define ARENA_BLOCK_SIZE		(4096)
+#define ARENA_ALIGNMENT			(alignof(max_align_t))
+#define ARENA_ARRAY_MIN_SLOTS		(4)
+
+// The block's memory follows its header, from arena_blockData() onward.
+struct arenaBlockS
+{
+	struct arenaBlockS	*next;
+	size_t			size, used;
+};
+
+static inline size_t arena_alignUp(size_t value)
+{
+	return (value + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+}
+
+static inline uint8_t *arena_blockData(struct arenaBlockS *block)
+{
+	return (uint8_t *)block + arena_alignUp(sizeof(*block));
+}
+
+void *arena_alloc(struct arenaS *a, size_t len)
+{
+	struct arenaBlockS	*block=a->blocks;
+	size_t			size;
+
+	len = arena_alignUp(len);
+	if (block == NULL || block->size - block->used < len)
+	{
+		size = (len > ARENA_BLOCK_SIZE) ? len : ARENA_BLOCK_SIZE;
+		block = (struct arenaBlockS *)calloc(
+			1, arena_alignUp(sizeof(*block)) + size);
+
+		if (block == NULL)
+		{
+			fprintf(stderr, "Error: Nomem while growing arena.\n");
+			return NULL;
+		};
+
+		block->size = size;
+		/* An oversized block is used up at once; keep filling the
+		 * current one instead.
+		 **/
+		if (size > ARENA_BLOCK_SIZE && a->blocks != NULL)
+		{
+			block->next = a->blocks->next;
+			a->blocks->next = block;
+			block->used = len;
+			return arena_blockData(block);
+		};
+
+		block->next = a->blocks;
+		a->blocks = block;
+	};
+
+	block->used += len;
+	return arena_blockData(block) + block->used - len;
+}
+
+// The number of slots that an array of "n" elements has room for.
+static inline uint32_t arena_arrayCapacity(uint32_t n)
+{
+	uint32_t	capacity=ARENA_ARRAY_MIN_SLOTS;
+
+	if (n == 0) { return 0; };
+	while (capacity < n) { capacity *= 2; };
+	return capacity;
+}
+
+int arena_allocArray(
+	struct arenaS *a, void **array, uint32_t n, size_t elemSize
+	)
+{
+	*array = NULL;
+	if (n == 0) { return EX_SUCCESS; };
+
+	*array = arena_alloc(a, arena_arrayCapacity(n) * elemSize);
+	return (*array == NULL) ? EX_NOMEM : EX_SUCCESS;
+}
+
+int arena_growArray(
+	struct arenaS *a, void **array, uint32_t n, size_t elemSize
+	)
+{
+	void		*tmp;
+
+	if (arena_arrayCapacity(n) > n) { return EX_SUCCESS; };
+
+	if (arena_allocArray(a, &tmp, n + 1, elemSize) != EX_SUCCESS)
+		{ return EX_NOMEM; };
+
+	if (n > 0) { memcpy(tmp, *array, n * elemSize); };
+	*array = tmp;
+	return EX_SUCCESS;
+}
+
+void arena_free(struct arenaS *a)
+{
+	struct arenaBlockS	*tmp;
+
+	while ((tmp = a->blocks) != NULL)
+	{
+		a->blocks = tmp->next;
+		free(tmp);
+	};
+}
@@ -0,0 +1,237 @@
+#include "zudipropsc.h"
+#include <string.h>
+#include <unistd.h>
+
+
+/**	EXPLANATION:
+ * Columnar attribute table (see zui.h), kept at the end of
+ * devices.zudi-index, right after the device match table.
+ *
+ * It is maintained the same way as the match table (see match.cpp), whose
+ * functions call the ones here: the rows of the devices written out in this
+ * run are collected by attrcol_addDevice(), the rows of the committed table
+ * are read back minus those of the devices that the update removed, and the
+ * whole table is written anew, sorted, so that it doesn't depend on the
+ * order in which the devices were added.
+ **/
+struct attrcolRowS
+{
+	uint32_t	nameId, value, deviceOff;
+	uint8_t		type;
+};
+
+// Rows are kept in host byte order until the table is written.
+static struct sectionS		rows;
+
+static int attrcol_addRow(
+	uint32_t nameId, uint8_t type, uint32_t value, uint32_t deviceOff
+	)
+{
+	struct attrcolRowS	r;
+
+	memset(&r, 0, sizeof(r));
+	r.nameId = nameId;
+	r.type = type;
+	r.value = value;
+	r.deviceOff = deviceOff;
+	return section_append(&rows, &r, sizeof(r), NULL);
+}
+
+/* Must be called right after the device was written out: its rows are
+ * taken from the sAttrData records that _sDevice::writeOut() just appended
+ * to the data section, which hold the name IDs and string offsets that it
+ * was given.
+ **/
+int attrcol_addDevice(
+	const struct zui::device::_sDevice *dev, uint32_t deviceOff
+	)
+{
+	struct sectionS			*dataS=&indexSections[IDXF_DATA];
+	struct zui::device::sAttrData	a;
+	uint32_t			off;
+
+	for (int i=0; i<dev->h.nAttributes; i++)
+	{
+		off = dev->h.dataOff + i * sizeof(a);
+		if (off < dataS->base
+			|| off - dataS->base + sizeof(a) > dataS->len)
+		{
+			return EX_GENERAL;
+		};
+
+		memcpy(&a, &dataS->buff[off - dataS->base], sizeof(a));
+		serial_decode(&a);
+		if (attrcol_addRow(
+			a.attr_nameId, a.attr_type, a.attr_valueOff,
+			deviceOff)
+			!= EX_SUCCESS)
+		{
+			return EX_NOMEM;
+		};
+	};
+
+	return EX_SUCCESS;
+}
+
+static int attrcol_checkColumn(
+	uint32_t tableLen, uint32_t columnOff, uint32_t nRows,
+	uint32_t elementSize
+	)
+{
+	if (columnOff > tableLen
+		|| (uint64_t)nRows * elementSize > tableLen - columnOff)
+	{
+		return EX_GENERAL;
+	};
+
+	return EX_SUCCESS;
+}
+
+int attrcol_loadCommitted(int fd)
+{
+	struct zui::device::sAttrColumns	t;
+	uint8_t					*buff;
+	uint32_t				len=indexHeader.attrColumnsLen;
+	uint32_t				nameId, value, deviceOff;
+	int					ret=EX_SUCCESS;
+
+	if (len == 0) { return EX_SUCCESS; };
+	if (len < sizeof(t)) { return EX_GENERAL; };
+
+	buff = (uint8_t *)malloc(len);
+	if (buff == NULL) { return EX_NOMEM; };
+
+	if (pread(fd, buff, len, indexHeader.attrColumnsOff) != (ssize_t)len)
+		{ free(buff); return EX_FILE_IO; };
+
+	memcpy(&t, buff, sizeof(t));
+	serial_decode(&t);
+	if (attrcol_checkColumn(len, t.nameIdsOff, t.nRows, 4) != EX_SUCCESS
+		|| attrcol_checkColumn(len, t.valuesOff, t.nRows, 4)
+			!= EX_SUCCESS
+		|| attrcol_checkColumn(len, t.deviceOffsOff, t.nRows, 4)
+			!= EX_SUCCESS
+		|| attrcol_checkColumn(len, t.typesOff, t.nRows, 1)
+			!= EX_SUCCESS)
+	{
+		free(buff);
+		return EX_GENERAL;
+	};
+
+	for (uint32_t i=0; i<t.nRows && ret == EX_SUCCESS; i++)
+	{
+		memcpy(&deviceOff, &buff[t.deviceOffsOff + i * 4], 4);
+		deviceOff = serial_value(deviceOff);
+		if (match_isRemoved(deviceOff)) { continue; };
+
+		memcpy(&nameId, &buff[t.nameIdsOff + i * 4], 4);
+		memcpy(&value, &buff[t.valuesOff + i * 4], 4);
+		ret = attrcol_addRow(
+			serial_value(nameId), buff[t.typesOff + i],
+			serial_value(value), deviceOff);
+	};
+
+	free(buff);
+	return ret;
+}
+
+static int attrcol_compareRows(const void *_a, const void *_b)
+{
+	const struct attrcolRowS	*a, *b;
+
+	a = (const struct attrcolRowS *)_a;
+	b = (const struct attrcolRowS *)_b;
+	if (a->nameId != b->nameId)
+		{ return (a->nameId < b->nameId) ? -1 : 1; };
+
+	if (a->type != b->type) { return (a->type < b->type) ? -1 : 1; };
+	if (a->value != b->value) { return (a->value < b->value) ? -1 : 1; };
+	if (a->deviceOff != b->deviceOff)
+		{ return (a->deviceOff < b->deviceOff) ? -1 : 1; };
+
+	return 0;
+}
+
+// Zero fills the section up to the next column boundary.
+static int attrcol_pad(struct sectionS *devS)
+{
+	static const uint8_t	zeroes[ZUI_ATTR_COLUMNS_ALIGNMENT]={0};
+	uint32_t		rem;
+
+	rem = section_tell(devS) % ZUI_ATTR_COLUMNS_ALIGNMENT;
+	if (rem == 0) { return EX_SUCCESS; };
+
+	return section_append(
+		devS, zeroes, ZUI_ATTR_COLUMNS_ALIGNMENT - rem, NULL);
+}
+
+static uint32_t attrcol_columnSize(uint32_t nRows, uint32_t elementSize)
+{
+	uint32_t	size=nRows * elementSize;
+
+	return (size + ZUI_ATTR_COLUMNS_ALIGNMENT - 1)
+		& ~(uint32_t)(ZUI_ATTR_COLUMNS_ALIGNMENT - 1);
+}
+
+int attrcol_writeTable(struct sectionS *devS)
+{
+	struct zui::device::sAttrColumns	t;
+	struct attrcolRowS			*r;
+	uint32_t				nRows, tableStart, v;
+	int					ret;
+
+	r = (struct attrcolRowS *)rows.buff;
+	nRows = rows.len / sizeof(*r);
+	indexHeader.attrColumnsLen = 0;
+	if (attrcol_pad(devS) != EX_SUCCESS) { return EX_NOMEM; };
+
+	tableStart = indexHeader.attrColumnsOff = section_tell(devS);
+	if (nRows == 0) { return attrname_writeTable(devS); };
+
+	qsort(r, nRows, sizeof(*r), &attrcol_compareRows);
+
+	memset(&t, 0, sizeof(t));
+	t.nRows = nRows;
+	t.nameIdsOff = sizeof(t);
+	t.valuesOff = t.nameIdsOff + attrcol_columnSize(nRows, 4);
+	t.deviceOffsOff = t.valuesOff + attrcol_columnSize(nRows, 4);
+	t.typesOff = t.deviceOffsOff + attrcol_columnSize(nRows, 4);
+
+	ret = serial_append(devS, &t, NULL);
+	for (uint32_t i=0; i<nRows && ret == EX_SUCCESS; i++)
+	{
+		v = serial_value(r[i].nameId);
+		ret = section_append(devS, &v, sizeof(v), NULL);
+	};
+
+	if (ret == EX_SUCCESS) { ret = attrcol_pad(devS); };
+	for (uint32_t i=0; i<nRows && ret == EX_SUCCESS; i++)
+	{
+		v = serial_value(r[i].value);
+		ret = section_append(devS, &v, sizeof(v), NULL);
+	};
+
+	if (ret == EX_SUCCESS) { ret = attrcol_pad(devS); };
+	for (uint32_t i=0; i<nRows && ret == EX_SUCCESS; i++)
+	{
+		v = serial_value(r[i].deviceOff);
+		ret = section_append(devS, &v, sizeof(v), NULL);
+	};
+
+	if (ret == EX_SUCCESS) { ret = attrcol_pad(devS); };
+	for (uint32_t i=0; i<nRows && ret == EX_SUCCESS; i++)
+		{ ret = section_append(devS, &r[i].type, 1, NULL); };
+
+	if (ret == EX_SUCCESS) { ret = attrcol_pad(devS); };
+	if (ret != EX_SUCCESS) { return EX_NOMEM; };
+
+	indexHeader.attrColumnsLen = section_tell(devS) - tableStart;
+	// The attribute name dictionary follows the columns.
+	return attrname_writeTable(devS);
+}
+
+void attrcol_free(void)
+{
+	free(rows.buff);
+	memset(&rows, 0, sizeof(rows));
+}
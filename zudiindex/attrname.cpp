@@ -0,0 +1,314 @@
+#include "zudipropsc.h"
+#include <string.h>
+#include <unistd.h>
+
+
+/**	EXPLANATION:
+ * Attribute name dictionary (see zui.h), kept at the end of
+ * devices.zudi-index, right after the columnar attribute table.
+ *
+ * Unlike the other tables at the ends of the files, the dictionary is needed
+ * before any record is written, since the attribute records hold name IDs:
+ * attrname_loadCommitted() reads the names of the committed dictionary back
+ * when an update that appends to the index starts, so that they keep their
+ * IDs, and attrname_intern() hands out the next ID to each name it hasn't
+ * seen. A compaction doesn't load the old dictionary, so it hands out every
+ * ID afresh as it writes the surviving drivers out again.
+ *
+ * The perfect hash is worked out anew on every commit, in
+ * attrname_writeTable(), by "hash and displace": the names are split into
+ * buckets of about ATTRNAME_BUCKET_SIZE names, and starting with the
+ * largest bucket, each bucket gets the first seed which sends all of its
+ * names to free slots.
+ **/
+#define ATTRNAME_BUCKET_SIZE		(4)
+#define ATTRNAME_MAX_SEED		(1u << 24)
+
+struct attrnameEntryS
+{
+	char		*name;
+	uint32_t	hash, nameOff;
+};
+
+struct attrnameBucketS
+{
+	uint32_t	index, start, nNames;
+};
+
+// Indexed by name ID.
+static struct sectionS		entries;
+
+#define ATTRNAME_ENTRIES		((struct attrnameEntryS *)entries.buff)
+#define ATTRNAME_N_ENTRIES		\
+	(entries.len / sizeof(struct attrnameEntryS))
+
+static int attrname_add(const char *name, uint32_t nameOff, uint16_t *id)
+{
+	struct attrnameEntryS	e;
+
+	if (ATTRNAME_N_ENTRIES >= ZUI_ATTR_NAME_MAX_NIDS)
+	{
+		fprintf(stderr, "Error: The index has more than %u distinct "
+			"attribute names.\n", ZUI_ATTR_NAME_MAX_NIDS);
+
+		return EX_GENERAL;
+	};
+
+	e.name = strdup(name);
+	if (e.name == NULL) { return EX_NOMEM; };
+
+	e.hash = zui::attrNameHash(name);
+	e.nameOff = nameOff;
+	if (id != NULL) { *id = ATTRNAME_N_ENTRIES; };
+	if (section_append(&entries, &e, sizeof(e), NULL) != EX_SUCCESS)
+		{ free(e.name); return EX_NOMEM; };
+
+	return EX_SUCCESS;
+}
+
+int attrname_loadCommitted(int fd)
+{
+	struct sectionS			*stringS=&indexSections[IDXF_STRINGS];
+	struct zui::sAttrNameDict	d;
+	uint8_t				*buff;
+	uint32_t			len=indexHeader.attrNamesLen, nameOff;
+	uint64_t			namesOff;
+	int				ret=EX_SUCCESS;
+
+	if (len == 0) { return EX_SUCCESS; };
+	if (len < sizeof(d)) { return EX_GENERAL; };
+
+	buff = (uint8_t *)malloc(len);
+	if (buff == NULL) { return EX_NOMEM; };
+
+	if (pread(fd, buff, len, indexHeader.attrNamesOff) != (ssize_t)len)
+		{ free(buff); return EX_FILE_IO; };
+
+	memcpy(&d, buff, sizeof(d));
+	serial_decode(&d);
+	namesOff = sizeof(d)
+		+ ((uint64_t)d.nBuckets + d.nNames) * sizeof(uint32_t);
+
+	if (d.nNames > ZUI_ATTR_NAME_MAX_NIDS
+		|| namesOff + (uint64_t)d.nNames * sizeof(uint32_t) != len)
+	{
+		free(buff);
+		return EX_GENERAL;
+	};
+
+	// The string section holds the whole string file.
+	for (uint32_t i=0; i<d.nNames && ret == EX_SUCCESS; i++)
+	{
+		memcpy(&nameOff, &buff[namesOff + i * sizeof(nameOff)], 4);
+		nameOff = serial_value(nameOff);
+		if (nameOff >= stringS->len
+			|| memchr(
+				&stringS->buff[nameOff], '\0',
+				stringS->len - nameOff) == NULL)
+		{
+			ret = EX_GENERAL;
+			break;
+		};
+
+		ret = attrname_add(
+			(const char *)&stringS->buff[nameOff], nameOff, NULL);
+	};
+
+	free(buff);
+	return ret;
+}
+
+int attrname_intern(
+	struct sectionS *stringS, const char *name, uint16_t *id
+	)
+{
+	struct attrnameEntryS	*e=ATTRNAME_ENTRIES;
+	uint32_t		hash=zui::attrNameHash(name), nameOff;
+
+	for (uint32_t i=0; i<ATTRNAME_N_ENTRIES; i++)
+	{
+		if (e[i].hash == hash && !strcmp(e[i].name, name))
+			{ *id = i; return EX_SUCCESS; };
+	};
+
+	if (strtab_internString(stringS, name, &nameOff) != EX_SUCCESS)
+		{ return EX_NOMEM; };
+
+	return attrname_add(name, nameOff, id);
+}
+
+static int attrname_compareBuckets(const void *_a, const void *_b)
+{
+	const struct attrnameBucketS	*a, *b;
+
+	a = (const struct attrnameBucketS *)_a;
+	b = (const struct attrnameBucketS *)_b;
+	// Largest first.
+	if (a->nNames != b->nNames)
+		{ return (a->nNames > b->nNames) ? -1 : 1; };
+
+	if (a->index != b->index) { return (a->index < b->index) ? -1 : 1; };
+	return 0;
+}
+
+/* Finds the first seed which sends every name in the bucket to a distinct
+ * free slot, and claims those slots.
+ **/
+static int attrname_placeBucket(
+	const struct attrnameBucketS *b, const uint32_t *members,
+	uint32_t *slots, uint32_t nNames, uint32_t *seed
+	)
+{
+	const struct attrnameEntryS	*e=ATTRNAME_ENTRIES;
+	uint32_t			placed[ATTRNAME_BUCKET_SIZE * 8];
+	uint32_t			i, j, slot;
+
+	if (b->nNames > sizeof(placed) / sizeof(*placed))
+		{ return EX_GENERAL; };
+
+	for (*seed = 0; *seed < ATTRNAME_MAX_SEED; (*seed)++)
+	{
+		for (i=0; i<b->nNames; i++)
+		{
+			slot = zui::attrNameSlot(
+				e[members[b->start + i]].name, *seed, nNames);
+
+			if (slots[slot] != UINT32_MAX) { break; };
+			for (j=0; j<i && placed[j] != slot; j++) {};
+			if (j < i) { break; };
+
+			placed[i] = slot;
+		};
+
+		if (i < b->nNames) { continue; };
+
+		for (i=0; i<b->nNames; i++)
+			{ slots[placed[i]] = members[b->start + i]; };
+
+		return EX_SUCCESS;
+	};
+
+	return EX_GENERAL;
+}
+
+static int attrname_appendWords(
+	struct sectionS *devS, const uint32_t *words, uint32_t n
+	)
+{
+	uint32_t	v;
+
+	for (uint32_t i=0; i<n; i++)
+	{
+		v = serial_value(words[i]);
+		if (section_append(devS, &v, sizeof(v), NULL) != EX_SUCCESS)
+			{ return EX_NOMEM; };
+	};
+
+	return EX_SUCCESS;
+}
+
+int attrname_writeTable(struct sectionS *devS)
+{
+	const struct attrnameEntryS	*e=ATTRNAME_ENTRIES;
+	struct zui::sAttrNameDict	d;
+	struct attrnameBucketS		*buckets;
+	uint32_t			*members, *seeds, *slots, *nameOffs;
+	uint32_t			nNames=ATTRNAME_N_ENTRIES, nBuckets;
+	uint32_t			tableStart=section_tell(devS), i, b;
+	int				ret=EX_SUCCESS;
+
+	indexHeader.attrNamesOff = tableStart;
+	indexHeader.attrNamesLen = 0;
+	if (nNames == 0) { return EX_SUCCESS; };
+
+	nBuckets = (nNames + ATTRNAME_BUCKET_SIZE - 1) / ATTRNAME_BUCKET_SIZE;
+	buckets = (struct attrnameBucketS *)calloc(nBuckets, sizeof(*buckets));
+	members = (uint32_t *)malloc(nNames * sizeof(*members));
+	seeds = (uint32_t *)calloc(nBuckets, sizeof(*seeds));
+	slots = (uint32_t *)malloc(nNames * sizeof(*slots));
+	nameOffs = (uint32_t *)malloc(nNames * sizeof(*nameOffs));
+	if (buckets == NULL || members == NULL || seeds == NULL
+		|| slots == NULL || nameOffs == NULL)
+	{
+		ret = EX_NOMEM;
+	};
+
+	// Group the IDs by bucket.
+	for (i=0; i<nBuckets && ret == EX_SUCCESS; i++)
+		{ buckets[i].index = i; };
+
+	for (i=0; i<nNames && ret == EX_SUCCESS; i++)
+		{ buckets[e[i].hash % nBuckets].nNames++; };
+
+	for (i=0, b=0; b<nBuckets && ret == EX_SUCCESS; b++)
+	{
+		buckets[b].start = i;
+		i += buckets[b].nNames;
+		buckets[b].nNames = 0;
+	};
+
+	for (i=0; i<nNames && ret == EX_SUCCESS; i++)
+	{
+		b = e[i].hash % nBuckets;
+		members[buckets[b].start + buckets[b].nNames++] = i;
+		nameOffs[i] = e[i].nameOff;
+		slots[i] = UINT32_MAX;
+	};
+
+	if (ret == EX_SUCCESS)
+	{
+		qsort(
+			buckets, nBuckets, sizeof(*buckets),
+			&attrname_compareBuckets);
+	};
+
+	for (b=0; b<nBuckets && ret == EX_SUCCESS; b++)
+	{
+		if (buckets[b].nNames == 0) { break; };
+
+		ret = attrname_placeBucket(
+			&buckets[b], members, slots, nNames,
+			&seeds[buckets[b].index]);
+
+		if (ret != EX_SUCCESS)
+		{
+			fprintf(stderr, "Error: Failed to build the attribute "
+				"name dictionary.\n");
+		};
+	};
+
+	if (ret == EX_SUCCESS)
+	{
+		d.nNames = nNames;
+		d.nBuckets = nBuckets;
+		if (serial_append(devS, &d, NULL) != EX_SUCCESS
+			|| attrname_appendWords(devS, seeds, nBuckets)
+				!= EX_SUCCESS
+			|| attrname_appendWords(devS, slots, nNames)
+				!= EX_SUCCESS
+			|| attrname_appendWords(devS, nameOffs, nNames)
+				!= EX_SUCCESS)
+		{
+			ret = EX_NOMEM;
+		};
+	};
+
+	free(buckets);
+	free(members);
+	free(seeds);
+	free(slots);
+	free(nameOffs);
+	if (ret != EX_SUCCESS) { return ret; };
+
+	indexHeader.attrNamesLen = section_tell(devS) - tableStart;
+	return EX_SUCCESS;
+}
+
+void attrname_free(void)
+{
+	for (uint32_t i=0; i<ATTRNAME_N_ENTRIES; i++)
+		{ free(ATTRNAME_ENTRIES[i].name); };
+
+	free(entries.buff);
+	memset(&entries, 0, sizeof(entries));
+}
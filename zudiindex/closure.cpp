@@ -0,0 +1,370 @@
+#include "zudipropsc.h"
+#include <string.h>
+#include <unistd.h>
+
+
+/**	EXPLANATION:
+ * Requirement closure table (see zui.h), kept at the end of
+ * provisions.zudi-index, right after the provision directory.
+ *
+ * Every closure can change whenever any driver is added or removed (a new
+ * metalanguage library may provide what an old driver was missing), so the
+ * whole table is worked out again on every commit, from the live driver
+ * headers and their requirements, and the finished provision directory.
+ *
+ * By the time the table is written, the records of this update are either
+ * still in the section buffers (a compaction, which holds every file in
+ * memory), or have already been written out past the committed end of
+ * their files (any other update), so they are read from wherever they are.
+ * Drivers removed by this update are still live on disk until it commits,
+ * so they are filtered out through the provision directory's list.
+ **/
+struct closureNodeS
+{
+	uint32_t	id, requirementsOffset;
+	uint32_t	edgesIndex, nEdges;
+	// Stamp of the last closure this node was added to.
+	uint32_t	mark;
+	uint16_t	flags;
+	uint8_t		nRequirements, onStack;
+	// The driver was added by this update.
+	uint8_t		isNew;
+};
+
+// Requirements that the UDI environment meets, rather than any library.
+static const char	*environmentProvisions[] = { "udi", "udi_physio" };
+
+#define CLOSURE_N_ENVIRONMENT_PROVISIONS	\
+	(sizeof(environmentProvisions) / sizeof(*environmentProvisions))
+
+static struct closureNodeS	*nodes;
+static uint32_t			nNodes;
+static struct sectionS		nodeS, edges, closures, ids;
+
+static int closure_read(
+	enum indexFileE fileIndex, uint32_t offset, void *buff, uint32_t len
+	)
+{
+	struct sectionS		*s=&indexSections[fileIndex];
+
+	if (offset >= s->base)
+	{
+		offset -= s->base;
+		if (offset > s->len || len > s->len - offset)
+			{ return EX_GENERAL; };
+
+		memcpy(buff, &s->buff[offset], len);
+		return EX_SUCCESS;
+	};
+
+	if (len > s->base - offset) { return EX_GENERAL; };
+	if (pread(indexFds[fileIndex], buff, len, offset) != (ssize_t)len)
+		{ return EX_FILE_IO; };
+
+	return EX_SUCCESS;
+}
+
+template <class T>
+static int closure_readRecord(
+	enum indexFileE fileIndex, uint32_t offset, T *record
+	)
+{
+	int		ret;
+
+	ret = closure_read(fileIndex, offset, record, sizeof(*record));
+	if (ret == EX_SUCCESS) { serial_decode(record); };
+	return ret;
+}
+
+// The string section holds the whole string file.
+static const char *closure_getString(uint32_t offset)
+{
+	struct sectionS		*stringS=&indexSections[IDXF_STRINGS];
+
+	if (offset >= stringS->len
+		|| memchr(
+			&stringS->buff[offset], '\0', stringS->len - offset)
+			== NULL)
+	{
+		return NULL;
+	};
+
+	return (const char *)&stringS->buff[offset];
+}
+
+static int closure_compareNodes(const void *_a, const void *_b)
+{
+	const struct closureNodeS	*a, *b;
+
+	a = (const struct closureNodeS *)_a;
+	b = (const struct closureNodeS *)_b;
+	if (a->id != b->id) { return (a->id < b->id) ? -1 : 1; };
+	return 0;
+}
+
+static int closure_loadNodes(void)
+{
+	struct zui::driver::sHeader	h;
+	struct closureNodeS		n;
+	uint32_t			off, end;
+	int				ret;
+
+	end = section_tell(&indexSections[IDXF_DRIVERS]);
+	for (off = sizeof(struct zui::sHeader); off + sizeof(h) <= end;
+		off += sizeof(h))
+	{
+		ret = closure_readRecord(IDXF_DRIVERS, off, &h);
+		if (ret != EX_SUCCESS) { return ret; };
+
+		if ((h.flags & ZUI_DRIVER_FLAGS_REMOVED)
+			|| provdir_isRemoved(h.id))
+		{
+			continue;
+		};
+
+		memset(&n, 0, sizeof(n));
+		n.id = h.id;
+		n.requirementsOffset = h.requirementsOffset;
+		n.nRequirements = h.nRequirements;
+		n.isNew = off >= indexSections[IDXF_DRIVERS].base;
+		if (section_append(&nodeS, &n, sizeof(n), NULL) != EX_SUCCESS)
+			{ return EX_NOMEM; };
+	};
+
+	nodes = (struct closureNodeS *)nodeS.buff;
+	nNodes = nodeS.len / sizeof(*nodes);
+	if (nNodes > 0)
+	{
+		qsort(nodes, nNodes, sizeof(*nodes), &closure_compareNodes);
+	};
+
+	return EX_SUCCESS;
+}
+
+static struct closureNodeS *closure_findNode(uint32_t driverId)
+{
+	struct closureNodeS	key;
+
+	if (nNodes == 0) { return NULL; };
+
+	key.id = driverId;
+	return (struct closureNodeS *)bsearch(
+		&key, nodes, nNodes, sizeof(*nodes), &closure_compareNodes);
+}
+
+static int closure_isEnvironmentProvision(const char *name)
+{
+	for (uint32_t i=0; i<CLOSURE_N_ENVIRONMENT_PROVISIONS; i++)
+	{
+		if (!strcmp(name, environmentProvisions[i])) { return 1; };
+	};
+
+	return 0;
+}
+
+/* Returns the node of the best live provider of "name" at "version" or
+ * later, or NULL if there is none.
+ **/
+static struct closureNodeS *closure_findProvider(
+	const struct zui::driver::sProvisionDirEntry *dir, uint32_t nDir,
+	const char *name, uint32_t version, uint32_t requirerId
+	)
+{
+	const struct zui::driver::sProvisionDirEntry	*best=NULL;
+	const char					*provName;
+	uint32_t					hash, lo, hi, mid;
+
+	hash = zui::driver::provisionHash(name);
+	for (lo=0, hi=nDir; lo < hi; )
+	{
+		mid = lo + (hi - lo) / 2;
+		if (dir[mid].nameHash < hash) { lo = mid + 1; }
+		else { hi = mid; };
+	};
+
+	for (; lo < nDir && dir[lo].nameHash == hash; lo++)
+	{
+		if (dir[lo].version < version || dir[lo].driverId == requirerId)
+			{ continue; };
+
+		provName = closure_getString(dir[lo].nameOff);
+		if (provName == NULL || strcmp(provName, name)) { continue; };
+
+		// Entries with equal hashes are sorted by driverId.
+		if (best == NULL || dir[lo].version > best->version)
+			{ best = &dir[lo]; };
+	};
+
+	return (best != NULL) ? closure_findNode(best->driverId) : NULL;
+}
+
+static int closure_resolveEdges(
+	const struct zui::driver::sProvisionDirEntry *dir, uint32_t nDir
+	)
+{
+	struct zui::driver::sRequirement	req;
+	struct closureNodeS			*n, *provider;
+	const char				*name;
+	uint32_t				edge;
+	int					ret;
+
+	for (n = nodes; n < &nodes[nNodes]; n++)
+	{
+		n->edgesIndex = edges.len / sizeof(edge);
+		for (int i=0; i<n->nRequirements; i++)
+		{
+			ret = closure_readRecord(
+				IDXF_DATA,
+				n->requirementsOffset + i * sizeof(req), &req);
+
+			if (ret != EX_SUCCESS) { return ret; };
+
+			name = closure_getString(req.nameOff);
+			if (name == NULL) { return EX_GENERAL; };
+
+			provider = closure_findProvider(
+				dir, nDir, name, req.version, n->id);
+
+			if (provider == NULL)
+			{
+				if (closure_isEnvironmentProvision(name))
+					{ continue; };
+
+				n->flags |= ZUI_CLOSURE_FLAGS_MISSING_PROVIDER;
+				if (verboseMode)
+				{
+					printf("Driver %u: nothing provides "
+						"\"%s\" v%x.\n",
+						n->id, name, req.version);
+				};
+
+				continue;
+			};
+
+			edge = provider - nodes;
+			if (section_append(&edges, &edge, sizeof(edge), NULL)
+				!= EX_SUCCESS)
+			{
+				return EX_NOMEM;
+			};
+
+			n->nEdges++;
+		};
+	};
+
+	return EX_SUCCESS;
+}
+
+/* Appends the closure of node "n" to ids[], in post order, so that every
+ * driver comes after the ones it requires.
+ **/
+static int closure_visit(
+	struct closureNodeS *n, uint32_t stamp, uint16_t *flags
+	)
+{
+	const uint32_t		*e;
+	struct closureNodeS	*next;
+	uint32_t		id;
+
+	n->mark = stamp;
+	n->onStack = 1;
+	*flags |= n->flags;
+	for (uint32_t i=0; i<n->nEdges; i++)
+	{
+		e = &((const uint32_t *)edges.buff)[n->edgesIndex + i];
+		next = &nodes[*e];
+		if (next->onStack)
+		{
+			*flags |= ZUI_CLOSURE_FLAGS_CYCLE;
+			continue;
+		};
+
+		if (next->mark == stamp) { continue; };
+		if (closure_visit(next, stamp, flags) != EX_SUCCESS)
+			{ return EX_NOMEM; };
+	};
+
+	n->onStack = 0;
+	id = serial_value(n->id);
+	return section_append(&ids, &id, sizeof(id), NULL);
+}
+
+int closure_writeTable(
+	struct sectionS *provS,
+	const struct zui::driver::sProvisionDirEntry *dir, uint32_t nDir
+	)
+{
+	struct zui::driver::sClosureTable	t;
+	struct zui::driver::sClosure		c;
+	uint32_t				tableStart=section_tell(provS);
+	int					ret;
+
+	indexHeader.closureTableOff = tableStart;
+	indexHeader.closureTableLen = 0;
+	if ((ret = closure_loadNodes()) != EX_SUCCESS
+		|| (ret = closure_resolveEdges(dir, nDir)) != EX_SUCCESS)
+	{
+		closure_free();
+		return ret;
+	};
+
+	if (nNodes == 0) { closure_free(); return EX_SUCCESS; };
+
+	// The closure records come first, so the IDs are collected aside.
+	for (uint32_t i=0; i<nNodes; i++)
+	{
+		memset(&c, 0, sizeof(c));
+		c.driverId = nodes[i].id;
+		c.idsIndex = ids.len / sizeof(uint32_t);
+		if (closure_visit(&nodes[i], i + 1, &c.flags) != EX_SUCCESS)
+			{ closure_free(); return EX_NOMEM; };
+
+		c.nIds = ids.len / sizeof(uint32_t) - c.idsIndex;
+		// Cycles among drivers that were already indexed are old news.
+		if ((c.flags & ZUI_CLOSURE_FLAGS_CYCLE) && nodes[i].isNew)
+		{
+			fprintf(stderr, "Warning: The requirements of "
+				"driver %u loop back on themselves.\n",
+				c.driverId);
+		};
+
+		if (section_append(&closures, &c, sizeof(c), NULL)
+			!= EX_SUCCESS)
+		{
+			closure_free();
+			return EX_NOMEM;
+		};
+	};
+
+	t.nDrivers = nNodes;
+	t.nIds = ids.len / sizeof(uint32_t);
+	ret = serial_append(provS, &t, NULL);
+	for (uint32_t i=0; i<nNodes && ret == EX_SUCCESS; i++)
+	{
+		memcpy(&c, &closures.buff[i * sizeof(c)], sizeof(c));
+		ret = serial_append(provS, &c, NULL);
+	};
+
+	if (ret == EX_SUCCESS)
+		{ ret = section_append(provS, ids.buff, ids.len, NULL); };
+
+	closure_free();
+	if (ret != EX_SUCCESS) { return EX_NOMEM; };
+
+	indexHeader.closureTableLen = section_tell(provS) - tableStart;
+	return EX_SUCCESS;
+}
+
+void closure_free(void)
+{
+	free(nodeS.buff);
+	free(edges.buff);
+	free(closures.buff);
+	free(ids.buff);
+	memset(&nodeS, 0, sizeof(nodeS));
+	memset(&edges, 0, sizeof(edges));
+	memset(&closures, 0, sizeof(closures));
+	memset(&ids, 0, sizeof(ids));
+	nodes = NULL;
+	nNodes = 0;
+}
@@ -0,0 +1,593 @@
+#include "zudipropsc.h"
+#include <limits.h>
+#include <string.h>
+
+
+/**	EXPLANATION:
+ * Driver removal ("-r"), by compaction of the whole index.
+ *
+ * Records in the index refer to each other by file offset, so a driver can't
+ * simply be cut out of the index files. Instead the index is rebuilt without
+ * it: every surviving driver is read back out of the old index files into a
+ * parser context, just as if it had been parsed from its udiprops, and
+ * index_writeToDisk() writes it out again into empty sections. All of the
+ * offsets in the new records are computed afresh by the record writers, and
+ * unreferenced strings are dropped along with everything else.
+ *
+ * Drivers keep their IDs, and are written out in their old order. Drivers
+ * that "--sync" had marked removed are purged at the same time. The rebuilt
+ * files are committed with txn_commitRewrite().
+ *
+ * The old files may be corrupt, so every offset and count read from them is
+ * checked before it is used.
+ **/
+static struct indexImageS	oldImage;
+
+static int compact_readString(uint32_t offset, char *out, uint32_t outSize)
+{
+	const char	*str=image_getString(&oldImage, offset);
+
+	if (str == NULL || strlen(str) >= outSize) { return EX_GENERAL; };
+
+	strcpy(out, str);
+	return EX_SUCCESS;
+}
+
+static int compact_readAttrName(uint32_t id, char *out, uint32_t outSize)
+{
+	const char	*name=image_getAttrName(&oldImage, id);
+
+	if (name == NULL || strlen(name) >= outSize) { return EX_GENERAL; };
+
+	strcpy(out, name);
+	return EX_SUCCESS;
+}
+
+/* Allocates a record object the way the parser does, and hands it to the
+ * driver's context. The context owns it from then on.
+ **/
+template <class T>
+static int compact_newItem(
+	struct parserContextS *ctxt, enum parser_lineTypeE lineType, T **item
+	)
+{
+	*item = (T *)malloc(sizeof(**item));
+	if (*item == NULL) { return EX_NOMEM; };
+
+	memset(*item, 0, sizeof(**item));
+	if (index_insert(ctxt, lineType, *item) != EX_SUCCESS)
+	{
+		free(*item);
+		return EX_NOMEM;
+	};
+
+	return EX_SUCCESS;
+}
+
+static int compact_loadDriverData(
+	struct parserContextS *ctxt, const struct zui::driver::sHeader *h
+	)
+{
+	struct zui::driver::sDriver		*drv=ctxt->driver;
+	struct zui::driver::sModule		module;
+	struct zui::driver::sRequirement	requirement;
+	struct zui::driver::sMetalanguage	meta;
+	struct arenaS				*a=&ctxt->arena;
+	int					i;
+
+	if (arena_newArray(a, &drv->modules, h->nModules) != EX_SUCCESS
+		|| arena_newArray(a, &drv->requirements, h->nRequirements)
+			!= EX_SUCCESS
+		|| arena_newArray(a, &drv->metalanguages, h->nMetalanguages)
+			!= EX_SUCCESS
+		|| arena_newArray(a, &drv->parentBops, h->nParentBops)
+			!= EX_SUCCESS
+		|| arena_newArray(a, &drv->childBops, h->nChildBops)
+			!= EX_SUCCESS
+		|| arena_newArray(a, &drv->internalBops, h->nInternalBops)
+			!= EX_SUCCESS)
+	{
+		return EX_NOMEM;
+	};
+
+	for (i=0; i<h->nModules; i++)
+	{
+		if (image_readRecord(
+			&oldImage, IDXF_DATA, h->modulesOffset, i, &module)
+			!= EX_SUCCESS
+			|| compact_readString(
+				module.fileNameOff, drv->modules[i].fileName,
+				sizeof(drv->modules[i].fileName)) != EX_SUCCESS)
+		{
+			return EX_GENERAL;
+		};
+
+		drv->modules[i].index = module.index;
+	};
+
+	for (i=0; i<h->nRequirements; i++)
+	{
+		if (image_readRecord(
+			&oldImage, IDXF_DATA, h->requirementsOffset, i,
+			&requirement)
+			!= EX_SUCCESS
+			|| compact_readString(
+				requirement.nameOff, drv->requirements[i].name,
+				sizeof(drv->requirements[i].name))
+				!= EX_SUCCESS)
+		{
+			return EX_GENERAL;
+		};
+
+		drv->requirements[i].version = requirement.version;
+	};
+
+	for (i=0; i<h->nMetalanguages; i++)
+	{
+		if (image_readRecord(
+			&oldImage, IDXF_DATA, h->metalanguagesOffset, i, &meta)
+			!= EX_SUCCESS
+			|| compact_readString(
+				meta.nameOff, drv->metalanguages[i].name,
+				sizeof(drv->metalanguages[i].name))
+				!= EX_SUCCESS)
+		{
+			return EX_GENERAL;
+		};
+
+		drv->metalanguages[i].index = meta.index;
+	};
+
+	for (i=0; i<h->nParentBops; i++)
+	{
+		if (image_readRecord(
+			&oldImage, IDXF_DATA, h->parentBopsOffset, i,
+			&drv->parentBops[i])
+			!= EX_SUCCESS)
+			{ return EX_GENERAL; };
+	};
+
+	for (i=0; i<h->nChildBops; i++)
+	{
+		if (image_readRecord(
+			&oldImage, IDXF_DATA, h->childBopsOffset, i,
+			&drv->childBops[i])
+			!= EX_SUCCESS)
+			{ return EX_GENERAL; };
+	};
+
+	for (i=0; i<h->nInternalBops; i++)
+	{
+		if (image_readRecord(
+			&oldImage, IDXF_DATA, h->internalBopsOffset, i,
+			&drv->internalBops[i]) != EX_SUCCESS)
+			{ return EX_GENERAL; };
+	};
+
+	return EX_SUCCESS;
+}
+
+static int compact_loadDeviceAttr(
+	struct zui::device::_sAttrData *attr, uint32_t offset, uint32_t i
+	)
+{
+	struct zui::device::sAttrData	rec;
+
+	if (image_readRecord(&oldImage, IDXF_DATA, offset, i, &rec)
+		!= EX_SUCCESS
+		|| compact_readAttrName(
+			rec.attr_nameId, attr->attr_name,
+			sizeof(attr->attr_name)) != EX_SUCCESS)
+	{
+		return EX_GENERAL;
+	};
+
+	attr->attr_type = rec.attr_type;
+	attr->attr_length = rec.attr_length;
+
+	// Undo what _sAttrData::writeOut() did to the value.
+	switch (rec.attr_type)
+	{
+	case UDI_ATTR_STRING:
+		return compact_readString(
+			rec.attr_valueOff, (char *)attr->attr_value,
+			sizeof(attr->attr_value));
+
+	case UDI_ATTR_ARRAY8:
+		if (rec.attr_length > sizeof(attr->attr_value)
+			|| rec.attr_valueOff > oldImage.sizes[IDXF_STRINGS]
+			|| rec.attr_length
+				> oldImage.sizes[IDXF_STRINGS] - rec.attr_valueOff)
+		{
+			return EX_GENERAL;
+		};
+
+		memcpy(
+			attr->attr_value,
+			&oldImage.files[IDXF_STRINGS][rec.attr_valueOff],
+			rec.attr_length);
+
+		return EX_SUCCESS;
+
+	case UDI_ATTR_BOOLEAN:
+		attr->attr_value[0] = rec.attr_valueOff;
+		return EX_SUCCESS;
+
+	case UDI_ATTR_UBIT32:
+		UDI_ATTR32_SET(attr->attr_value, rec.attr_valueOff);
+		return EX_SUCCESS;
+	};
+
+	return EX_SUCCESS;
+}
+
+static int compact_loadDevices(
+	struct parserContextS *ctxt, const struct zui::driver::sHeader *h
+	)
+{
+	struct zui::device::_sDevice	*dev;
+	int				i, j, ret;
+
+	// The writer walks each list from its head, so insert back to front.
+	for (i=h->nDevices - 1; i >= 0; i--)
+	{
+		if ((ret = compact_newItem(ctxt, LT_DEVICE, &dev)) != EX_SUCCESS)
+			{ return ret; };
+
+		if (image_readRecord(
+			&oldImage, IDXF_DEVICES, h->deviceFileOffset, i, &dev->h)
+			!= EX_SUCCESS)
+		{
+			return EX_GENERAL;
+		};
+
+		ret = arena_newArray(&ctxt->arena, &dev->d, dev->h.nAttributes);
+		if (ret != EX_SUCCESS) { return ret; };
+
+		for (j=0; j<dev->h.nAttributes; j++)
+		{
+			if (compact_loadDeviceAttr(&dev->d[j], dev->h.dataOff, j)
+				!= EX_SUCCESS)
+				{ return EX_GENERAL; };
+		};
+	};
+
+	return EX_SUCCESS;
+}
+
+static int compact_loadRanks(
+	struct parserContextS *ctxt, const struct zui::driver::sHeader *h
+	)
+{
+	struct zui::rank::_sRank	*rank;
+	struct zui::rank::sRankAttr	attr;
+	int				i, j, ret;
+
+	for (i=h->nRanks - 1; i >= 0; i--)
+	{
+		if ((ret = compact_newItem(ctxt, LT_RANK, &rank)) != EX_SUCCESS)
+			{ return ret; };
+
+		if (image_readRecord(
+			&oldImage, IDXF_RANKS, h->rankFileOffset, i, &rank->h)
+			!= EX_SUCCESS)
+		{
+			return EX_GENERAL;
+		};
+
+		ret = arena_newArray(
+			&ctxt->arena, &rank->d, rank->h.nAttributes);
+		if (ret != EX_SUCCESS) { return ret; };
+
+		for (j=0; j<rank->h.nAttributes; j++)
+		{
+			if (image_readRecord(
+				&oldImage, IDXF_DATA, rank->h.dataOff, j,
+				&attr) != EX_SUCCESS
+				|| compact_readAttrName(
+					attr.nameId, rank->d[j].name,
+					sizeof(rank->d[j].name)) != EX_SUCCESS)
+			{
+				return EX_GENERAL;
+			};
+		};
+	};
+
+	return EX_SUCCESS;
+}
+
+static int compact_loadProvisions(
+	struct parserContextS *ctxt, const struct zui::driver::sHeader *h
+	)
+{
+	struct zui::driver::_sProvision	*prov;
+	struct zui::driver::sProvision	rec;
+	int				i, ret;
+
+	for (i=h->nProvisions - 1; i >= 0; i--)
+	{
+		if ((ret = compact_newItem(ctxt, LT_PROVIDES, &prov))
+			!= EX_SUCCESS)
+			{ return ret; };
+
+		if (image_readRecord(
+			&oldImage, IDXF_PROVISIONS, h->provisionFileOffset,
+			i, &rec)
+			!= EX_SUCCESS
+			|| compact_readString(
+				rec.nameOff, prov->name, sizeof(prov->name))
+				!= EX_SUCCESS)
+		{
+			return EX_GENERAL;
+		};
+
+		prov->driverId = rec.driverId;
+		prov->version = rec.version;
+	};
+
+	return EX_SUCCESS;
+}
+
+static int compact_loadRegions(
+	struct parserContextS *ctxt, const struct zui::driver::sHeader *h
+	)
+{
+	struct zui::driver::sRegion	*region;
+	int				i, ret;
+
+	for (i=h->nRegions - 1; i >= 0; i--)
+	{
+		if ((ret = compact_newItem(ctxt, LT_REGION, &region))
+			!= EX_SUCCESS)
+			{ return ret; };
+
+		if (image_readRecord(
+			&oldImage, IDXF_DATA, h->regionsOffset, i, region)
+			!= EX_SUCCESS)
+			{ return EX_GENERAL; };
+	};
+
+	return EX_SUCCESS;
+}
+
+/* Messages may be in compressed blocks; see image_readMessage(). Each one
+ * gets the locale whose run of records in the locale directory holds it.
+ * Unlike the other lists, the message list is rebuilt in reverse record
+ * order, as the parser would have built it, since index_sortMessages()
+ * relies on that to keep messages with the same index in order.
+ **/
+static int compact_loadMessages(
+	struct parserContextS *ctxt, const struct zui::driver::sHeader *h
+	)
+{
+	struct zui::driver::sMessageLocaleDir	dir;
+	struct zui::driver::sMessageLocale	loc;
+	struct zui::driver::sMessage		rec;
+	struct zui::driver::_sMessage		*item;
+	const char				*locale;
+	int					i, j, ret;
+
+	if (h->nMessages == 0) { return EX_SUCCESS; };
+
+	if (image_readRecord(
+		&oldImage, IDXF_DATA, h->messageLocalesOffset, 0, &dir)
+		!= EX_SUCCESS)
+		{ return EX_GENERAL; };
+
+	for (i=0, j=0; j<dir.nLocales; j++)
+	{
+		if (image_readRecord(
+			&oldImage, IDXF_DATA,
+			h->messageLocalesOffset + sizeof(dir), j, &loc)
+			!= EX_SUCCESS
+			|| loc.firstMessage != i
+			|| loc.firstMessage + loc.nMessages > h->nMessages
+			|| (locale = image_getString(&oldImage, loc.nameOff))
+				== NULL
+			|| strlen(locale) >= ZUI_LOCALE_MAXLEN)
+		{
+			return EX_GENERAL;
+		};
+
+		for (; i<loc.firstMessage + loc.nMessages; i++)
+		{
+			if ((ret = compact_newItem(ctxt, LT_MESSAGE, &item))
+				!= EX_SUCCESS)
+				{ return ret; };
+
+			if (image_readRecord(
+				&oldImage, IDXF_DATA, h->messagesOffset, i,
+				&rec) != EX_SUCCESS
+				|| image_readMessage(
+					&oldImage, h, &rec, item->message,
+					sizeof(item->message)) != EX_SUCCESS)
+			{
+				return EX_GENERAL;
+			};
+
+			item->driverId = rec.driverId;
+			item->index = rec.index;
+			strcpy(item->locale, locale);
+		};
+	};
+
+	return (i == h->nMessages) ? EX_SUCCESS : EX_GENERAL;
+}
+
+/* Disaster messages, message files and readable files all have a driver ID,
+ * an index and one string, which only differ in name.
+ **/
+#define COMPACT_LOAD_STRING_LIST(__ctxt, __h, __lineType, __n, __off, \
+	__recType, __itemType, __strOff, __str) \
+	do { \
+		struct zui::driver::__recType	rec; \
+		struct zui::driver::__itemType	*item; \
+		int				i, ret; \
+	\
+		for (i=(__h)->__n - 1; i >= 0; i--) \
+		{ \
+			ret = compact_newItem((__ctxt), (__lineType), &item); \
+			if (ret != EX_SUCCESS) { return ret; }; \
+	\
+			if (image_readRecord( \
+				&oldImage, IDXF_DATA, (__h)->__off, i, \
+				&rec) != EX_SUCCESS \
+				|| compact_readString( \
+					rec.__strOff, item->__str, \
+					sizeof(item->__str)) != EX_SUCCESS) \
+			{ \
+				return EX_GENERAL; \
+			}; \
+	\
+			item->driverId = rec.driverId; \
+			item->index = rec.index; \
+		}; \
+	} while (0)
+
+static int compact_loadStringLists(
+	struct parserContextS *ctxt, const struct zui::driver::sHeader *h
+	)
+{
+	COMPACT_LOAD_STRING_LIST(
+		ctxt, h, LT_DISASTER_MESSAGE, nDisasterMessages,
+		disasterMessagesOffset,
+		sDisasterMessage, _sDisasterMessage, messageOff, message);
+
+	COMPACT_LOAD_STRING_LIST(
+		ctxt, h, LT_MESSAGE_FILE, nMessageFiles, messageFilesOffset,
+		sMessageFile, _sMessageFile, fileNameOff, fileName);
+
+	COMPACT_LOAD_STRING_LIST(
+		ctxt, h, LT_READABLE_FILE, nReadableFiles, readableFilesOffset,
+		sReadableFile, _sReadableFile, fileNameOff, fileName);
+
+	return EX_SUCCESS;
+}
+
+// Rebuilds the parser context that the driver was originally written from.
+static int compact_loadDriver(
+	struct parserContextS *ctxt, const struct zui::driver::sHeader *h
+	)
+{
+	char		path[PATH_MAX];
+	int		ret;
+
+	index_initialize(ctxt);
+	ctxt->driver = new zui::driver::sDriver;
+	if (ctxt->driver == NULL) { return EX_NOMEM; };
+
+	memset(ctxt->driver, 0, sizeof(*ctxt->driver));
+	ctxt->driver->h = *h;
+	ctxt->driver->h.sourcePathOff = 0;
+
+	/* Drivers are always added with their source path, but an index which
+	 * is fine otherwise shouldn't be refused over it.
+	 **/
+	if (compact_readString(h->sourcePathOff, path, sizeof(path))
+		== EX_SUCCESS)
+	{
+		ctxt->sourcePath = strdup(path);
+		if (ctxt->sourcePath == NULL) { return EX_NOMEM; };
+	};
+
+	if ((ret = compact_loadDriverData(ctxt, h)) != EX_SUCCESS
+		|| (ret = compact_loadRanks(ctxt, h)) != EX_SUCCESS
+		|| (ret = compact_loadDevices(ctxt, h)) != EX_SUCCESS
+		|| (ret = compact_loadProvisions(ctxt, h)) != EX_SUCCESS
+		|| (ret = compact_loadRegions(ctxt, h)) != EX_SUCCESS
+		|| (ret = compact_loadMessages(ctxt, h)) != EX_SUCCESS
+		|| (ret = compact_loadStringLists(ctxt, h)) != EX_SUCCESS)
+	{
+		return ret;
+	};
+
+	return EX_SUCCESS;
+}
+
+static void compact_releaseDriver(struct parserContextS *ctxt)
+{
+	index_free(ctxt);
+	parser_releaseState(ctxt);
+	free(ctxt->sourcePath);
+	ctxt->sourcePath = NULL;
+}
+
+int compact_removeDrivers(const char *selector, int *nRemoved)
+{
+	struct parserContextS		ctxt;
+	struct zui::driver::sHeader	h;
+	uint32_t			nDrivers, i;
+	int				nPurged=0, ret;
+
+	*nRemoved = 0;
+	if ((ret = image_map(&oldImage)) != EX_SUCCESS) { return ret; };
+
+	nDrivers = image_getNDrivers(&oldImage);
+
+	/* Start every file over from scratch. With the string section empty,
+	 * strtab_load() just binds an empty string table to it.
+	 **/
+	for (i=0; i<IDXF_N_FILES; i++) { indexSections[i].base = 0; };
+
+	ret = strtab_load(&indexSections[IDXF_STRINGS], indexFds[IDXF_STRINGS]);
+	if (ret != EX_SUCCESS) { return ret; };
+
+	// Leave room for the header; txn_commitRewrite() fills it in.
+	ret = section_reserve(&indexSections[IDXF_DRIVERS], sizeof(indexHeader));
+	if (ret != EX_SUCCESS) { return ret; };
+
+	memset(indexSections[IDXF_DRIVERS].buff, 0, sizeof(indexHeader));
+	indexSections[IDXF_DRIVERS].len = sizeof(indexHeader);
+
+	indexHeader.nRecords = 0;
+	indexHeader.nSupportedDevices = indexHeader.nSupportedMetas = 0;
+
+	memset(&ctxt, 0, sizeof(ctxt));
+	for (i=0; i<nDrivers; i++)
+	{
+		image_readRecord(
+			&oldImage, IDXF_DRIVERS, sizeof(indexHeader), i, &h);
+
+		if (h.flags & ZUI_DRIVER_FLAGS_REMOVED) { nPurged++; continue; };
+		if (image_isSelected(&h, selector))
+		{
+			if (verboseMode)
+			{
+				printf("Removing driver %u, \"%.*s\".\n",
+					h.id, ZUI_DRIVER_SHORTNAME_MAXLEN,
+					h.shortName);
+			};
+
+			(*nRemoved)++;
+			continue;
+		};
+
+		ret = compact_loadDriver(&ctxt, &h);
+		if (ret == EX_GENERAL)
+		{
+			fprintf(stderr, "Error: Index records of driver %u are "
+				"corrupt.\n", h.id);
+		};
+
+		if (ret == EX_SUCCESS) { ret = index_writeToDisk(&ctxt); };
+		compact_releaseDriver(&ctxt);
+		if (ret != EX_SUCCESS) { return ret; };
+
+		indexHeader.nRecords++;
+		indexHeader.nSupportedDevices += h.nDevices;
+		indexHeader.nSupportedMetas += h.nProvisions;
+	};
+
+	if (verboseMode)
+	{
+		printf("Compaction: %d removed, %d already removed, %u kept.\n",
+			*nRemoved, nPurged, indexHeader.nRecords);
+	};
+
+	return EX_SUCCESS;
+}
+
+void compact_free(void)
+{
+	image_unmap(&oldImage);
+}
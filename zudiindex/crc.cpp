@@ -0,0 +1,117 @@
+#include "zudipropsc.h"
+#include <pthread.h>
+#if defined(__x86_64__)
+	#include <nmmintrin.h>
+#elif defined(__aarch64__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	#include <arm_acle.h>
+	#include <sys/auxv.h>
+	#include <asm/hwcap.h>
+#endif
+
+
+/**	EXPLANATION:
+ * CRC32C of the index files (see zui.h).
+ *
+ * The index compiler is built for any CPU of its architecture, so unlike
+ * zui::crc32c(), it picks the CRC32C instruction at run time: crc_compute()
+ * uses it if the CPU has it, and falls back to zui::crc32c() with the
+ * slicing-by-8 tables otherwise. Both give the same checksums.
+ *
+ * The checksums of the index files are worked out when an update commits
+ * (see transaction.cpp), over the whole of each committed file, and are
+ * checked by "--verify" (see verify.cpp).
+ **/
+static struct zui::sCrc32cTable	crcTable;
+static pthread_once_t		crcTableOnce=PTHREAD_ONCE_INIT;
+static int			crcHaveHardware;
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+static uint32_t crc_computeHardware(
+	uint32_t crc, const uint8_t *p, uint32_t len
+	)
+{
+	uint64_t	word;
+
+	crc = ~crc;
+	for (; len >= 8; p += 8, len -= 8)
+	{
+		memcpy(&word, p, sizeof(word));
+		crc = (uint32_t)_mm_crc32_u64(crc, word);
+	};
+
+	for (; len > 0; p++, len--) { crc = _mm_crc32_u8(crc, *p); };
+	return ~crc;
+}
+
+static int crc_detectHardware(void)
+{
+	return __builtin_cpu_supports("sse4.2");
+}
+#elif defined(__aarch64__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+__attribute__((target("+crc")))
+static uint32_t crc_computeHardware(
+	uint32_t crc, const uint8_t *p, uint32_t len
+	)
+{
+	uint64_t	word;
+
+	crc = ~crc;
+	for (; len >= 8; p += 8, len -= 8)
+	{
+		memcpy(&word, p, sizeof(word));
+		crc = __crc32cd(crc, word);
+	};
+
+	for (; len > 0; p++, len--) { crc = __crc32cb(crc, *p); };
+	return ~crc;
+}
+
+static int crc_detectHardware(void)
+{
+	return (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+}
+#else
+static uint32_t crc_computeHardware(
+	uint32_t crc, const uint8_t *p, uint32_t len
+	)
+{
+	return zui::crc32c(crc, p, len, &crcTable);
+}
+
+static int crc_detectHardware(void)
+{
+	return 0;
+}
+#endif
+
+static void crc_initialize(void)
+{
+	crcHaveHardware = crc_detectHardware();
+	if (!crcHaveHardware) { zui::crc32cInitTable(&crcTable); };
+}
+
+uint32_t crc_compute(uint32_t crc, const void *data, uint32_t len)
+{
+	pthread_once(&crcTableOnce, &crc_initialize);
+	if (crcHaveHardware)
+	{
+		return crc_computeHardware(
+			crc, (const uint8_t *)data, len);
+	};
+
+	return zui::crc32c(crc, data, len, &crcTable);
+}
+
+// Fills in the headerChecksum of a header which is in index byte order.
+void crc_sealHeader(struct zui::sHeader *h)
+{
+	h->headerChecksum = 0;
+	h->headerChecksum = serial_value(zui::headerChecksum(h));
+}
+
+int crc_checkHeader(const struct zui::sHeader *h)
+{
+	return (serial_value(h->headerChecksum) == zui::headerChecksum(h))
+		? EX_SUCCESS : EX_GENERAL;
+}
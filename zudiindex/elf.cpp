@@ -0,0 +1,136 @@
+#include "zudipropsc.h"
+#include <elf.h>
+#include <stddef.h>
+#include <string.h>
+
+
+/**	EXPLANATION:
+ * Just enough of an ELF reader to find a named section in a compiled UDI
+ * driver. The driver may be ELF32 or ELF64, of either byte order, so the
+ * headers are never accessed through the <elf.h> structs directly; each field
+ * is assembled byte by byte from its offset within the struct instead. This
+ * also means that the image needs no particular alignment.
+ *
+ * Every offset and size read from the image is checked against the size of
+ * the image before it is used, since the input file may be anything at all.
+ **/
+struct elfImageS
+{
+	const uint8_t	*image;
+	size_t		size;
+	int		is64, isBigEndian;
+};
+
+static uint64_t elf_get(const struct elfImageS *e, size_t off, int nBytes)
+{
+	uint64_t	ret=0;
+
+	for (int i=0; i<nBytes; i++)
+	{
+		ret |= (uint64_t)e->image[off + i]
+			<< ((e->isBigEndian) ? (nBytes - 1 - i) * 8 : i * 8);
+	};
+
+	return ret;
+}
+
+// Fetches a field which has the same name in the ELF32 and ELF64 structs.
+#define ELF_FIELD(__e, __base, __type, __field) \
+	(((__e)->is64) \
+		? elf_get( \
+			(__e), (__base) + offsetof(Elf64_##__type, __field), \
+			sizeof(((Elf64_##__type *)0)->__field)) \
+		: elf_get( \
+			(__e), (__base) + offsetof(Elf32_##__type, __field), \
+			sizeof(((Elf32_##__type *)0)->__field)))
+
+static inline int elf_inBounds(
+	const struct elfImageS *e, uint64_t off, uint64_t len
+	)
+{
+	return off <= e->size && len <= e->size - off;
+}
+
+int elf_findSection(
+	const uint8_t *image, size_t imageSize, const char *name,
+	const char **section, size_t *sectionSize
+	)
+{
+	struct elfImageS	e;
+	uint64_t		shOff, shEntSize, shNum, shStrIndex,
+				strOff, strSize, hdr, nameOff, off, size;
+	size_t			nameLen=strlen(name) + 1;
+
+	e.image = image;
+	e.size = imageSize;
+
+	if (imageSize < EI_NIDENT || memcmp(image, ELFMAG, SELFMAG) != 0)
+		{ return EX_INVALID_INPUT_FILE; };
+
+	if (image[EI_CLASS] != ELFCLASS32 && image[EI_CLASS] != ELFCLASS64)
+		{ return EX_INVALID_INPUT_FILE; };
+
+	if (image[EI_DATA] != ELFDATA2LSB && image[EI_DATA] != ELFDATA2MSB)
+		{ return EX_INVALID_INPUT_FILE; };
+
+	e.is64 = image[EI_CLASS] == ELFCLASS64;
+	e.isBigEndian = image[EI_DATA] == ELFDATA2MSB;
+
+	if (!elf_inBounds(
+		&e, 0, (e.is64) ? sizeof(Elf64_Ehdr) : sizeof(Elf32_Ehdr)))
+	{
+		return EX_INVALID_INPUT_FILE;
+	};
+
+	shOff = ELF_FIELD(&e, 0, Ehdr, e_shoff);
+	shEntSize = ELF_FIELD(&e, 0, Ehdr, e_shentsize);
+	shNum = ELF_FIELD(&e, 0, Ehdr, e_shnum);
+	shStrIndex = ELF_FIELD(&e, 0, Ehdr, e_shstrndx);
+
+	if (shOff == 0 || !elf_inBounds(&e, shOff, shEntSize)
+		|| shEntSize < ((e.is64)
+			? sizeof(Elf64_Shdr) : sizeof(Elf32_Shdr)))
+	{
+		return EX_INVALID_INPUT_FILE;
+	};
+
+	/* With very many sections, the real section count and string table
+	 * index are kept in the first section header.
+	 **/
+	if (shNum == 0) { shNum = ELF_FIELD(&e, shOff, Shdr, sh_size); };
+	if (shStrIndex == SHN_XINDEX)
+		{ shStrIndex = ELF_FIELD(&e, shOff, Shdr, sh_link); };
+
+	if (shNum > (e.size - shOff) / shEntSize || shStrIndex >= shNum)
+		{ return EX_INVALID_INPUT_FILE; };
+
+	hdr = shOff + shStrIndex * shEntSize;
+	strOff = ELF_FIELD(&e, hdr, Shdr, sh_offset);
+	strSize = ELF_FIELD(&e, hdr, Shdr, sh_size);
+	if (!elf_inBounds(&e, strOff, strSize)) { return EX_INVALID_INPUT_FILE; };
+
+	for (uint64_t i=1; i<shNum; i++)
+	{
+		hdr = shOff + i * shEntSize;
+		nameOff = ELF_FIELD(&e, hdr, Shdr, sh_name);
+		if (nameOff >= strSize || strSize - nameOff < nameLen
+			|| memcmp(&image[strOff + nameOff], name, nameLen) != 0)
+		{
+			continue;
+		};
+
+		off = ELF_FIELD(&e, hdr, Shdr, sh_offset);
+		size = ELF_FIELD(&e, hdr, Shdr, sh_size);
+		if (ELF_FIELD(&e, hdr, Shdr, sh_type) == SHT_NOBITS
+			|| !elf_inBounds(&e, off, size))
+		{
+			return EX_INVALID_INPUT_FILE;
+		};
+
+		*section = (const char *)&image[off];
+		*sectionSize = size;
+		return EX_SUCCESS;
+	};
+
+	return EX_PARSE_ERROR;
+}
@@ -0,0 +1,375 @@
+#include "zudipropsc.h"
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+/**	EXPLANATION:
+ * Read-only view of the committed contents of every index file, mapped
+ * straight from the files. The list and remove modes walk the existing
+ * records through it, rather than reading the files into buffers.
+ *
+ * Records are packed end to end, so they are not necessarily aligned; use
+ * image_readRecord() to get at one. Every offset and count in the index is
+ * checked against the size of its file before it is followed, since the
+ * files may be corrupt.
+ *
+ * image_mapContainer() gets the same view from an index container (see
+ * zui.h) with a single mmap(): each "file" is then one of its sections.
+ **/
+int image_map(struct indexImageS *img)
+{
+	void		*mem;
+
+	memset(img, 0, sizeof(*img));
+	for (int i=0; i<IDXF_N_FILES; i++)
+	{
+		img->sizes[i] = indexHeader.fileSizes[i];
+		// A zero length mapping isn't allowed.
+		if (img->sizes[i] == 0) { continue; };
+
+		mem = mmap(
+			NULL, img->sizes[i], PROT_READ, MAP_PRIVATE,
+			indexFds[i], 0);
+
+		if (mem == MAP_FAILED)
+		{
+			fprintf(stderr, "Error: Failed to map in %s.\n",
+				indexFileNames[i]);
+
+			image_unmap(img);
+			return EX_FILE_IO;
+		};
+
+		img->files[i] = (const uint8_t *)mem;
+	};
+
+	return EX_SUCCESS;
+}
+
+static int image_checkContainer(
+	struct indexImageS *img, const char *fileName
+	)
+{
+	struct zui::container::sHeader	h, raw;
+	struct zui::container::sSection	s;
+	uint64_t			tableEnd;
+
+	if (img->containerSize < sizeof(h)) { return EX_NO_INDEX; };
+
+	memcpy(&h, img->container, sizeof(h));
+	h.endianness[sizeof(h.endianness) - 1] = '\0';
+	if (memcmp(h.magic, ZUI_CONTAINER_MAGIC, sizeof(h.magic))
+		|| serial_setTargetOrder(h.endianness) != EX_SUCCESS)
+	{
+		return EX_NO_INDEX;
+	};
+
+	memcpy(&raw, img->container, sizeof(raw));
+	serial_decode(&h);
+	if (h.majorVersion != ZUI_VERSION_MAJOR
+		|| h.minorVersion != ZUI_VERSION_MINOR)
+	{
+		fprintf(stderr, "Error: Index record format v%d.%d of %s is "
+			"not supported.\n",
+			h.majorVersion, h.minorVersion, fileName);
+
+		return EX_GENERAL;
+	};
+
+	tableEnd = h.sectionTableOff + (uint64_t)h.nSections * sizeof(s);
+	if (h.fileSize > img->containerSize || h.nSections < IDXF_N_FILES
+		|| tableEnd > h.fileSize)
+	{
+		return EX_NO_INDEX;
+	};
+
+	// The checksum is of the header as it is stored.
+	if (h.checksum != zui::container::checksum(
+		&raw,
+		(const struct zui::container::sSection *)
+			&img->container[h.sectionTableOff],
+		h.nSections))
+	{
+		fprintf(stderr, "Error: %s is corrupt (container checksum "
+			"mismatch).\n", fileName);
+
+		return EX_GENERAL;
+	};
+
+	for (int i=0; i<IDXF_N_FILES; i++)
+	{
+		memcpy(
+			&s, &img->container[h.sectionTableOff + i * sizeof(s)],
+			sizeof(s));
+
+		serial_decode(&s);
+		if (s.type != (uint32_t)i
+			|| s.alignment == 0 || (s.alignment & (s.alignment - 1))
+			|| s.offset % s.alignment != 0
+			|| (uint64_t)s.offset + s.length > h.fileSize)
+		{
+			return EX_NO_INDEX;
+		};
+
+		img->files[i] = &img->container[s.offset];
+		img->sizes[i] = s.length;
+	};
+
+	/* The index header is at the start of the drivers section, and the file
+	 * sizes in it have to agree with the section table.
+	 **/
+	if (img->sizes[IDXF_DRIVERS] < sizeof(indexHeader))
+		{ return EX_NO_INDEX; };
+
+	memcpy(&indexHeader, img->files[IDXF_DRIVERS], sizeof(indexHeader));
+	if (strncmp(
+		indexHeader.endianness, h.endianness,
+		sizeof(indexHeader.endianness))
+		|| crc_checkHeader(&indexHeader) != EX_SUCCESS)
+	{
+		return EX_NO_INDEX;
+	};
+
+	serial_decode(&indexHeader);
+	for (int i=0; i<IDXF_N_FILES; i++)
+	{
+		if (indexHeader.fileSizes[i] != img->sizes[i])
+			{ return EX_NO_INDEX; };
+	};
+
+	return EX_SUCCESS;
+}
+
+int image_mapContainer(struct indexImageS *img, const char *fileName)
+{
+	struct stat	st;
+	void		*mem;
+	int		fd, ret;
+
+	memset(img, 0, sizeof(*img));
+	fd = open(fileName, O_RDONLY);
+	if (fd < 0)
+	{
+		fprintf(stderr, "Error: Failed to open %s.\n", fileName);
+		return EX_FILE_OPEN;
+	};
+
+	if (fstat(fd, &st) != 0 || st.st_size == 0
+		|| (uint64_t)st.st_size > UINT32_MAX)
+	{
+		fprintf(stderr, "Error: %s is not an index container.\n",
+			fileName);
+
+		close(fd);
+		return EX_NO_INDEX;
+	};
+
+	mem = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (mem == MAP_FAILED)
+	{
+		fprintf(stderr, "Error: Failed to map in %s.\n", fileName);
+		return EX_FILE_IO;
+	};
+
+	img->container = (const uint8_t *)mem;
+	img->containerSize = st.st_size;
+
+	if ((ret = image_checkContainer(img, fileName)) != EX_SUCCESS)
+	{
+		if (ret == EX_NO_INDEX)
+		{
+			fprintf(stderr, "Error: %s is not a valid index "
+				"container.\n", fileName);
+		};
+
+		image_unmap(img);
+		return ret;
+	};
+
+	return EX_SUCCESS;
+}
+
+void image_unmap(struct indexImageS *img)
+{
+	// A container is a single mapping; its sections point into it.
+	if (img->container != NULL)
+	{
+		munmap((void *)img->container, img->containerSize);
+		memset(img, 0, sizeof(*img));
+		return;
+	};
+
+	for (int i=0; i<IDXF_N_FILES; i++)
+	{
+		if (img->files[i] != NULL)
+			{ munmap((void *)img->files[i], img->sizes[i]); };
+	};
+
+	memset(img, 0, sizeof(*img));
+}
+
+uint32_t image_getNDrivers(const struct indexImageS *img)
+{
+	uint32_t	size=img->sizes[IDXF_DRIVERS];
+
+	if (size < sizeof(struct zui::sHeader)) { return 0; };
+	return (size - sizeof(struct zui::sHeader))
+		/ sizeof(struct zui::driver::sHeader);
+}
+
+const char *image_getString(const struct indexImageS *img, uint32_t offset)
+{
+	const uint8_t	*str;
+
+	if (offset >= img->sizes[IDXF_STRINGS]) { return NULL; };
+
+	str = &img->files[IDXF_STRINGS][offset];
+	if (memchr(str, '\0', img->sizes[IDXF_STRINGS] - offset) == NULL)
+		{ return NULL; };
+
+	return (const char *)str;
+}
+
+// Returns the name with the given ID in the attribute name dictionary.
+const char *image_getAttrName(const struct indexImageS *img, uint32_t id)
+{
+	struct zui::sAttrNameDict	d;
+	uint32_t			off=indexHeader.attrNamesOff, nameOff;
+
+	if (indexHeader.attrNamesLen == 0
+		|| image_readRecord(img, IDXF_DEVICES, off, 0, &d) != EX_SUCCESS
+		|| id >= d.nNames)
+	{
+		return NULL;
+	};
+
+	off += sizeof(d) + (d.nBuckets + d.nNames) * sizeof(uint32_t);
+	if (image_readRecord(img, IDXF_DEVICES, off, id, &nameOff)
+		!= EX_SUCCESS)
+		{ return NULL; };
+
+	return image_getString(img, nameOff);
+}
+
+/* Looks a name up in the attribute name dictionary through its perfect
+ * hash. Returns EX_GENERAL if the name isn't in it.
+ **/
+int image_findAttrName(
+	const struct indexImageS *img, const char *name, uint16_t *id
+	)
+{
+	struct zui::sAttrNameDict	d;
+	const char			*str;
+	uint32_t			off=indexHeader.attrNamesOff;
+	uint32_t			seed, slotId;
+
+	if (indexHeader.attrNamesLen == 0
+		|| image_readRecord(img, IDXF_DEVICES, off, 0, &d) != EX_SUCCESS
+		|| d.nNames == 0 || d.nBuckets == 0)
+	{
+		return EX_GENERAL;
+	};
+
+	off += sizeof(d);
+	if (image_readRecord(
+		img, IDXF_DEVICES, off,
+		zui::attrNameHash(name) % d.nBuckets, &seed) != EX_SUCCESS
+		|| image_readRecord(
+			img, IDXF_DEVICES, off + d.nBuckets * sizeof(uint32_t),
+			zui::attrNameSlot(name, seed, d.nNames), &slotId)
+			!= EX_SUCCESS)
+	{
+		return EX_GENERAL;
+	};
+
+	str = image_getAttrName(img, slotId);
+	if (str == NULL || strcmp(str, name)) { return EX_GENERAL; };
+
+	*id = slotId;
+	return EX_SUCCESS;
+}
+
+/* Copies the text of one of the driver's messages into "buff", from the
+ * string file or from the compressed block that holds it.
+ **/
+int image_readMessage(
+	const struct indexImageS *img, const struct zui::driver::sHeader *h,
+	const struct zui::driver::sMessage *msg, char *buff, uint32_t buffSize
+	)
+{
+	struct zui::driver::sMessageBlock	block;
+	uint8_t					text[ZUI_MESSAGE_BLOCK_MAXLEN];
+	const uint8_t				*payload;
+	const char				*str;
+	uint32_t				payloadOff, len;
+
+	if (!(h->flags & ZUI_DRIVER_FLAGS_COMPRESSED_MESSAGES))
+	{
+		str = image_getString(img, msg->messageOff);
+		if (str == NULL || strlen(str) >= buffSize)
+			{ return EX_GENERAL; };
+
+		strcpy(buff, str);
+		return EX_SUCCESS;
+	};
+
+	if (image_readRecord(img, IDXF_DATA, msg->messageOff, 0, &block)
+		!= EX_SUCCESS
+		|| block.length > ZUI_MESSAGE_BLOCK_MAXLEN)
+	{
+		return EX_GENERAL;
+	};
+
+	payloadOff = msg->messageOff + sizeof(block);
+	len = (block.compressedLength != 0)
+		? block.compressedLength : block.length;
+
+	if (len > img->sizes[IDXF_DATA] - payloadOff) { return EX_GENERAL; };
+
+	payload = &img->files[IDXF_DATA][payloadOff];
+	if (block.compressedLength == 0) { memcpy(text, payload, len); }
+	else if (zui::lz::decompress(payload, len, text, block.length)
+		!= block.length)
+	{
+		return EX_GENERAL;
+	};
+
+	if (msg->textOff >= block.length) { return EX_GENERAL; };
+
+	// The text must end within the block.
+	str = (const char *)&text[msg->textOff];
+	len = block.length - msg->textOff;
+	if (memchr(str, '\0', len) == NULL || strlen(str) >= buffSize)
+		{ return EX_GENERAL; };
+
+	strcpy(buff, str);
+	return EX_SUCCESS;
+}
+
+/* The selector is "*" for every driver, a driver ID, or a shortname. A base
+ * path given with "-b" narrows it down further.
+ **/
+int image_isSelected(
+	const struct zui::driver::sHeader *h, const char *selector
+	)
+{
+	size_t		len=strlen(selector);
+
+	if (basePath != NULL
+		&& strncmp(h->basePath, basePath, ZUI_DRIVER_BASEPATH_MAXLEN))
+	{
+		return 0;
+	};
+
+	if (!strcmp(selector, "*")) { return 1; };
+
+	if (len > 0 && strspn(selector, "0123456789") == len)
+		{ return h->id == strtoul(selector, NULL, 10); };
+
+	return len < ZUI_DRIVER_SHORTNAME_MAXLEN
+		&& !strncmp(h->shortName, selector, ZUI_DRIVER_SHORTNAME_MAXLEN);
+}
@@ -1,16 +1,17 @@
 
 #include "zudipropsc.h"
+#include <errno.h>
+#include <fcntl.h>
 #include <string.h>
+#include <unistd.h>
 
 
+// The record lists themselves are kept in each driver's parser context.
 struct listElementS
 {
 	struct listElementS	*next;
 	void			*item;
-} *regionList=NULL, *deviceList=NULL,
-	*messageList=NULL, *disasterMessageList=NULL,
-	*messageFileList=NULL, *readableFileList=NULL,
-	*rankList=NULL, *provisionList=NULL;
+};
 
 static int list_insert(struct listElementS **list, void *item)
 {
@@ -42,17 +43,188 @@ static void list_free(struct listElementS **list)
 	for (tmp = *list; tmp != NULL; tmp = *list)
 	{
 		*list = (*list)->next;
-		free(tmp);
+		// Items are allocated by the parser with malloc().
+		free(tmp->item);
+		delete tmp;
 	};
 
 	*list = NULL;
 }
 
-void index_initialize(void)
+/**	EXPLANATION:
+ * Each index file is compiled into an in-memory section buffer, and flushed to
+ * disk with a single write when the run is done. Record offsets are computed
+ * arithmetically from the size of the file when it was opened plus the number
+ * of bytes buffered so far, so there is no per-record stdio traffic at all.
+ *
+ * A section's buffer holds the file's contents from file offset "base"
+ * onward. The first "clean" bytes of the buffer are already on disk. The
+ * string section is the odd one out: it holds the whole file (base 0), since
+ * the string table compares new strings against the existing ones.
+ **/
+int			indexFds[IDXF_N_FILES];
+struct sectionS		indexSections[IDXF_N_FILES];
+// Whether the index's byte order differs from the host's. See serial.h.
+int			serialNeedsSwap=0;
+
+int serial_setTargetOrder(const char *endianness)
 {
+	int		hostIsBigEndian;
+
+	hostIsBigEndian = __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__;
+	if (!strcmp(endianness, "le")) { serialNeedsSwap = hostIsBigEndian; }
+	else if (!strcmp(endianness, "be")) { serialNeedsSwap = !hostIsBigEndian; }
+	else { return EX_GENERAL; };
+
+	return EX_SUCCESS;
+}
+
+uint32_t section_tell(struct sectionS *s)
+{
+	return s->base + s->len;
+}
+
+int section_reserve(struct sectionS *s, uint32_t len)
+{
+	uint8_t		*tmp;
+	uint32_t	newCapacity;
+
+	if (s->len + len <= s->capacity) { return EX_SUCCESS; };
+
+	newCapacity = (s->capacity == 0) ? 4096 : s->capacity;
+	while (newCapacity < s->len + len) { newCapacity *= 2; };
+
+	tmp = (uint8_t *)realloc(s->buff, newCapacity);
+	if (tmp == NULL)
+	{
+		fprintf(stderr, "Error: Nomem while growing section buffer.\n");
+		return EX_NOMEM;
+	};
+
+	s->buff = tmp;
+	s->capacity = newCapacity;
+	return EX_SUCCESS;
+}
+
+int section_append(
+	struct sectionS *s, const void *data, uint32_t len, uint32_t *offset
+	)
+{
+	if (section_reserve(s, len) != EX_SUCCESS) { return EX_NOMEM; };
+
+	if (offset != NULL) { *offset = section_tell(s); };
+	memcpy(&s->buff[s->len], data, len);
+	s->len += len;
+	return EX_SUCCESS;
+}
+
+static int section_flush(struct sectionS *s, int fd)
+{
+	ssize_t		nWritten;
+
+	while (s->clean < s->len)
+	{
+		nWritten = pwrite(
+			fd, &s->buff[s->clean], s->len - s->clean,
+			s->base + s->clean);
+
+		if (nWritten < 0 && errno == EINTR) { continue; };
+		if (nWritten <= 0) { return EX_FILE_IO; };
+		s->clean += nWritten;
+	};
+
+	return EX_SUCCESS;
+}
+
+static void section_free(struct sectionS *s)
+{
+	free(s->buff);
+	memset(s, 0, sizeof(*s));
 }
 
-int index_insert(enum parser_lineTypeE lineType, void *obj)
+int index_openFiles(void)
+{
+	char		*fullName=NULL;
+	int		i;
+
+	for (i=0; i<IDXF_N_FILES; i++) { indexFds[i] = -1; };
+
+	for (i=0; i<IDXF_N_FILES; i++)
+	{
+		fullName = makeFullName(fullName, indexPath, indexFileNames[i]);
+		if (fullName == NULL)
+		{
+			fprintf(stderr, "Error: Nomem in makeFullName for index "
+				"file %s.\n", indexFileNames[i]);
+
+			index_closeFiles();
+			return EX_NOMEM;
+		};
+
+		indexFds[i] = open(fullName, O_RDWR);
+		if (indexFds[i] < 0)
+		{
+			fprintf(stderr, "Error: Failed to open index file %s.\n",
+				fullName);
+
+			free(fullName);
+			index_closeFiles();
+			return EX_FILE_OPEN;
+		};
+
+		// txn_begin() fills in the committed size of the file.
+		memset(&indexSections[i], 0, sizeof(indexSections[i]));
+	};
+
+	free(fullName);
+	return EX_SUCCESS;
+}
+
+int index_flushFiles(void)
+{
+	for (int i=0; i<IDXF_N_FILES; i++)
+	{
+		/* devices.zudi-index and provisions.zudi-index end with a
+		 * table that is rebuilt on every commit, so they aren't
+		 * appended to in place; txn_commit() rewrites them.
+		 **/
+		if (i == IDXF_DEVICES || i == IDXF_PROVISIONS) { continue; };
+
+		if (section_flush(&indexSections[i], indexFds[i]) != EX_SUCCESS)
+		{
+			fprintf(stderr, "Error: Failed to write out %s.\n",
+				indexFileNames[i]);
+
+			return EX_FILE_IO;
+		};
+	};
+
+	return EX_SUCCESS;
+}
+
+void index_closeFiles(void)
+{
+	for (int i=0; i<IDXF_N_FILES; i++)
+	{
+		section_free(&indexSections[i]);
+		if (indexFds[i] < 0) { continue; };
+		close(indexFds[i]);
+		indexFds[i] = -1;
+	};
+}
+
+void index_initialize(struct parserContextS *ctxt)
+{
+	ctxt->regionList = ctxt->deviceList = NULL;
+	ctxt->messageList = ctxt->disasterMessageList = NULL;
+	ctxt->messageFileList = ctxt->readableFileList = NULL;
+	ctxt->rankList = ctxt->provisionList = NULL;
+}
+
+int index_insert(
+	struct parserContextS *ctxt, enum parser_lineTypeE lineType,
+	void *obj
+	)
 {
 	if (lineType == LT_MISC || lineType == LT_DRIVER
 		|| lineType == LT_CHILD_BOPS || lineType == LT_PARENT_BOPS
@@ -65,28 +237,28 @@ int index_insert(enum parser_lineTypeE lineType, void *obj)
 	switch (lineType)
 	{
 	case LT_REGION:
-		return list_insert(&regionList, obj);
+		return list_insert(&ctxt->regionList, obj);
 
 	case LT_DEVICE:
-		return list_insert(&deviceList, obj);
+		return list_insert(&ctxt->deviceList, obj);
 
 	case LT_MESSAGE:
-		return list_insert(&messageList, obj);
+		return list_insert(&ctxt->messageList, obj);
 
 	case LT_DISASTER_MESSAGE:
-		return list_insert(&disasterMessageList, obj);
+		return list_insert(&ctxt->disasterMessageList, obj);
 
 	case LT_MESSAGE_FILE:
-		return list_insert(&messageFileList, obj);
+		return list_insert(&ctxt->messageFileList, obj);
 
 	case LT_READABLE_FILE:
-		return list_insert(&readableFileList, obj);
+		return list_insert(&ctxt->readableFileList, obj);
 
 	case LT_RANK:
-		return list_insert(&rankList, obj);
+		return list_insert(&ctxt->rankList, obj);
 
 	case LT_PROVIDES:
-		return list_insert(&provisionList, obj);
+		return list_insert(&ctxt->provisionList, obj);
 
 	default:
 		fprintf(stderr, "Unknown line type fell into index_insert.\n");
@@ -94,360 +266,292 @@ int index_insert(enum parser_lineTypeE lineType, void *obj)
 	};
 }
 
-void index_free(void)
+void index_free(struct parserContextS *ctxt)
 {
-	list_free(&regionList);
-	list_free(&deviceList);
-	list_free(&messageList);
-	list_free(&disasterMessageList);
-	list_free(&messageFileList);
-	list_free(&readableFileList);
-	list_free(&rankList);
-	list_free(&provisionList);
+	list_free(&ctxt->regionList);
+	list_free(&ctxt->deviceList);
+	list_free(&ctxt->messageList);
+	list_free(&ctxt->disasterMessageList);
+	list_free(&ctxt->messageFileList);
+	list_free(&ctxt->readableFileList);
+	list_free(&ctxt->rankList);
+	list_free(&ctxt->provisionList);
 }
 
-static int index_writeDriverHeader(void)
+static int index_writeDriverHeader(struct parserContextS *ctxt)
 {
-	FILE				*dhFile;
-	char				*fullName=NULL;
+	struct sectionS			*dhS=&indexSections[IDXF_DRIVERS];
 	struct zui::driver::sDriver	*dStruct;
 
-	fullName = makeFullName(
-		fullName, indexPath, "drivers.zudi-index");
-
-	if (fullName == NULL) { return EX_NOMEM; };
-
-	dhFile = fopen(fullName, "a");
-	if (dhFile == NULL)
-	{
-		fprintf(stderr, "Error: Failed to open driver header index for "
-			"appending.\n");
-
-		return EX_FILE_OPEN;
-	};
-
-	dStruct = parser_getCurrentDriverState();
-	if (fwrite(&dStruct->h, sizeof(dStruct->h), 1, dhFile) != 1)
+	dStruct = parser_getCurrentDriverState(ctxt);
+	if (serial_append(dhS, &dStruct->h, NULL)
+		!= EX_SUCCESS)
 	{
 		fprintf(stderr, "Error: failed to write out driver header.\n");
 		return EX_FILE_IO;
 	};
 
-	fclose(dhFile);
 	return EX_SUCCESS;
 }
 
-static int index_writeDriverData(uint32_t *fileOffset)
+static int index_writeDriverData(
+	struct parserContextS *ctxt, uint32_t *fileOffset
+	)
 {
-	FILE				*ddFile, *strFile;
+	struct sectionS			*dataS=&indexSections[IDXF_DATA],
+					*stringS=&indexSections[IDXF_STRINGS];
 	int				i;
 	struct zui::driver::sDriver	*dStruct;
-	char				*driverDataFFullName=NULL,
-					*stringFFullName=NULL;
-
-	driverDataFFullName = makeFullName(
-		driverDataFFullName, indexPath, "data.zudi-index");
-
-	stringFFullName = makeFullName(
-		stringFFullName, indexPath, "strings.zudi-index");
-
-	if (driverDataFFullName == NULL || stringFFullName == NULL)
-	{
-		fprintf(stderr, "Error: Nomem in makeFullName for driver-data "
-			"index.\n");
 
-		return EX_NOMEM;
-	};
+	*fileOffset = section_tell(dataS);
+	dStruct = parser_getCurrentDriverState(ctxt);
 
-	ddFile = fopen(driverDataFFullName, "a");
-	strFile = fopen(stringFFullName, "a");
-	if (ddFile == NULL || strFile == NULL)
+	if (verboseMode)
 	{
-		fprintf(stderr, "Error: Failed to open driver-data or string index.\n");
-		return EX_FILE_OPEN;
+		strtab_appendRaw(
+			stringS, "::MODULES::", strlen("::MODULES::") + 1, NULL);
 	};
 
-	*fileOffset = ftell(ddFile);
-	dStruct = parser_getCurrentDriverState();
-
-	if (verboseMode)
-		{ fwrite("::MODULES::", strlen("::MODULES::")+1, 1, strFile); };
-
-	dStruct->h.modulesOffset = ftell(ddFile);
+	dStruct->h.modulesOffset = section_tell(dataS);
 	// First write out the modules.
 	for (i=0; i<dStruct->h.nModules; i++)
 	{
-		if (dStruct->modules[i].writeOut(ddFile, strFile) != EX_SUCCESS)
+		if (dStruct->modules[i].writeOut(dataS, stringS) != EX_SUCCESS)
 		{
-			fclose(ddFile);
 			fprintf(stderr, "Error: Failed to write out module.\n");
 			return EX_FILE_IO;
 		};
 	};
 
 	if (verboseMode)
-		{ fwrite("::REQUIREMENTS::", strlen("::REQUIREMENTS::")+1, 1, strFile); };
+	{
+		strtab_appendRaw(
+			stringS, "::REQUIREMENTS::",
+			strlen("::REQUIREMENTS::") + 1, NULL);
+	};
 
-	dStruct->h.requirementsOffset = ftell(ddFile);
+	dStruct->h.requirementsOffset = section_tell(dataS);
 	// Then write out the requirements.
 	for (i=0; i<dStruct->h.nRequirements; i++)
 	{
-		if (dStruct->requirements[i].writeOut(ddFile, strFile)
+		if (dStruct->requirements[i].writeOut(dataS, stringS)
 			!= EX_SUCCESS)
 		{
-			fclose(ddFile);
-			fclose(strFile);
 			fprintf(stderr, "Error: Failed to write out requirement.\n");
 			return EX_FILE_IO;
 		};
 	};
 
 	if (verboseMode)
-		{ fwrite("::METAS::", strlen("::METAS::")+1, 1, strFile); };
+	{
+		strtab_appendRaw(
+			stringS, "::METAS::", strlen("::METAS::") + 1, NULL);
+	};
 
-	dStruct->h.metalanguagesOffset = ftell(ddFile);
+	dStruct->h.metalanguagesOffset = section_tell(dataS);
 	// Then write out the metalanguage indexes.
 	for (i=0; i<dStruct->h.nMetalanguages; i++)
 	{
-		if (dStruct->metalanguages[i].writeOut(ddFile, strFile)
+		if (dStruct->metalanguages[i].writeOut(dataS, stringS)
 			!= EX_SUCCESS)
 		{
-			fclose(ddFile);
-			fclose(strFile);
 			fprintf(stderr, "Error: Failed to write out metalanguage.\n");
 			return EX_FILE_IO;
 		};
 	};
 
 	if (verboseMode)
-		{ fwrite("::PBOPS::", strlen("::PBOPS::")+1, 1, strFile); };
+	{
+		strtab_appendRaw(
+			stringS, "::PBOPS::", strlen("::PBOPS::") + 1, NULL);
+	};
 
-	dStruct->h.parentBopsOffset = ftell(ddFile);
+	dStruct->h.parentBopsOffset = section_tell(dataS);
 	// Then write out the parent bops.
 	for (i=0; i<dStruct->h.nParentBops; i++)
 	{
-		if (fwrite(
-			&dStruct->parentBops[i],
-			sizeof(dStruct->parentBops[i]),
-			1, ddFile)
-			!= 1)
+		if (serial_append(dataS, &dStruct->parentBops[i], NULL)
+			!= EX_SUCCESS)
 		{
-			fclose(ddFile);
-			fclose(strFile);
 			fprintf(stderr, "Error: Failed to write out parent bop.\n");
 			return EX_FILE_IO;
 		};
 	};
 
 	if (verboseMode)
-		{ fwrite("::CBOPS::", strlen("::CBOPS::")+1, 1, strFile); };
+	{
+		strtab_appendRaw(
+			stringS, "::CBOPS::", strlen("::CBOPS::") + 1, NULL);
+	};
 
-	dStruct->h.childBopsOffset = ftell(ddFile);
+	dStruct->h.childBopsOffset = section_tell(dataS);
 	// Then write out the child bops.
 	for (i=0; i<dStruct->h.nChildBops; i++)
 	{
-		if (fwrite(
-			&dStruct->childBops[i],
-			sizeof(dStruct->childBops[i]),
-			1, ddFile)
-			!= 1)
+		if (serial_append(dataS, &dStruct->childBops[i], NULL)
+			!= EX_SUCCESS)
 		{
-			fclose(ddFile);
-			fclose(strFile);
 			fprintf(stderr, "Error: Failed to write out child bop.\n");
 			return EX_FILE_IO;
 		};
 	};
 
 	if (verboseMode)
-		{ fwrite("::IBOPS::", strlen("::IBOPS::")+1, 1, strFile); };
+	{
+		strtab_appendRaw(
+			stringS, "::IBOPS::", strlen("::IBOPS::") + 1, NULL);
+	};
 
-	dStruct->h.internalBopsOffset = ftell(ddFile);
+	dStruct->h.internalBopsOffset = section_tell(dataS);
 	// Then write out the internal bops.
 	for (i=0; i<dStruct->h.nInternalBops; i++)
 	{
-		if (fwrite(
-			&dStruct->internalBops[i],
-			sizeof(dStruct->internalBops[i]),
-			1, ddFile)
-			!= 1)
+		if (serial_append(dataS, &dStruct->internalBops[i], NULL)
+			!= EX_SUCCESS)
 		{
-			fclose(ddFile);
-			fclose(strFile);
 			fprintf(stderr, "Error: Failed to write out internal bop.\n");
 			return EX_FILE_IO;
 		};
 	};
 
 	// Done.
-	fclose(ddFile);
-	fclose(strFile);
 	return EX_SUCCESS;
 }
 
-int index_writeDevices(uint32_t *offset)
+static int index_writeDevices(
+	struct parserContextS *ctxt, uint32_t *offset
+	)
 {
 	struct listElementS		*tmp;
 	struct zui::device::_sDevice	*dev;
-	FILE				*dataFile, *devFile, *strFile;
-	char				*deviceFFullName=NULL,
-					*stringFFullName=NULL,
-					*dataFFullName=NULL;
-
-	deviceFFullName = makeFullName(
-		deviceFFullName, indexPath, "devices.zudi-index");
-
-	stringFFullName = makeFullName(
-		stringFFullName, indexPath, "strings.zudi-index");
-
-	dataFFullName = makeFullName(
-		dataFFullName, indexPath, "data.zudi-index");
+	struct zui::driver::sDriver	*dStruct;
+	struct sectionS			*dataS=&indexSections[IDXF_DATA],
+					*devS=&indexSections[IDXF_DEVICES],
+					*stringS=&indexSections[IDXF_STRINGS];
+	const char			*meta;
+	uint32_t			devOff;
 
-	if (deviceFFullName == NULL || stringFFullName == NULL
-		|| dataFFullName == NULL)
+	if (verboseMode)
 	{
-		fprintf(stderr, "Error: Nomem in makeFullName for devices index.\n");
-		return EX_NOMEM;
+		strtab_appendRaw(
+			stringS, "::DEVICES::", strlen("::DEVICES::") + 1, NULL);
 	};
 
-	devFile = fopen(deviceFFullName, "a");
-	strFile = fopen(stringFFullName, "a");
-	dataFile = fopen(dataFFullName, "a");
-	if (devFile == NULL || strFile == NULL || dataFile == NULL)
+	*offset = section_tell(devS);
+	dStruct = parser_getCurrentDriverState(ctxt);
+
+	// The match filter is built anew along with the devices.
+	memset(dStruct->h.matchFilter, 0, sizeof(dStruct->h.matchFilter));
+	for (int i=0; i<dStruct->h.nMetalanguages; i++)
 	{
-		fprintf(stderr, "Error: Failed to open devices, data or strings index.\n");
-		return EX_FILE_OPEN;
+		zui::driver::matchFilterAdd(
+			dStruct->h.matchFilter,
+			zui::driver::matchFilterMetaHash(
+				dStruct->metalanguages[i].name));
 	};
 
-	if (verboseMode)
-		{ fwrite("::DEVICES::", strlen("::DEVICES::")+1, 1, strFile); };
-
-	*offset = ftell(devFile);
-
-	for (tmp = deviceList; tmp != NULL; tmp = tmp->next)
+	for (tmp = ctxt->deviceList; tmp != NULL; tmp = tmp->next)
 	{
 		dev = (zui::device::_sDevice *)tmp->item;
+		devOff = section_tell(devS);
 
 		// Write the device header out.
-		if (dev->writeOut(devFile, dataFile, strFile) != EX_SUCCESS)
+		if (dev->writeOut(devS, dataS, stringS) != EX_SUCCESS)
 		{
 			fprintf(stderr, "Failed to write out device line.\n");
-			break;
+			return EX_FILE_IO;
+		};
+
+		if (attrcol_addDevice(dev, devOff) != EX_SUCCESS)
+			{ return EX_NOMEM; };
+
+		match_addToFilter(dStruct->h.matchFilter, dev);
+
+		// Enter its attributes into the device match table.
+		meta = NULL;
+		for (int i=0; i<dStruct->h.nMetalanguages; i++)
+		{
+			if (dStruct->metalanguages[i].index == dev->h.metaIndex)
+				{ meta = dStruct->metalanguages[i].name; };
+		};
+
+		if (meta != NULL
+			&& match_addDevice(meta, dev, devOff) != EX_SUCCESS)
+		{
+			return EX_NOMEM;
 		};
 	};
 
-	fclose(devFile);
-	fclose(dataFile);
-	fclose(strFile);
 	return EX_SUCCESS;
 }
 
 
-static int index_writeProvisions(uint32_t *provOffset)
+static int index_writeProvisions(
+	struct parserContextS *ctxt, uint32_t *provOffset
+	)
 {
-	char		*provFFullName=NULL, *stringFFullName=NULL;
-	FILE		*provF, *stringF;
+	struct sectionS	*provS=&indexSections[IDXF_PROVISIONS],
+			*stringS=&indexSections[IDXF_STRINGS];
 	listElementS	*tmp;
 	int		err=EX_SUCCESS;
 
-	provFFullName = makeFullName(
-		provFFullName, indexPath, "provisions.zudi-index");
-
-	stringFFullName = makeFullName(
-		stringFFullName, indexPath, "strings.zudi-index");
-
-	if (provFFullName == NULL || stringFFullName == NULL)
-	{
-		fprintf(stderr, "Failed to makeFullName for provision or string index.\n");
-		return EX_NOMEM;
-	};
-
-	provF = fopen(provFFullName, "a");
-	stringF = fopen(stringFFullName, "a");
-	if (provF == NULL || stringF == NULL)
+	if (verboseMode)
 	{
-		fprintf(stderr, "Failed to open prov or string index.\n");
-		return EX_FILE_OPEN;
+		strtab_appendRaw(
+			stringS, "::PROVISIONS::",
+			strlen("::PROVISIONS::") + 1, NULL);
 	};
 
-	if (verboseMode)
-		{ fwrite("::PROVISIONS::", strlen("::PROVISIONS::")+1, 1, stringF); };
+	*provOffset = section_tell(provS);
 
-	*provOffset = ftell(provF);
-
-	for (tmp = provisionList; tmp != NULL; tmp = tmp->next)
+	for (tmp = ctxt->provisionList; tmp != NULL; tmp = tmp->next)
 	{
 		zui::driver::_sProvision	*item;
 
 		item = (zui::driver::_sProvision *)tmp->item;
-		err = item->writeOut(provF, stringF);
+		err = item->writeOut(provS, stringS);
 		if (err != EX_SUCCESS)
 		{
 			fprintf(stderr, "Failed to write out item from provisionList.\n");
-			break;
+			return err;
 		};
+
+		if ((err = provdir_addProvision(item)) != EX_SUCCESS)
+			{ return err; };
 	};
 
-	fclose(provF);
-	fclose(stringF);
 	return EX_SUCCESS;
 }
 
-static int index_writeRanks(uint32_t *fileOffset)
+static int index_writeRanks(
+	struct parserContextS *ctxt, uint32_t *fileOffset
+	)
 {
 	struct listElementS		*tmp;
 	struct zui::rank::_sRank	*item;
-	FILE				*rankF, *dataF, *stringF;
-	char				*rankFFullName=NULL,
-					*dataFFullName=NULL,
-					*stringFFullName=NULL;
-
-	rankFFullName = makeFullName(
-		rankFFullName, indexPath, "ranks.zudi-index");
-
-	dataFFullName = makeFullName(
-		dataFFullName, indexPath, "data.zudi-index");
+	struct sectionS			*rankS=&indexSections[IDXF_RANKS],
+					*dataS=&indexSections[IDXF_DATA],
+					*stringS=&indexSections[IDXF_STRINGS];
 
-	stringFFullName = makeFullName(
-		stringFFullName, indexPath, "strings.zudi-index");
-
-	if (rankFFullName == NULL || dataFFullName == NULL
-		|| stringFFullName == NULL)
-	{
-		fprintf(stderr, "Error: Nomem in makeFullName for ranks, "
-			"driver-data or string index.\n");
-
-		return EX_NOMEM;
-	};
-
-	rankF = fopen(rankFFullName, "a");
-	dataF = fopen(dataFFullName, "a");
-	stringF = fopen(stringFFullName, "a");
-	if (rankF == NULL || dataF == NULL || stringF == NULL)
+	if (verboseMode)
 	{
-		fprintf(stderr, "Error: Failed to open ranks, data or string index.\n");
-		return EX_FILE_OPEN;
+		strtab_appendRaw(
+			stringS, "::RANKS::", strlen("::RANKS::") + 1, NULL);
 	};
 
-	if (verboseMode)
-		{ fwrite("::RANKS::", strlen("::RANKS::")+1, 1, stringF); };
-
-	*fileOffset = ftell(rankF);
+	*fileOffset = section_tell(rankS);
 
-	for (tmp = rankList; tmp != NULL; tmp = tmp->next)
+	for (tmp = ctxt->rankList; tmp != NULL; tmp = tmp->next)
 	{
 		item = (zui::rank::_sRank *)tmp->item;
 
-		if (item->writeOut(rankF, dataF, stringF))
+		if (item->writeOut(rankS, dataS, stringS) != EX_SUCCESS)
 		{
 			fprintf(stderr, "Failed to write out rank line.\n");
-			break;
+			return EX_FILE_IO;
 		};
 	};
 
-	fclose(rankF);
-	fclose(dataF);
-	fclose(stringF);
 	return EX_SUCCESS;
 }
 
@@ -457,58 +561,427 @@ static int index_writeListToDisk(
 	)
 {
 	(void)type;
-	char		*dataFFullName=NULL, *stringFFullName=NULL;
-	FILE		*dataF, *stringF;
+	struct sectionS	*dataS=&indexSections[IDXF_DATA],
+			*stringS=&indexSections[IDXF_STRINGS];
 	listElementS	*tmp;
 	int		err=EX_SUCCESS;
 
-	dataFFullName = makeFullName(
-		dataFFullName, indexPath, "data.zudi-index");
+	*offset = section_tell(dataS);
+
+	for (tmp = list; tmp != NULL; tmp = tmp->next)
+	{
+		T		*item;
+
+		item = (T *)tmp->item;
+		err = item->writeOut(dataS, stringS);
+		if (err != EX_SUCCESS)
+		{
+			fprintf(stderr, "Failed to write out object from %s list.\n",
+				listName);
+
+			return err;
+		};
+	};
+
+	return EX_SUCCESS;
+}
+
+struct indexMessageS
+{
+	struct zui::driver::_sMessage	*item;
+	uint32_t			order;
+};
+
+// The order of the locales in a driver's locale directory.
+static int index_compareLocales(const char *a, const char *b)
+{
+	uint32_t	aHash, bHash;
+
+	if (strcmp(a, b) == 0) { return 0; };
+	if (strcmp(a, ZUI_LOCALE_DEFAULT) == 0) { return -1; };
+	if (strcmp(b, ZUI_LOCALE_DEFAULT) == 0) { return 1; };
+
+	aHash = zui::driver::localeHash(a);
+	bHash = zui::driver::localeHash(b);
+	if (aHash != bHash) { return (aHash < bHash) ? -1 : 1; };
+	return strcmp(a, b);
+}
+
+static int index_compareMessages(const void *_a, const void *_b)
+{
+	const struct indexMessageS	*a, *b;
+	int				ret;
+
+	a = (const struct indexMessageS *)_a;
+	b = (const struct indexMessageS *)_b;
+	ret = index_compareLocales(a->item->locale, b->item->locale);
+	if (ret != 0) { return ret; };
+
+	if (a->item->index != b->item->index)
+		{ return (a->item->index < b->item->index) ? -1 : 1; };
+
+	if (a->order != b->order) { return (a->order < b->order) ? -1 : 1; };
+	return 0;
+}
+
+/* Sorts the driver's message list by locale, then by index (see
+ * driver::sMessageLocale). The list holds the messages in reverse source
+ * order (see list_insert()); messages with the same index are kept in
+ * source order.
+ **/
+static int index_sortMessages(
+	struct parserContextS *ctxt, uint32_t *nMessages
+	)
+{
+	struct indexMessageS	*sorted;
+	listElementS		*tmp;
+	uint32_t		n, i;
+
+	for (n=0, tmp = ctxt->messageList; tmp != NULL; tmp = tmp->next)
+		{ n++; };
+
+	*nMessages = n;
+	if (n == 0) { return EX_SUCCESS; };
 
-	stringFFullName = makeFullName(
-		stringFFullName, indexPath, "strings.zudi-index");
+	sorted = (struct indexMessageS *)malloc(n * sizeof(*sorted));
+	if (sorted == NULL) { return EX_NOMEM; };
 
-	if (dataFFullName == NULL || stringFFullName == NULL)
+	for (i=0, tmp = ctxt->messageList; tmp != NULL; tmp = tmp->next, i++)
 	{
-		fprintf(stderr, "Failed to makeFullName for data or string index.\n");
-		return EX_NOMEM;
+		sorted[i].item = (struct zui::driver::_sMessage *)tmp->item;
+		sorted[i].order = n - 1 - i;
 	};
 
-	dataF = fopen(dataFFullName, "a");
-	stringF = fopen(stringFFullName, "a");
-	if (dataF == NULL || stringF == NULL)
+	qsort(sorted, n, sizeof(*sorted), &index_compareMessages);
+	for (i=0, tmp = ctxt->messageList; tmp != NULL; tmp = tmp->next, i++)
+		{ tmp->item = sorted[i].item; };
+
+	free(sorted);
+	return EX_SUCCESS;
+}
+
+/* Appends the message table (see driver::sMessageTable) of the "nMessages"
+ * sorted messages of one locale, starting at "list", to "tables". Appends
+ * nothing if their indexes are too sparse for a table.
+ **/
+static int index_buildMessageTable(
+	listElementS *list, uint32_t nMessages, struct sectionS *tables
+	)
+{
+	struct zui::driver::sMessageTable	t;
+	struct zui::driver::_sMessage		*first, *last;
+	listElementS				*tmp;
+	uint16_t				*slots;
+	uint32_t				nSlots, i, zero=0;
+	int					ret=EX_SUCCESS;
+
+	first = (struct zui::driver::_sMessage *)list->item;
+	for (i=1, tmp = list; i<nMessages; i++) { tmp = tmp->next; };
+	last = (struct zui::driver::_sMessage *)tmp->item;
+
+	nSlots = last->index - first->index + 1;
+	if (nSlots > ZUI_MESSAGE_TABLE_MAX_NSLOTS(nMessages) || nSlots > 0xFFFF)
+		{ return EX_SUCCESS; };
+
+	slots = (uint16_t *)malloc(nSlots * sizeof(*slots));
+	if (slots == NULL) { return EX_NOMEM; };
+
+	for (i=0; i<nSlots; i++) { slots[i] = ZUI_MESSAGE_TABLE_NONE; };
+	for (i=0, tmp = list; i<nMessages; tmp = tmp->next, i++)
 	{
-		fprintf(stderr, "Failed to open data or string index.\n");
-		return EX_FILE_OPEN;
+		uint16_t	*slot;
+
+		slot = &slots[
+			((struct zui::driver::_sMessage *)tmp->item)->index
+				- first->index];
+
+		if (*slot == ZUI_MESSAGE_TABLE_NONE) { *slot = i; };
 	};
 
-	*offset = ftell(dataF);
+	t.firstIndex = first->index;
+	t.nSlots = nSlots;
+	ret = serial_append(tables, &t, NULL);
+	for (i=0; i<nSlots && ret == EX_SUCCESS; i++)
+		{ ret = serial_append(tables, &slots[i], NULL); };
 
-	for (tmp = list; tmp != NULL; tmp = tmp->next)
+	if (ret == EX_SUCCESS)
 	{
-		T		*item;
+		ret = section_append(
+			tables, &zero, (4 - tables->len % 4) % 4, NULL);
+	};
 
-		item = (T *)tmp->item;
-		err = item->writeOut(dataF, stringF);
-		if (err != EX_SUCCESS)
+	free(slots);
+	return ret;
+}
+
+/* Builds the locale directory of the sorted message list, followed by the
+ * message tables of its locales, into "out", which is to be written at
+ * "base" in the data section.
+ **/
+static int index_buildMessageLocales(
+	struct parserContextS *ctxt, uint32_t base, struct sectionS *out
+	)
+{
+	struct sectionS				*stringS=&indexSections[IDXF_STRINGS];
+	struct zui::driver::sMessageLocaleDir	dir;
+	struct zui::driver::sMessageLocale	*locales;
+	struct zui::driver::_sMessage		*item;
+	struct sectionS				tables;
+	listElementS				*tmp, *run;
+	const char				*prevLocale=NULL;
+	uint32_t				nLocales=0, tablesOff, i, pos;
+	int					ret=EX_SUCCESS;
+
+	for (tmp = ctxt->messageList; tmp != NULL; tmp = tmp->next)
+	{
+		item = (struct zui::driver::_sMessage *)tmp->item;
+		if (prevLocale == NULL || strcmp(item->locale, prevLocale))
+			{ nLocales++; };
+
+		prevLocale = item->locale;
+	};
+
+	locales = (struct zui::driver::sMessageLocale *)calloc(
+		nLocales, sizeof(*locales));
+
+	if (locales == NULL) { return EX_NOMEM; };
+
+	memset(&tables, 0, sizeof(tables));
+	tablesOff = base + sizeof(dir) + nLocales * sizeof(*locales);
+	tmp = ctxt->messageList;
+	for (i=0, pos=0; i<nLocales && ret == EX_SUCCESS; i++)
+	{
+		run = tmp;
+		item = (struct zui::driver::_sMessage *)run->item;
+		locales[i].firstMessage = pos;
+		for (; tmp != NULL && !strcmp(
+			item->locale,
+			((struct zui::driver::_sMessage *)tmp->item)->locale);
+			tmp = tmp->next)
 		{
-			fprintf(stderr, "Failed to write out object from %s list.\n",
-				listName);
+			locales[i].nMessages++;
+		};
+
+		pos += locales[i].nMessages;
+		locales[i].nameHash = zui::driver::localeHash(item->locale);
+		locales[i].tableOffset = tablesOff + tables.len;
+		ret = strtab_internString(
+			stringS, item->locale, &locales[i].nameOff);
 
-			break;
+		if (ret == EX_SUCCESS)
+		{
+			ret = index_buildMessageTable(
+				run, locales[i].nMessages, &tables);
 		};
+
+		// Too sparse for a table.
+		if (tablesOff + tables.len == locales[i].tableOffset)
+			{ locales[i].tableOffset = 0; };
 	};
 
-	fclose(dataF);
-	fclose(stringF);
+	memset(&dir, 0, sizeof(dir));
+	dir.nLocales = nLocales;
+	if (ret == EX_SUCCESS) { ret = serial_append(out, &dir, NULL); };
+	for (i=0; i<nLocales && ret == EX_SUCCESS; i++)
+		{ ret = serial_append(out, &locales[i], NULL); };
+
+	if (ret == EX_SUCCESS && tables.len > 0)
+		{ ret = section_append(out, tables.buff, tables.len, NULL); };
+
+	free(locales);
+	free(tables.buff);
+	return ret;
+}
+
+/* Packs the text of the finished block into "blocks", compressed if that
+ * makes it any smaller, and empties the block.
+ **/
+static int index_flushMessageBlock(
+	struct sectionS *block, struct sectionS *blocks
+	)
+{
+	struct zui::driver::sMessageBlock	h;
+	uint8_t					packed[ZUI_MESSAGE_BLOCK_MAXLEN];
+	uint32_t				packedLen, zero=0;
+	const uint8_t				*payload=block->buff;
+
+	if (block->len == 0) { return EX_SUCCESS; };
+
+	h.length = block->len;
+	h.compressedLength = 0;
+	if (lz_compress(
+		block->buff, block->len, packed, block->len - 1, &packedLen)
+		== EX_SUCCESS)
+	{
+		h.compressedLength = packedLen;
+		payload = packed;
+	};
+
+	packedLen = (h.compressedLength != 0) ? h.compressedLength : h.length;
+	if (serial_append(blocks, &h, NULL) != EX_SUCCESS
+		|| section_append(blocks, payload, packedLen, NULL)
+			!= EX_SUCCESS
+		|| section_append(
+			blocks, &zero, (4 - packedLen % 4) % 4, NULL)
+			!= EX_SUCCESS)
+	{
+		return EX_NOMEM;
+	};
+
+	block->len = 0;
 	return EX_SUCCESS;
 }
 
-int index_writeToDisk(void)
+/* Writes out the driver's message records, followed by its locale
+ * directory and message tables, and the blocks that hold their text (see
+ * driver::sMessageBlock).
+ **/
+static int index_writeCompressedMessages(
+	struct parserContextS *ctxt, const struct sectionS *locales,
+	uint32_t *offset
+	)
+{
+	struct sectionS			*dataS=&indexSections[IDXF_DATA];
+	struct sectionS			records, block, blocks;
+	struct zui::driver::sMessage	rec, *recs;
+	struct zui::driver::_sMessage	*item;
+	listElementS			*tmp;
+	uint32_t			len, recordsEnd, i;
+	int				ret=EX_SUCCESS;
+
+	memset(&records, 0, sizeof(records));
+	memset(&block, 0, sizeof(block));
+	memset(&blocks, 0, sizeof(blocks));
+
+	/* The records refer to the blocks by offset, so the blocks are
+	 * packed first, and the records are fixed up to point past them.
+	 **/
+	for (tmp = ctxt->messageList; tmp != NULL && ret == EX_SUCCESS;
+		tmp = tmp->next)
+	{
+		item = (struct zui::driver::_sMessage *)tmp->item;
+		len = strlen(item->message) + 1;
+		if (block.len + len > ZUI_MESSAGE_BLOCK_MAXLEN)
+			{ ret = index_flushMessageBlock(&block, &blocks); };
+
+		memset(&rec, 0, sizeof(rec));
+		rec.driverId = item->driverId;
+		rec.index = item->index;
+		rec.messageOff = blocks.len;
+		rec.textOff = block.len;
+		if (ret == EX_SUCCESS)
+		{
+			ret = section_append(
+				&records, &rec, sizeof(rec), NULL);
+		};
+
+		if (ret == EX_SUCCESS)
+		{
+			ret = section_append(
+				&block, item->message, len, NULL);
+		};
+	};
+
+	if (ret == EX_SUCCESS)
+		{ ret = index_flushMessageBlock(&block, &blocks); };
+
+	*offset = section_tell(dataS);
+	recordsEnd = *offset + records.len + locales->len;
+	recs = (struct zui::driver::sMessage *)records.buff;
+	for (i=0; ret == EX_SUCCESS && i<records.len / sizeof(*recs); i++)
+	{
+		recs[i].messageOff += recordsEnd;
+		ret = serial_append(dataS, &recs[i], NULL);
+	};
+
+	if (ret == EX_SUCCESS && locales->len > 0)
+	{
+		ret = section_append(
+			dataS, locales->buff, locales->len, NULL);
+	};
+
+	if (ret == EX_SUCCESS && blocks.len > 0)
+		{ ret = section_append(dataS, blocks.buff, blocks.len, NULL); };
+
+	free(records.buff);
+	free(block.buff);
+	free(blocks.buff);
+	if (ret != EX_SUCCESS)
+	{
+		fprintf(stderr,
+			"Failed to write out compressed messages.\n");
+	};
+
+	return ret;
+}
+
+static int index_writeMessages(
+	struct parserContextS *ctxt, uint32_t *offset
+	)
+{
+	struct sectionS	*dataS=&indexSections[IDXF_DATA];
+	struct sectionS	locales;
+	uint32_t	nMessages, localesOff;
+	void		*dummy;
+	int		ret;
+
+	memset(&locales, 0, sizeof(locales));
+	ret = index_sortMessages(ctxt, &nMessages);
+	if (ret != EX_SUCCESS) { return ret; };
+
+	if (nMessages >= ZUI_MESSAGE_TABLE_NONE)
+	{
+		fprintf(stderr, "Error: Driver has more than %u messages.\n",
+			ZUI_MESSAGE_TABLE_NONE - 1);
+
+		return EX_GENERAL;
+	};
+
+	localesOff = section_tell(dataS)
+		+ nMessages * sizeof(struct zui::driver::sMessage);
+
+	if (nMessages > 0
+		&& (ret = index_buildMessageLocales(ctxt, localesOff, &locales))
+			!= EX_SUCCESS)
+	{
+		fprintf(stderr, "Failed to build the message locales.\n");
+		free(locales.buff);
+		return ret;
+	};
+
+	if (compressMessages)
+		{ ret = index_writeCompressedMessages(ctxt, &locales, offset); }
+	else
+	{
+		ret = index_writeListToDisk(
+			ctxt->messageList,
+			(struct zui::driver::_sMessage *)dummy,
+			"message", offset);
+
+		if (ret == EX_SUCCESS && locales.len > 0
+			&& section_append(
+				dataS, locales.buff, locales.len, NULL)
+				!= EX_SUCCESS)
+		{
+			ret = EX_NOMEM;
+		};
+	};
+
+	ctxt->driver->h.messageLocalesOffset =
+		(nMessages > 0) ? localesOff : 0;
+
+	free(locales.buff);
+	return ret;
+}
+
+int index_writeToDisk(struct parserContextS *ctxt)
 {
+	struct sectionS	*dataS=&indexSections[IDXF_DATA],
+			*stringS=&indexSections[IDXF_STRINGS];
 	int		ret;
 	uint32_t	driverDataFileOffset, rankFileOffset, deviceFileOffset,
-			provisionFileOffset, offsetTmp;
+			provisionFileOffset, offsetTmp,
+			stringFileOffset=section_tell(stringS);
 	void		*dummy;
 
 	/* 1. Read the index header and get the endianness of the index.
@@ -519,77 +992,109 @@ int index_writeToDisk(void)
 	 * 6. Write the device data to the idnex in append mode.
 	 * 7. FOR EACH index: write its data out.
 	 **/
-	if ((ret = index_writeDriverData(&driverDataFileOffset)) != EX_SUCCESS)
-		{ return ret; };
+	strtab_setFloor((contiguousLayout) ? stringFileOffset : 0);
 
-	if ((ret = index_writeRanks(&rankFileOffset)) != EX_SUCCESS)
-		{ return ret; };
+	ret = index_writeDriverData(ctxt, &driverDataFileOffset);
+	if (ret != EX_SUCCESS) { return ret; };
 
-	if ((ret = index_writeDevices(&deviceFileOffset)) != EX_SUCCESS)
+	if ((ret = index_writeRanks(ctxt, &rankFileOffset)) != EX_SUCCESS)
 		{ return ret; };
 
-	if ((ret = index_writeProvisions(&provisionFileOffset)) != EX_SUCCESS)
+	if ((ret = index_writeDevices(ctxt, &deviceFileOffset)) != EX_SUCCESS)
 		{ return ret; };
 
-	parser_getCurrentDriverState()->h.dataFileOffset = driverDataFileOffset;
-	parser_getCurrentDriverState()->h.rankFileOffset = rankFileOffset;
-	parser_getCurrentDriverState()->h.deviceFileOffset = deviceFileOffset;
-	parser_getCurrentDriverState()->h.provisionFileOffset =
+	ret = index_writeProvisions(ctxt, &provisionFileOffset);
+	if (ret != EX_SUCCESS) { return ret; };
+
+	ctxt->driver->h.dataFileOffset = driverDataFileOffset;
+	ctxt->driver->h.rankFileOffset = rankFileOffset;
+	ctxt->driver->h.deviceFileOffset = deviceFileOffset;
+	ctxt->driver->h.provisionFileOffset =
 		provisionFileOffset;
 
 	if ((ret = index_writeListToDisk(
-		regionList, (struct zui::driver::sRegion *)dummy,
+		ctxt->regionList, (struct zui::driver::sRegion *)dummy,
 		"regions", &offsetTmp)) != EX_SUCCESS)
 		{ return ret; };
 
-	parser_getCurrentDriverState()->h.regionsOffset = offsetTmp;
+	ctxt->driver->h.regionsOffset = offsetTmp;
 
-	if ((ret = index_writeListToDisk(
-		messageList, (struct zui::driver::_sMessage *)dummy,
-		"message", &offsetTmp)) != EX_SUCCESS)
+	if ((ret = index_writeMessages(ctxt, &offsetTmp)) != EX_SUCCESS)
 		{ return ret; };
 
-	parser_getCurrentDriverState()->h.messagesOffset = offsetTmp;
+	ctxt->driver->h.messagesOffset = offsetTmp;
 
 	if ((ret = index_writeListToDisk(
-		disasterMessageList, (struct zui::driver::_sDisasterMessage *)dummy,
+		ctxt->disasterMessageList,
+		(struct zui::driver::_sDisasterMessage *)dummy,
 		"disaster-message", &offsetTmp)) != EX_SUCCESS)
 		{ return ret; };
 
-	parser_getCurrentDriverState()->h.disasterMessagesOffset = offsetTmp;
+	ctxt->driver->h.disasterMessagesOffset = offsetTmp;
 
 	if ((ret = index_writeListToDisk(
-		messageFileList, (struct zui::driver::_sMessageFile *)dummy,
+		ctxt->messageFileList,
+		(struct zui::driver::_sMessageFile *)dummy,
 		"message-file", &offsetTmp)) != EX_SUCCESS)
 		{ return ret; };
 
-	parser_getCurrentDriverState()->h.messageFilesOffset = offsetTmp;
+	ctxt->driver->h.messageFilesOffset = offsetTmp;
 
 	if ((ret = index_writeListToDisk(
-		readableFileList, (struct zui::driver::_sReadableFile *)dummy,
+		ctxt->readableFileList,
+		(struct zui::driver::_sReadableFile *)dummy,
 		"readable-file", &offsetTmp)) != EX_SUCCESS)
 		{ return ret; };
 
-	parser_getCurrentDriverState()->h.readableFilesOffset = offsetTmp;
+	ctxt->driver->h.readableFilesOffset = offsetTmp;
 
-	if ((ret = index_writeDriverHeader()) != EX_SUCCESS) { return ret; };
+	if (ctxt->sourcePath != NULL
+		&& (ret = strtab_internString(
+			&indexSections[IDXF_STRINGS], ctxt->sourcePath,
+			&ctxt->driver->h.sourcePathOff)) != EX_SUCCESS)
+		{ return ret; };
+
+	// Everything the driver owns has been written out now.
+	ctxt->driver->h.dataFileLength =
+		section_tell(dataS) - driverDataFileOffset;
+
+	ctxt->driver->h.stringFileOffset = stringFileOffset;
+	ctxt->driver->h.stringFileLength =
+		section_tell(stringS) - stringFileOffset;
+
+	ctxt->driver->h.flags &= ~(ZUI_DRIVER_FLAGS_CONTIGUOUS
+		| ZUI_DRIVER_FLAGS_COMPRESSED_MESSAGES);
+
+	if (contiguousLayout)
+		{ ctxt->driver->h.flags |= ZUI_DRIVER_FLAGS_CONTIGUOUS; };
+
+	if (compressMessages)
+	{
+		ctxt->driver->h.flags |=
+			ZUI_DRIVER_FLAGS_COMPRESSED_MESSAGES;
+	};
+
+	if ((ret = index_writeDriverHeader(ctxt)) != EX_SUCCESS)
+		{ return ret; };
 
 	return EX_SUCCESS;
 }
 
-int zui::device::_sDevice::writeOut(FILE *headerF, FILE *dataF, FILE *stringF)
+int zui::device::_sDevice::writeOut(
+	struct sectionS *headerS, struct sectionS *dataS, struct sectionS *stringS
+	)
 {
 	int		ret;
 
-	h.dataOff = ftell(dataF);
+	h.dataOff = section_tell(dataS);
 
 	for (int i=0; i<h.nAttributes; i++)
 	{
-		ret = d[i].writeOut(dataF, stringF);
+		ret = d[i].writeOut(dataS, stringS);
 		if (ret != EX_SUCCESS) { return ret; };
 	};
 
-	if (fwrite(&h, sizeof(h), 1, headerF) < 1)
+	if (serial_append(headerS, &h, NULL) != EX_SUCCESS)
 	{
 		fprintf(stderr, "Failed to write out device header.\n");
 		return EX_FILE_IO;
@@ -598,42 +1103,40 @@ int zui::device::_sDevice::writeOut(FILE *headerF, FILE *dataF, FILE *stringF)
 	return EX_SUCCESS;
 }
 
-int zui::device::_sAttrData::writeOut(FILE *outfile, FILE *stringfile)
+int zui::device::_sAttrData::writeOut(
+	struct sectionS *dataS, struct sectionS *stringS
+	)
 {
 	zui::device::sAttrData		tmp;
 
+	memset(&tmp, 0, sizeof(tmp));
 	tmp.attr_type = attr_type;
 	tmp.attr_length = attr_length;
 
-	tmp.attr_nameOff = ftell(stringfile);
-	if (fwrite(attr_name, strlen(attr_name) + 1, 1, stringfile) < 1)
+	if (attrname_intern(stringS, attr_name, &tmp.attr_nameId)
+		!= EX_SUCCESS)
 	{
-		fprintf(stderr, "Failed to write string to stringfile.\n");
+		fprintf(stderr, "Failed to enter attribute name into the "
+			"dictionary.\n");
+
 		return EX_FILE_IO;
 	};
 
-	int	writeLen=0, err;
+	int	writeLen=0;
 
 	switch (attr_type)
 	{
 	case UDI_ATTR_STRING:
 	case UDI_ATTR_ARRAY8:
-		if (attr_type == UDI_ATTR_STRING)
-		{
+		if (attr_type == UDI_ATTR_STRING) {
 			writeLen = strlen((const char *)attr_value) + 1;
-			tmp.attr_valueOff = ftell(stringfile);
-		}
-		else
-		{
+		} else {
 			writeLen = attr_length;
-			tmp.attr_valueOff = ftell(stringfile);
 		};
 
-		err = fwrite(
-			attr_value, sizeof(*attr_value), writeLen,
-			stringfile);
-
-		if (err < writeLen)
+		if (strtab_intern(
+			stringS, attr_value, writeLen, &tmp.attr_valueOff)
+			!= EX_SUCCESS)
 		{
 			fprintf(stderr, "Failed to write out array8 attrib to "
 				"string index.\n");
@@ -643,18 +1146,19 @@ int zui::device::_sAttrData::writeOut(FILE *outfile, FILE *stringfile)
 
 		break;
 
+	/* Scalar values are kept in the value field itself, as a number in
+	 * index byte order, so the kernel can use them in place.
+	 **/
 	case UDI_ATTR_BOOLEAN:
-		*(uint8_t *)(&tmp.attr_valueOff) = attr_value[0];
+		tmp.attr_valueOff = attr_value[0];
 		break;
 
 	case UDI_ATTR_UBIT32:
-		UDI_ATTR32_SET(
-			(uint8_t *)&tmp.attr_valueOff,
-			UDI_ATTR32_GET(attr_value));
+		tmp.attr_valueOff = UDI_ATTR32_GET(attr_value);
 		break;
 	};
 
-	if (fwrite(&tmp, sizeof(tmp), 1, outfile) < 1)
+	if (serial_append(dataS, &tmp, NULL) != EX_SUCCESS)
 	{
 		fprintf(stderr, "Failed to write out device attrib.\n");
 		return EX_FILE_IO;
@@ -663,20 +1167,21 @@ int zui::device::_sAttrData::writeOut(FILE *outfile, FILE *stringfile)
 	return EX_SUCCESS;
 }
 
-int zui::driver::_sRequirement::writeOut(FILE *dataF, FILE *stringF)
+int zui::driver::_sRequirement::writeOut(
+	struct sectionS *dataS, struct sectionS *stringS
+	)
 {
 	zui::driver::sRequirement	tmp;
 
+	memset(&tmp, 0, sizeof(tmp));
 	tmp.version = version;
-	tmp.nameOff = ftell(stringF);
-
-	if (fwrite(name, strlen(name) + 1, 1, stringF) < 1)
+	if (strtab_internString(stringS, name, &tmp.nameOff) != EX_SUCCESS)
 	{
 		fprintf(stderr, "Failed to write out requirement name string.\n");
 		return EX_FILE_IO;
 	};
 
-	if (fwrite(&tmp, sizeof(tmp), 1, dataF) < 1)
+	if (serial_append(dataS, &tmp, NULL) != EX_SUCCESS)
 	{
 		fprintf(stderr, "Failed to write out requirement.\n");
 		return EX_FILE_IO;
@@ -685,21 +1190,21 @@ int zui::driver::_sRequirement::writeOut(FILE *dataF, FILE *stringF)
 	return EX_SUCCESS;
 }
 
-int zui::driver::_sMetalanguage::writeOut(FILE *dataF, FILE *stringF)
+int zui::driver::_sMetalanguage::writeOut(
+	struct sectionS *dataS, struct sectionS *stringS
+	)
 {
 	zui::driver::sMetalanguage	tmp;
 
+	memset(&tmp, 0, sizeof(tmp));
 	tmp.index = index;
-	fflush(stringF);
-	tmp.nameOff = ftell(stringF);
-
-	if (fwrite(name, strlen(name) + 1, 1, stringF) < 1)
+	if (strtab_internString(stringS, name, &tmp.nameOff) != EX_SUCCESS)
 	{
 		fprintf(stderr, "Failed to write out metalanguage name string.\n");
 		return EX_FILE_IO;
 	};
 
-	if (fwrite(&tmp, sizeof(tmp), 1, dataF) < 1)
+	if (serial_append(dataS, &tmp, NULL) != EX_SUCCESS)
 	{
 		fprintf(stderr, "Failed to write out requirement.\n");
 		return EX_FILE_IO;
@@ -708,20 +1213,21 @@ int zui::driver::_sMetalanguage::writeOut(FILE *dataF, FILE *stringF)
 	return EX_SUCCESS;
 }
 
-int zui::driver::_sModule::writeOut(FILE *dataF, FILE *stringF)
+int zui::driver::_sModule::writeOut(
+	struct sectionS *dataS, struct sectionS *stringS
+	)
 {
 	zui::driver::sModule	tmp;
 
+	memset(&tmp, 0, sizeof(tmp));
 	tmp.index = index;
-	tmp.fileNameOff = ftell(stringF);
-
-	if (fwrite(fileName, strlen(fileName) + 1, 1, stringF) < 1)
+	if (strtab_internString(stringS, fileName, &tmp.fileNameOff) != EX_SUCCESS)
 	{
 		fprintf(stderr, "Failed to write out module name string.\n");
 		return EX_FILE_IO;
 	};
 
-	if (fwrite(&tmp, sizeof(tmp), 1, dataF) < 1)
+	if (serial_append(dataS, &tmp, NULL) != EX_SUCCESS)
 	{
 		fprintf(stderr, "Failed to write out module.\n");
 		return EX_FILE_IO;
@@ -730,21 +1236,22 @@ int zui::driver::_sModule::writeOut(FILE *dataF, FILE *stringF)
 	return EX_SUCCESS;
 }
 
-int zui::driver::_sMessage::writeOut(FILE *dataF, FILE *stringF)
+int zui::driver::_sMessage::writeOut(
+	struct sectionS *dataS, struct sectionS *stringS
+	)
 {
 	zui::driver::sMessage	tmp;
 
+	memset(&tmp, 0, sizeof(tmp));
 	tmp.driverId = driverId;
 	tmp.index = index;
-	tmp.messageOff = ftell(stringF);
-
-	if (fwrite(message, strlen(message) + 1, 1, stringF) < 1)
+	if (strtab_internString(stringS, message, &tmp.messageOff) != EX_SUCCESS)
 	{
 		fprintf(stderr, "Failed to write out message string.\n");
 		return EX_FILE_IO;
 	};
 
-	if (fwrite(&tmp, sizeof(tmp), 1, dataF) < 1)
+	if (serial_append(dataS, &tmp, NULL) != EX_SUCCESS)
 	{
 		fprintf(stderr, "Failed to write out message.\n");
 		return EX_FILE_IO;
@@ -753,21 +1260,22 @@ int zui::driver::_sMessage::writeOut(FILE *dataF, FILE *stringF)
 	return EX_SUCCESS;
 }
 
-int zui::driver::_sMessageFile::writeOut(FILE *dataF, FILE *stringF)
+int zui::driver::_sMessageFile::writeOut(
+	struct sectionS *dataS, struct sectionS *stringS
+	)
 {
 	zui::driver::sMessageFile	tmp;
 
+	memset(&tmp, 0, sizeof(tmp));
 	tmp.driverId = driverId;
 	tmp.index = index;
-	tmp.fileNameOff = ftell(stringF);
-
-	if (fwrite(fileName, strlen(fileName) + 1, 1, stringF) < 1)
+	if (strtab_internString(stringS, fileName, &tmp.fileNameOff) != EX_SUCCESS)
 	{
 		fprintf(stderr, "Failed to write out message file name string.\n");
 		return EX_FILE_IO;
 	};
 
-	if (fwrite(&tmp, sizeof(tmp), 1, dataF) < 1)
+	if (serial_append(dataS, &tmp, NULL) != EX_SUCCESS)
 	{
 		fprintf(stderr, "Failed to write out message file.\n");
 		return EX_FILE_IO;
@@ -776,21 +1284,22 @@ int zui::driver::_sMessageFile::writeOut(FILE *dataF, FILE *stringF)
 	return EX_SUCCESS;
 }
 
-int zui::driver::_sDisasterMessage::writeOut(FILE *dataF, FILE *stringF)
+int zui::driver::_sDisasterMessage::writeOut(
+	struct sectionS *dataS, struct sectionS *stringS
+	)
 {
 	zui::driver::sDisasterMessage	tmp;
 
+	memset(&tmp, 0, sizeof(tmp));
 	tmp.driverId = driverId;
 	tmp.index = index;
-	tmp.messageOff = ftell(stringF);
-
-	if (fwrite(message, strlen(message) + 1, 1, stringF) < 1)
+	if (strtab_internString(stringS, message, &tmp.messageOff) != EX_SUCCESS)
 	{
 		fprintf(stderr, "Failed to write out disaster message string.\n");
 		return EX_FILE_IO;
 	};
 
-	if (fwrite(&tmp, sizeof(tmp), 1, dataF) < 1)
+	if (serial_append(dataS, &tmp, NULL) != EX_SUCCESS)
 	{
 		fprintf(stderr, "Failed to write out disaster message.\n");
 		return EX_FILE_IO;
@@ -799,21 +1308,22 @@ int zui::driver::_sDisasterMessage::writeOut(FILE *dataF, FILE *stringF)
 	return EX_SUCCESS;
 }
 
-int zui::driver::_sReadableFile::writeOut(FILE *dataF, FILE *stringF)
+int zui::driver::_sReadableFile::writeOut(
+	struct sectionS *dataS, struct sectionS *stringS
+	)
 {
 	zui::driver::sReadableFile	tmp;
 
+	memset(&tmp, 0, sizeof(tmp));
 	tmp.driverId = driverId;
 	tmp.index = index;
-	tmp.fileNameOff = ftell(stringF);
-
-	if (fwrite(fileName, strlen(fileName) + 1, 1, stringF) < 1)
+	if (strtab_internString(stringS, fileName, &tmp.fileNameOff) != EX_SUCCESS)
 	{
 		fprintf(stderr, "Failed to write out readable file name string.\n");
 		return EX_FILE_IO;
 	};
 
-	if (fwrite(&tmp, sizeof(tmp), 1, dataF) < 1)
+	if (serial_append(dataS, &tmp, NULL) != EX_SUCCESS)
 	{
 		fprintf(stderr, "Failed to write out readable file.\n");
 		return EX_FILE_IO;
@@ -822,21 +1332,22 @@ int zui::driver::_sReadableFile::writeOut(FILE *dataF, FILE *stringF)
 	return EX_SUCCESS;
 }
 
-int zui::driver::_sProvision::writeOut(FILE *provF, FILE *stringF)
+int zui::driver::_sProvision::writeOut(
+	struct sectionS *provS, struct sectionS *stringS
+	)
 {
 	zui::driver::sProvision	tmp;
 
+	memset(&tmp, 0, sizeof(tmp));
 	tmp.driverId = driverId;
 	tmp.version = version;
-	tmp.nameOff = ftell(stringF);
-
-	if (fwrite(name, strlen(name) + 1, 1, stringF) < 1)
+	if (strtab_internString(stringS, name, &tmp.nameOff) != EX_SUCCESS)
 	{
 		fprintf(stderr, "Failed to write out provision string.\n");
 		return EX_FILE_IO;
 	};
 
-	if (fwrite(&tmp, sizeof(tmp), 1, provF) < 1)
+	if (serial_append(provS, &tmp, NULL) != EX_SUCCESS)
 	{
 		fprintf(stderr, "Failed to write out provision.\n");
 		return EX_FILE_IO;
@@ -845,10 +1356,12 @@ int zui::driver::_sProvision::writeOut(FILE *provF, FILE *stringF)
 	return EX_SUCCESS;
 }
 
-int zui::driver::sRegion::writeOut(FILE *dataF, FILE *stringF)
+int zui::driver::sRegion::writeOut(
+	struct sectionS *dataS, struct sectionS *stringS
+	)
 {
-	(void)stringF;
-	if (fwrite(this, sizeof(*this), 1, dataF) < 1)
+	(void)stringS;
+	if (serial_append(dataS, this, NULL) != EX_SUCCESS)
 	{
 		fprintf(stderr, "Failed to write out region.\n");
 		return EX_FILE_IO;
@@ -857,19 +1370,21 @@ int zui::driver::sRegion::writeOut(FILE *dataF, FILE *stringF)
 	return EX_SUCCESS;
 }
 
-int zui::rank::_sRank::writeOut(FILE *rankF, FILE *dataF, FILE *stringF)
+int zui::rank::_sRank::writeOut(
+	struct sectionS *rankS, struct sectionS *dataS, struct sectionS *stringS
+	)
 {
 	int		err;
 
-	h.dataOff = ftell(dataF);
+	h.dataOff = section_tell(dataS);
 
 	for (int i=0; i<h.nAttributes; i++)
 	{
-		err = d[i].writeOut(dataF, stringF);
+		err = d[i].writeOut(dataS, stringS);
 		if (err != EX_SUCCESS) { return err; };
 	};
 
-	if (fwrite(&h, sizeof(h), 1, rankF) < 1)
+	if (serial_append(rankS, &h, NULL) != EX_SUCCESS)
 	{
 		fprintf(stderr, "Failed to write rank header.\n");
 		return EX_FILE_IO;
@@ -878,19 +1393,22 @@ int zui::rank::_sRank::writeOut(FILE *rankF, FILE *dataF, FILE *stringF)
 	return EX_SUCCESS;
 }
 
-int zui::rank::_sRankAttr::writeOut(FILE *dataF, FILE *stringF)
+int zui::rank::_sRankAttr::writeOut(
+	struct sectionS *dataS, struct sectionS *stringS
+	)
 {
 	zui::rank::sRankAttr	tmp;
 
-	tmp.nameOff = ftell(stringF);
-
-	if (fwrite(name, strlen(name) + 1, 1, stringF) < 1)
+	memset(&tmp, 0, sizeof(tmp));
+	if (attrname_intern(stringS, name, &tmp.nameId) != EX_SUCCESS)
 	{
-		fprintf(stderr, "Failed to write rank attribute name string.\n");
+		fprintf(stderr, "Failed to enter rank attribute name into the "
+			"dictionary.\n");
+
 		return EX_FILE_IO;
 	};
 
-	if (fwrite(&tmp, sizeof(tmp), 1, dataF) < 1)
+	if (serial_append(dataS, &tmp, NULL) != EX_SUCCESS)
 	{
 		fprintf(stderr, "Failed to write rank attribute.\n");
 		return EX_FILE_IO;
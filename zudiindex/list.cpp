@@ -0,0 +1,482 @@
+#include "zudipropsc.h"
+#include <string.h>
+#include <strings.h>
+
+
+/**	EXPLANATION:
+ * List mode ("-l <shortname|driver-id|*>").
+ *
+ * Walks the mapped index (see image.cpp) from each driver header out to the
+ * driver's metalanguages, provisions, ranks and devices, and prints every
+ * driver that matches the selector and all of the filters. Nothing is read
+ * into memory first, so even a very large index is listed about as fast as
+ * it can be printed.
+ *
+ * The output is one line per record, with its fields separated by tabs, so
+ * that it can be read by eye as well as fed to cut, awk and friends:
+ *
+ *	<driver|metalanguage> <id> <shortname> <base-path> <source-path>
+ *		meta <index> <name>
+ *		provides <name> <version>
+ *		rank <rank> <attr-name>...
+ *		device <index> <msg-index> <meta-index> <name>=<value>...
+ *		loads <driver-id>... [missing-provider] [cycle]
+ *
+ * Attribute values are printed as they would be written in a udiprops file.
+ * The "loads" line is the driver's requirement closure (see zui.h): the
+ * drivers to load, in order, to bring it up.
+ * With "--attr", only the devices that have the attribute are printed.
+ * Drivers which have been removed from the index are skipped, as are those
+ * whose match filters (see zui.h) rule out "--uses-meta" or "--attr",
+ * without any of their records being read.
+ **/
+#define LIST_ATTRVALUE_MAXLEN		(UDI_MAX_ATTR_SIZE * 2 + 1)
+
+static struct indexImageS	image;
+
+static int list_formatAttrValue(
+	const struct zui::device::sAttrData *attr, char *buff
+	)
+{
+	const char	*str;
+	uint32_t	size=image.sizes[IDXF_STRINGS];
+
+	switch (attr->attr_type)
+	{
+	case UDI_ATTR_STRING:
+		str = image_getString(&image, attr->attr_valueOff);
+		if (str == NULL || strlen(str) >= LIST_ATTRVALUE_MAXLEN)
+			{ return EX_GENERAL; };
+
+		strcpy(buff, str);
+		return EX_SUCCESS;
+
+	case UDI_ATTR_ARRAY8:
+		if (attr->attr_length > UDI_MAX_ATTR_SIZE
+			|| attr->attr_valueOff > size
+			|| attr->attr_length > size - attr->attr_valueOff)
+		{
+			return EX_GENERAL;
+		};
+
+		buff[0] = '\0';
+		str = (const char *)&image.files[IDXF_STRINGS][
+			attr->attr_valueOff];
+
+		for (int i=0; i<attr->attr_length; i++)
+			{ sprintf(&buff[i * 2], "%02x", (uint8_t)str[i]); };
+
+		return EX_SUCCESS;
+
+	case UDI_ATTR_BOOLEAN:
+		strcpy(buff, (attr->attr_valueOff) ? "T" : "F");
+		return EX_SUCCESS;
+
+	case UDI_ATTR_UBIT32:
+		sprintf(buff, "0x%x", attr->attr_valueOff);
+		return EX_SUCCESS;
+	};
+
+	return EX_GENERAL;
+}
+
+static int list_attrMatches(
+	const struct zui::device::sAttrData *attr, const char *value,
+	const struct listFiltersS *filters
+	)
+{
+	char		*end;
+	unsigned long	number;
+	uint16_t	nameId;
+
+	if (image_findAttrName(&image, filters->attrName, &nameId)
+		!= EX_SUCCESS
+		|| attr->attr_nameId != nameId)
+	{
+		return 0;
+	};
+
+	// Let "0x10" match 16, etc.
+	if (attr->attr_type == UDI_ATTR_UBIT32)
+	{
+		number = strtoul(filters->attrValue, &end, 0);
+		if (filters->attrValue[0] != '\0' && *end == '\0')
+		{
+			return number == attr->attr_valueOff;
+		};
+	};
+
+	if (attr->attr_type == UDI_ATTR_STRING)
+		{ return !strcmp(value, filters->attrValue); };
+
+	return !strcasecmp(value, filters->attrValue);
+}
+
+static int list_deviceMatches(
+	const struct zui::device::sHeader *dev,
+	const struct listFiltersS *filters
+	)
+{
+	struct zui::device::sAttrData	attr;
+	char				value[LIST_ATTRVALUE_MAXLEN];
+
+	if (filters->attrName == NULL) { return 1; };
+
+	for (int i=0; i<dev->nAttributes; i++)
+	{
+		if (image_readRecord(&image, IDXF_DATA, dev->dataOff, i, &attr)
+			!= EX_SUCCESS
+			|| list_formatAttrValue(&attr, value) != EX_SUCCESS)
+		{
+			continue;
+		};
+
+		if (list_attrMatches(&attr, value, filters)) { return 1; };
+	};
+
+	return 0;
+}
+
+static int list_testFilter(
+	const struct zui::driver::sHeader *h, uint32_t hash
+	)
+{
+	return zui::driver::matchFilterTest(h->matchFilter, hash);
+}
+
+/* Tries the "--attr" value as each type of attribute that list_attrMatches()
+ * could match it to.
+ **/
+static int list_attrMayMatch(
+	const struct zui::driver::sHeader *h,
+	const struct listFiltersS *filters
+	)
+{
+	const char	*name=filters->attrName, *value=filters->attrValue;
+	uint8_t		bytes[UDI_MAX_ATTR_SIZE];
+	uint32_t	len=strlen(value);
+	unsigned long	number;
+	char		*end;
+
+	if (list_testFilter(h, zui::driver::matchFilterAttrHash(
+		name, UDI_ATTR_STRING, value, len)))
+	{
+		return 1;
+	};
+
+	number = strtoul(value, &end, 0);
+	if (value[0] != '\0' && *end == '\0' && number <= UINT32_MAX
+		&& list_testFilter(h, zui::driver::matchFilterAttrHashScalar(
+			name, UDI_ATTR_UBIT32, number)))
+	{
+		return 1;
+	};
+
+	if ((!strcasecmp(value, "T") || !strcasecmp(value, "F"))
+		&& list_testFilter(h, zui::driver::matchFilterAttrHashScalar(
+			name, UDI_ATTR_BOOLEAN, !strcasecmp(value, "T"))))
+	{
+		return 1;
+	};
+
+	// ARRAY8 values are given in hex.
+	if (len % 2 != 0 || len / 2 > sizeof(bytes)
+		|| strspn(value, "0123456789abcdefABCDEF") != len)
+	{
+		return 0;
+	};
+
+	for (uint32_t i=0; i<len / 2; i++)
+		{ sscanf(&value[i * 2], "%2hhx", &bytes[i]); };
+
+	return list_testFilter(h, zui::driver::matchFilterAttrHash(
+		name, UDI_ATTR_ARRAY8, bytes, len / 2));
+}
+
+static int list_driverMatches(
+	const struct zui::driver::sHeader *h,
+	const struct listFiltersS *filters
+	)
+{
+	struct zui::driver::sMetalanguage	meta;
+	struct zui::driver::sProvision		prov;
+	struct zui::device::sHeader		dev;
+	const char				*name;
+	int					i, found;
+
+	if (filters->meta != NULL
+		&& !list_testFilter(
+			h, zui::driver::matchFilterMetaHash(filters->meta)))
+	{
+		return 0;
+	};
+
+	if (filters->attrName != NULL && !list_attrMayMatch(h, filters))
+		{ return 0; };
+
+	if (filters->meta != NULL)
+	{
+		for (found=0, i=0; i<h->nMetalanguages && !found; i++)
+		{
+			name = NULL;
+			if (image_readRecord(
+				&image, IDXF_DATA, h->metalanguagesOffset, i,
+				&meta) == EX_SUCCESS)
+			{
+				name = image_getString(&image, meta.nameOff);
+			};
+
+			found = name != NULL && !strcmp(name, filters->meta);
+		};
+
+		if (!found) { return 0; };
+	};
+
+	if (filters->provision != NULL)
+	{
+		for (found=0, i=0; i<h->nProvisions && !found; i++)
+		{
+			name = NULL;
+			if (image_readRecord(
+				&image, IDXF_PROVISIONS, h->provisionFileOffset,
+				i, &prov) == EX_SUCCESS)
+			{
+				name = image_getString(&image, prov.nameOff);
+			};
+
+			found = name != NULL
+				&& !strcmp(name, filters->provision);
+		};
+
+		if (!found) { return 0; };
+	};
+
+	if (filters->attrName != NULL)
+	{
+		for (found=0, i=0; i<h->nDevices && !found; i++)
+		{
+			found = image_readRecord(
+				&image, IDXF_DEVICES, h->deviceFileOffset, i,
+				&dev) == EX_SUCCESS
+				&& list_deviceMatches(&dev, filters);
+		};
+
+		if (!found) { return 0; };
+	};
+
+	return 1;
+}
+
+static int list_printDevice(const struct zui::device::sHeader *dev)
+{
+	struct zui::device::sAttrData	attr;
+	const char			*name;
+	char				value[LIST_ATTRVALUE_MAXLEN];
+
+	printf("\tdevice\t%u\t%u\t%u",
+		dev->index, dev->messageIndex, dev->metaIndex);
+
+	for (int i=0; i<dev->nAttributes; i++)
+	{
+		if (image_readRecord(&image, IDXF_DATA, dev->dataOff, i, &attr)
+			!= EX_SUCCESS
+			|| (name = image_getAttrName(&image, attr.attr_nameId))
+				== NULL
+			|| list_formatAttrValue(&attr, value) != EX_SUCCESS)
+		{
+			return EX_GENERAL;
+		};
+
+		printf("\t%s=%s", name, value);
+	};
+
+	printf("\n");
+	return EX_SUCCESS;
+}
+
+static int list_printClosure(const struct zui::driver::sHeader *h)
+{
+	struct zui::driver::sClosureTable	t;
+	struct zui::driver::sClosure		c;
+	uint32_t				off, idsOff, id, lo, hi, mid;
+
+	if (indexHeader.closureTableLen == 0) { return EX_SUCCESS; };
+
+	off = indexHeader.closureTableOff;
+	if (image_readRecord(&image, IDXF_PROVISIONS, off, 0, &t)
+		!= EX_SUCCESS)
+		{ return EX_GENERAL; };
+
+	off += sizeof(t);
+	for (lo=0, hi=t.nDrivers; lo < hi; )
+	{
+		mid = lo + (hi - lo) / 2;
+		if (image_readRecord(&image, IDXF_PROVISIONS, off, mid, &c)
+			!= EX_SUCCESS)
+			{ return EX_GENERAL; };
+
+		if (c.driverId == h->id) { break; };
+		if (c.driverId < h->id) { lo = mid + 1; }
+		else { hi = mid; };
+	};
+
+	// Every live driver has a closure.
+	if (lo >= hi) { return EX_GENERAL; };
+
+	idsOff = off + t.nDrivers * sizeof(c);
+	printf("\tloads");
+	for (uint32_t i=0; i<c.nIds; i++)
+	{
+		if (image_readRecord(
+			&image, IDXF_PROVISIONS, idsOff, c.idsIndex + i, &id)
+			!= EX_SUCCESS)
+			{ return EX_GENERAL; };
+
+		printf("\t%u", id);
+	};
+
+	if (c.flags & ZUI_CLOSURE_FLAGS_MISSING_PROVIDER)
+		{ printf("\tmissing-provider"); };
+
+	if (c.flags & ZUI_CLOSURE_FLAGS_CYCLE) { printf("\tcycle"); };
+
+	printf("\n");
+	return EX_SUCCESS;
+}
+
+static int list_printDriver(
+	const struct zui::driver::sHeader *h,
+	const struct listFiltersS *filters
+	)
+{
+	struct zui::driver::sMetalanguage	meta;
+	struct zui::driver::sProvision		prov;
+	struct zui::rank::sHeader		rank;
+	struct zui::rank::sRankAttr		rankAttr;
+	struct zui::device::sHeader		dev;
+	const char				*str;
+	int					i, j;
+
+	str = image_getString(&image, h->sourcePathOff);
+	printf("%s\t%u\t%.*s\t%.*s\t%s\n",
+		(h->type == zui::driver::DRIVERTYPE_METALANGUAGE)
+			? "metalanguage" : "driver",
+		h->id,
+		ZUI_DRIVER_SHORTNAME_MAXLEN, h->shortName,
+		ZUI_DRIVER_BASEPATH_MAXLEN, h->basePath,
+		(str != NULL) ? str : "-");
+
+	for (i=0; i<h->nMetalanguages; i++)
+	{
+		if (image_readRecord(
+			&image, IDXF_DATA, h->metalanguagesOffset, i, &meta)
+			!= EX_SUCCESS
+			|| (str = image_getString(&image, meta.nameOff)) == NULL)
+		{
+			return EX_GENERAL;
+		};
+
+		printf("\tmeta\t%u\t%s\n", meta.index, str);
+	};
+
+	for (i=0; i<h->nProvisions; i++)
+	{
+		if (image_readRecord(
+			&image, IDXF_PROVISIONS, h->provisionFileOffset, i,
+			&prov) != EX_SUCCESS
+			|| (str = image_getString(&image, prov.nameOff)) == NULL)
+		{
+			return EX_GENERAL;
+		};
+
+		printf("\tprovides\t%s\t0x%x\n", str, prov.version);
+	};
+
+	for (i=0; i<h->nRanks; i++)
+	{
+		if (image_readRecord(
+			&image, IDXF_RANKS, h->rankFileOffset, i, &rank)
+			!= EX_SUCCESS)
+			{ return EX_GENERAL; };
+
+		printf("\trank\t%u", rank.rank);
+		for (j=0; j<rank.nAttributes; j++)
+		{
+			if (image_readRecord(
+				&image, IDXF_DATA, rank.dataOff, j, &rankAttr)
+				!= EX_SUCCESS
+				|| (str = image_getAttrName(
+					&image, rankAttr.nameId)) == NULL)
+			{
+				return EX_GENERAL;
+			};
+
+			printf("\t%s", str);
+		};
+
+		printf("\n");
+	};
+
+	for (i=0; i<h->nDevices; i++)
+	{
+		if (image_readRecord(
+			&image, IDXF_DEVICES, h->deviceFileOffset, i, &dev)
+			!= EX_SUCCESS)
+			{ return EX_GENERAL; };
+
+		if (!list_deviceMatches(&dev, filters)) { continue; };
+		if (list_printDevice(&dev) != EX_SUCCESS) { return EX_GENERAL; };
+	};
+
+	return list_printClosure(h);
+}
+
+int list_printDrivers(
+	const char *selector, const struct listFiltersS *filters
+	)
+{
+	struct zui::driver::sHeader	h;
+	uint32_t			nDrivers, nListed=0, i;
+	int				ret=EX_SUCCESS;
+
+	ret = (containerFileName != NULL)
+		? image_mapContainer(&image, containerFileName)
+		: image_map(&image);
+
+	if (ret != EX_SUCCESS) { return ret; };
+
+	nDrivers = image_getNDrivers(&image);
+	for (i=0; i<nDrivers; i++)
+	{
+		image_readRecord(
+			&image, IDXF_DRIVERS, sizeof(struct zui::sHeader), i, &h);
+
+		if ((h.flags & ZUI_DRIVER_FLAGS_REMOVED)
+			|| !image_isSelected(&h, selector)
+			|| !list_driverMatches(&h, filters))
+		{
+			continue;
+		};
+
+		if (list_printDriver(&h, filters) != EX_SUCCESS)
+		{
+			fflush(stdout);
+			fprintf(stderr, "Error: Index records of driver %u are "
+				"corrupt.\n", h.id);
+
+			ret = EX_GENERAL;
+			break;
+		};
+
+		nListed++;
+	};
+
+	if (verboseMode)
+	{
+		printf("%u of %u drivers listed.\n",
+			nListed, indexHeader.nRecords);
+	};
+
+	image_unmap(&image);
+	return ret;
+}
@@ -0,0 +1,154 @@
+#include "zudipropsc.h"
+#include <string.h>
+
+
+/**	EXPLANATION:
+ * Encoder for the LZ77 codec of compressed message blocks. The format, and
+ * its decoder, are in zui.h (zui::lz).
+ *
+ * This is a plain greedy parser: at each position, the last earlier
+ * position whose first four bytes hashed the same is tried as a match, and
+ * the match is taken if those bytes really are the same. Blocks are at
+ * most ZUI_MESSAGE_BLOCK_MAXLEN bytes, so every distance fits in 16 bits.
+ * That isn't the best compression possible, but message text is very
+ * repetitive, and the output only has to be decodable one small block at a
+ * time.
+ **/
+#define LZ_HASH_BITS		(12)
+#define LZ_MAX_DISTANCE		(0xFFFF)
+
+static_assert(ZUI_MESSAGE_BLOCK_MAXLEN <= LZ_MAX_DISTANCE,
+	"Every match in a message block must be within reach.");
+
+struct lzOutputS
+{
+	uint8_t		*buff;
+	uint32_t	len, capacity;
+};
+
+static inline uint32_t lz_hash(const uint8_t *p)
+{
+	uint32_t	v;
+
+	memcpy(&v, p, sizeof(v));
+	return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+static int lz_putByte(struct lzOutputS *out, uint8_t b)
+{
+	if (out->len >= out->capacity) { return EX_GENERAL; };
+	out->buff[out->len++] = b;
+	return EX_SUCCESS;
+}
+
+// Appends the bytes of a length beyond what its token nibble holds.
+static int lz_putLength(struct lzOutputS *out, uint32_t len)
+{
+	for (; len >= 255; len -= 255)
+	{
+		if (lz_putByte(out, 255) != EX_SUCCESS) { return EX_GENERAL; };
+	};
+
+	return lz_putByte(out, len);
+}
+
+/* Appends one sequence. A distance of 0 makes it the last one, with no
+ * match.
+ **/
+static int lz_putSequence(
+	struct lzOutputS *out, const uint8_t *literals, uint32_t nLiterals,
+	uint32_t distance, uint32_t matchLen
+	)
+{
+	uint32_t	litNibble, matchNibble=0;
+
+	litNibble = (nLiterals < 15) ? nLiterals : 15;
+	if (distance != 0)
+	{
+		matchLen -= ZUI_LZ_MIN_MATCH;
+		matchNibble = (matchLen < 15) ? matchLen : 15;
+	};
+
+	if (lz_putByte(out, (litNibble << 4) | matchNibble) != EX_SUCCESS
+		|| (litNibble == 15
+			&& lz_putLength(out, nLiterals - 15) != EX_SUCCESS)
+		|| nLiterals > out->capacity - out->len)
+	{
+		return EX_GENERAL;
+	};
+
+	memcpy(&out->buff[out->len], literals, nLiterals);
+	out->len += nLiterals;
+	if (distance == 0) { return EX_SUCCESS; };
+
+	if (lz_putByte(out, distance & 0xFF) != EX_SUCCESS
+		|| lz_putByte(out, distance >> 8) != EX_SUCCESS
+		|| (matchNibble == 15
+			&& lz_putLength(out, matchLen - 15) != EX_SUCCESS))
+	{
+		return EX_GENERAL;
+	};
+
+	return EX_SUCCESS;
+}
+
+/* Compresses "len" bytes of "src" into at most "capacity" bytes of "dst".
+ * Returns EX_GENERAL if they don't fit, in which case the caller should
+ * store the bytes as they are.
+ **/
+int lz_compress(
+	const uint8_t *src, uint32_t len, uint8_t *dst, uint32_t capacity,
+	uint32_t *outLen
+	)
+{
+	struct lzOutputS	out;
+	uint32_t		table[1 << LZ_HASH_BITS];
+	uint32_t		i=0, anchor=0, candidate, matchLen, h;
+
+	if (len > ZUI_MESSAGE_BLOCK_MAXLEN) { return EX_GENERAL; };
+
+	out.buff = dst;
+	out.len = 0;
+	out.capacity = capacity;
+	memset(table, 0xFF, sizeof(table));
+
+	while (i + ZUI_LZ_MIN_MATCH <= len)
+	{
+		h = lz_hash(&src[i]);
+		candidate = table[h];
+		table[h] = i;
+
+		if (candidate == UINT32_MAX
+			|| memcmp(&src[candidate], &src[i], ZUI_LZ_MIN_MATCH))
+		{
+			i++;
+			continue;
+		};
+
+		matchLen = ZUI_LZ_MIN_MATCH;
+		while (i + matchLen < len
+			&& src[candidate + matchLen] == src[i + matchLen])
+		{
+			matchLen++;
+		};
+
+		if (lz_putSequence(
+			&out, &src[anchor], i - anchor, i - candidate, matchLen)
+			!= EX_SUCCESS)
+		{
+			return EX_GENERAL;
+		};
+
+		i += matchLen;
+		anchor = i;
+	};
+
+	if (lz_putSequence(&out, &src[anchor], len - anchor, 0, 0)
+		!= EX_SUCCESS)
+	{
+		return EX_GENERAL;
+	};
+
+	*outLen = out.len;
+	return EX_SUCCESS;
+}
@@ -0,0 +1,257 @@
+#include "zudipropsc.h"
+#include <string.h>
+#include <unistd.h>
+
+
+/**	EXPLANATION:
+ * Device match table (see zui.h), kept at the end of devices.zudi-index.
+ *
+ * Entries for the devices written out in this run are collected by
+ * match_addDevice() as index_writeToDisk() emits them. When an update that
+ * appended to the index commits, match_loadCommitted() first reads back the
+ * entries of the table that is already in the index, leaving out those of
+ * the drivers that the update removed, and match_writeTable() then emits
+ * the whole table anew. A compaction writes every surviving device out
+ * again, so its table is built from this run's entries alone.
+ *
+ * The entries are sorted by bucket, then by device, so the table only
+ * depends on the devices in the index and not on the order in which they
+ * were added.
+ *
+ * The columnar attribute table (see attrcol.cpp) and the attribute name
+ * dictionary (see attrname.cpp) follow the match table, and are written
+ * along with it.
+ **/
+struct matchRangeS
+{
+	uint32_t	start, end;
+};
+
+// Entries are kept in host byte order until the table is written.
+static struct sectionS		entries, removedRanges;
+static uint32_t			sortMask;
+
+/* Points "value" at the bytes that an attribute's value is hashed as (see
+ * device::matchHash()). Scalars are laid out in "scalar", which must be
+ * 4 bytes long. Returns 0 for attribute types that aren't hashed.
+ **/
+static int match_attrValue(
+	const struct zui::device::_sAttrData *attr, uint8_t *scalar,
+	const void **value, uint32_t *valueLen
+	)
+{
+	uint32_t	v;
+
+	switch (attr->attr_type)
+	{
+	case UDI_ATTR_STRING:
+		*value = attr->attr_value;
+		*valueLen = strlen((const char *)attr->attr_value);
+		return 1;
+
+	case UDI_ATTR_ARRAY8:
+		*value = attr->attr_value;
+		*valueLen = attr->attr_length;
+		return 1;
+
+	case UDI_ATTR_BOOLEAN:
+	case UDI_ATTR_UBIT32:
+		v = (attr->attr_type == UDI_ATTR_BOOLEAN)
+			? attr->attr_value[0]
+			: UDI_ATTR32_GET(attr->attr_value);
+
+		for (int i=0; i<4; i++) { scalar[i] = v >> (i * 8); };
+		*value = scalar;
+		*valueLen = 4;
+		return 1;
+	};
+
+	return 0;
+}
+
+int match_addDevice(
+	const char *meta, const struct zui::device::_sDevice *dev,
+	uint32_t deviceOff
+	)
+{
+	const struct zui::device::_sAttrData	*attr;
+	struct zui::device::sMatchEntry		e;
+	uint8_t					scalar[4];
+	const void				*value;
+	uint32_t				valueLen;
+
+	for (int i=0; i<dev->h.nAttributes; i++)
+	{
+		attr = &dev->d[i];
+		if (!match_attrValue(attr, scalar, &value, &valueLen))
+			{ continue; };
+
+		e.hash = zui::device::matchHash(
+			meta, attr->attr_name, attr->attr_type,
+			value, valueLen);
+
+		e.deviceOff = deviceOff;
+		if (section_append(&entries, &e, sizeof(e), NULL) != EX_SUCCESS)
+			{ return EX_NOMEM; };
+	};
+
+	return EX_SUCCESS;
+}
+
+// Enters the device's attributes into its driver's match filter.
+void match_addToFilter(
+	uint32_t *filter, const struct zui::device::_sDevice *dev
+	)
+{
+	const struct zui::device::_sAttrData	*attr;
+	uint8_t					scalar[4];
+	const void				*value;
+	uint32_t				valueLen;
+
+	for (int i=0; i<dev->h.nAttributes; i++)
+	{
+		attr = &dev->d[i];
+		if (!match_attrValue(attr, scalar, &value, &valueLen))
+			{ continue; };
+
+		zui::driver::matchFilterAdd(
+			filter,
+			zui::driver::matchFilterAttrHash(
+				attr->attr_name, attr->attr_type,
+				value, valueLen));
+	};
+}
+
+int match_removeDevices(uint32_t deviceOff, uint32_t nDevices)
+{
+	struct matchRangeS	r;
+
+	r.start = deviceOff;
+	r.end = deviceOff + nDevices * sizeof(struct zui::device::sHeader);
+	return section_append(&removedRanges, &r, sizeof(r), NULL);
+}
+
+int match_isRemoved(uint32_t deviceOff)
+{
+	const struct matchRangeS	*r;
+	uint32_t			n;
+
+	r = (const struct matchRangeS *)removedRanges.buff;
+	n = removedRanges.len / sizeof(*r);
+	for (uint32_t i=0; i<n; i++)
+	{
+		if (deviceOff >= r[i].start && deviceOff < r[i].end)
+			{ return 1; };
+	};
+
+	return 0;
+}
+
+int match_loadCommitted(int fd)
+{
+	struct zui::device::sMatchTable	t;
+	struct zui::device::sMatchEntry	e;
+	uint8_t				*buff;
+	uint32_t			len=indexHeader.matchTableLen;
+	uint64_t			entriesOff;
+	int				ret=EX_SUCCESS;
+
+	if (len == 0) { return attrcol_loadCommitted(fd); };
+	if (len < sizeof(t)) { return EX_GENERAL; };
+
+	buff = (uint8_t *)malloc(len);
+	if (buff == NULL) { return EX_NOMEM; };
+
+	if (pread(fd, buff, len, indexHeader.matchTableOff) != (ssize_t)len)
+		{ free(buff); return EX_FILE_IO; };
+
+	memcpy(&t, buff, sizeof(t));
+	serial_decode(&t);
+	entriesOff = sizeof(t) + ((uint64_t)t.nBuckets + 1) * sizeof(uint32_t);
+	if (entriesOff + (uint64_t)t.nEntries * sizeof(e) != len)
+		{ free(buff); return EX_GENERAL; };
+
+	for (uint32_t i=0; i<t.nEntries && ret == EX_SUCCESS; i++)
+	{
+		memcpy(&e, &buff[entriesOff + i * sizeof(e)], sizeof(e));
+		serial_decode(&e);
+		if (match_isRemoved(e.deviceOff)) { continue; };
+
+		ret = section_append(&entries, &e, sizeof(e), NULL);
+	};
+
+	free(buff);
+	if (ret != EX_SUCCESS) { return ret; };
+	return attrcol_loadCommitted(fd);
+}
+
+static int match_compareEntries(const void *_a, const void *_b)
+{
+	const struct zui::device::sMatchEntry	*a, *b;
+
+	a = (const struct zui::device::sMatchEntry *)_a;
+	b = (const struct zui::device::sMatchEntry *)_b;
+	if ((a->hash & sortMask) != (b->hash & sortMask))
+	{
+		return ((a->hash & sortMask) < (b->hash & sortMask))
+			? -1 : 1;
+	};
+
+	if (a->deviceOff != b->deviceOff)
+		{ return (a->deviceOff < b->deviceOff) ? -1 : 1; };
+
+	if (a->hash != b->hash) { return (a->hash < b->hash) ? -1 : 1; };
+	return 0;
+}
+
+int match_writeTable(struct sectionS *devS, uint32_t *tableLen)
+{
+	struct zui::device::sMatchTable	t;
+	struct zui::device::sMatchEntry	*e;
+	uint32_t			nBuckets, nEntries, start, b, i;
+	uint32_t			tableStart=section_tell(devS);
+
+	e = (struct zui::device::sMatchEntry *)entries.buff;
+	nEntries = entries.len / sizeof(*e);
+	*tableLen = 0;
+	if (nEntries == 0) { return attrcol_writeTable(devS); };
+
+	for (nBuckets = 1; nBuckets < nEntries; nBuckets *= 2) {};
+
+	sortMask = nBuckets - 1;
+	qsort(e, nEntries, sizeof(*e), &match_compareEntries);
+
+	t.nBuckets = nBuckets;
+	t.nEntries = nEntries;
+	if (serial_append(devS, &t, NULL) != EX_SUCCESS) { return EX_NOMEM; };
+
+	// Bucket b starts at the first entry whose bucket is b or greater.
+	for (i=0, b=0; b<=nBuckets; b++)
+	{
+		while (i < nEntries && (e[i].hash & sortMask) < b) { i++; };
+
+		start = serial_value(i);
+		if (section_append(devS, &start, sizeof(start), NULL)
+			!= EX_SUCCESS)
+		{
+			return EX_NOMEM;
+		};
+	};
+
+	for (i=0; i<nEntries; i++)
+	{
+		if (serial_append(devS, &e[i], NULL) != EX_SUCCESS)
+			{ return EX_NOMEM; };
+	};
+
+	*tableLen = section_tell(devS) - tableStart;
+	return attrcol_writeTable(devS);
+}
+
+void match_free(void)
+{
+	free(entries.buff);
+	free(removedRanges.buff);
+	memset(&entries, 0, sizeof(entries));
+	memset(&removedRanges, 0, sizeof(removedRanges));
+}
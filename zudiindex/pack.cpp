@@ -0,0 +1,152 @@
+#include "zudipropsc.h"
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+
+/**	EXPLANATION:
+ * Pack mode ("-p <container-file>").
+ *
+ * Writes the committed contents of the index out as a single index
+ * container (see zui.h), which the kernel can load with one read, or one
+ * mmap(), instead of opening all of the index files. The sections are laid
+ * out in the same order as the index files, each on its own
+ * ZUI_CONTAINER_ALIGNMENT boundary.
+ *
+ * The container header has a checksum of its own and of the section table;
+ * the sections are covered by the checksums in the index header, which is
+ * copied in with the drivers section.
+ *
+ * The container is a snapshot: it is not updated along with the index, so
+ * it has to be packed again after the index changes. It is written beside
+ * its final name and renamed into place, so a reader never sees half of it.
+ **/
+static_assert((int)IDXF_N_FILES == (int)zui::container::SECTION_N_TYPES,
+	"Every index file must have a container section type.");
+
+#define PACK_STAGED_SUFFIX		".new"
+
+static inline uint64_t pack_alignUp(uint64_t value, uint32_t alignment)
+{
+	return (value + alignment - 1) & ~(uint64_t)(alignment - 1);
+}
+
+static int pack_writeFile(
+	const char *fileName, const uint8_t *buff, uint32_t len
+	)
+{
+	FILE		*f;
+	char		*tmpName;
+	int		ret=EX_FILE_IO;
+
+	tmpName = (char *)malloc(
+		strlen(fileName) + strlen(PACK_STAGED_SUFFIX) + 1);
+	if (tmpName == NULL) { return EX_NOMEM; };
+
+	strcpy(tmpName, fileName);
+	strcat(tmpName, PACK_STAGED_SUFFIX);
+
+	f = fopen(tmpName, "wb");
+	if (f == NULL)
+	{
+		fprintf(stderr, "Error: Failed to open %s.\n", tmpName);
+		free(tmpName);
+		return EX_FILE_OPEN;
+	};
+
+	if (fwrite(buff, 1, len, f) == len && fflush(f) == 0
+		&& fsync(fileno(f)) == 0)
+	{
+		ret = EX_SUCCESS;
+	};
+
+	if (fclose(f) != 0) { ret = EX_FILE_IO; };
+	if (ret == EX_SUCCESS && rename(tmpName, fileName) != 0)
+		{ ret = EX_FILE_IO; };
+
+	if (ret != EX_SUCCESS)
+	{
+		fprintf(stderr, "Error: Failed to write out %s.\n", fileName);
+		unlink(tmpName);
+	};
+
+	free(tmpName);
+	return ret;
+}
+
+int pack_writeContainer(const char *fileName)
+{
+	struct indexImageS		img;
+	struct zui::container::sHeader	h;
+	struct zui::container::sSection	table[IDXF_N_FILES];
+	uint8_t				*buff;
+	uint64_t			offset;
+	int				i, ret;
+
+	if ((ret = image_map(&img)) != EX_SUCCESS) { return ret; };
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, ZUI_CONTAINER_MAGIC, sizeof(h.magic));
+	memcpy(h.endianness, indexHeader.endianness, sizeof(h.endianness));
+	h.majorVersion = ZUI_VERSION_MAJOR;
+	h.minorVersion = ZUI_VERSION_MINOR;
+	h.nSections = IDXF_N_FILES;
+	h.sectionTableOff = sizeof(h);
+
+	offset = sizeof(h) + sizeof(table);
+	for (i=0; i<IDXF_N_FILES; i++)
+	{
+		offset = pack_alignUp(offset, ZUI_CONTAINER_ALIGNMENT);
+		table[i].type = i;
+		table[i].alignment = ZUI_CONTAINER_ALIGNMENT;
+		table[i].offset = offset;
+		table[i].length = img.sizes[i];
+		offset += img.sizes[i];
+	};
+
+	if (offset > UINT32_MAX)
+	{
+		fprintf(stderr, "Error: The index is too large to be packed.\n");
+		image_unmap(&img);
+		return EX_GENERAL;
+	};
+
+	h.fileSize = offset;
+
+	// The gaps between the sections must be zero.
+	buff = (uint8_t *)calloc(1, h.fileSize);
+	if (buff == NULL) { image_unmap(&img); return EX_NOMEM; };
+
+	for (i=0; i<IDXF_N_FILES; i++)
+	{
+		if (img.sizes[i] > 0)
+		{
+			memcpy(
+				&buff[table[i].offset], img.files[i],
+				img.sizes[i]);
+		};
+
+		serial_encode(&table[i]);
+	};
+
+	image_unmap(&img);
+	memcpy(&buff[h.sectionTableOff], table, sizeof(table));
+	serial_encode(&h);
+	h.checksum = serial_value(
+		zui::container::checksum(&h, table, IDXF_N_FILES));
+
+	memcpy(buff, &h, sizeof(h));
+	serial_decode(&h);
+
+	ret = pack_writeFile(fileName, buff, h.fileSize);
+	free(buff);
+	if (ret != EX_SUCCESS) { return ret; };
+
+	if (verboseMode)
+	{
+		printf("Packed %u drivers into %s (%u bytes).\n",
+			indexHeader.nRecords, fileName, h.fileSize);
+	};
+
+	return EX_SUCCESS;
+}
@@ -1,71 +1,86 @@
 
 #include "zudipropsc.h"
+#include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 
 
 /**	EXPLANATION:
- * Very simple stateful parser. It will parse one udiprops at a time (therefore
- * one driver at a time), so we can just keep a single global pointer and
- * allocate memory for it on each new call to parser_initializeNewDriver().
+ * Very simple stateful parser. It parses one udiprops (therefore one driver)
+ * per parser context. All of the state for a driver lives in its context, so
+ * several drivers may be parsed at once, each on its own thread, as long as
+ * each has its own context. parser_initializeNewDriverState() allocates the
+ * driver object in the context.
+ *
+ * The driver's requirements, metalanguages, bind ops and modules, and the
+ * attributes of its device and rank lines, are kept in arrays that grow in
+ * the context's arena (see arena.cpp). The only limit on how many of each
+ * there may be is the width of their counts in the index records.
  **/
-struct zui::driver::sDriver	*currentDriver=NULL;
 const char			*limitExceededMessage=
 	"Limit exceeded for entity";
 
-int parser_initializeNewDriverState(uint16_t driverId)
+// The counts of records in the index headers are 8 bits wide.
+#define PARSER_MAX_NRECORDS		(UINT8_MAX)
+
+int parser_initializeNewDriverState(
+	struct parserContextS *ctxt, uint32_t driverId
+	)
 {
 	/**	EXPLANATION:
-	 * Causes the parser to allocate a new driver object and delete the old
-	 * parsed state.
+	 * Causes the parser to allocate a new driver object in the context and
+	 * delete the old parsed state.
 	 *
 	 * If a driver was parsed previously, the caller is expected to first
 	 * use parser_getCurrentDriverState() to get the pointer to the old
 	 * state if it needs it, before calling this function.
 	 **/
-	if (currentDriver != NULL)
-	{
-		free(currentDriver);
-		currentDriver = NULL;
-	};
+	parser_releaseState(ctxt);
 
-	currentDriver = new zui::driver::sDriver;
-	if (currentDriver == NULL) { return 0; };
+	ctxt->driver = new zui::driver::sDriver;
+	if (ctxt->driver == NULL) { return 0; };
 
-	memset(currentDriver, 0, sizeof(*currentDriver));
-	currentDriver->h.id = driverId;
-	strcpy(currentDriver->h.basePath, basePath);
+	memset(ctxt->driver, 0, sizeof(*ctxt->driver));
+	ctxt->hasRequiresUdi = ctxt->hasRequiresUdiPhysio = 0;
+	strcpy(ctxt->locale, ZUI_LOCALE_DEFAULT);
+	ctxt->driver->h.id = driverId;
+	strcpy(ctxt->driver->h.basePath, basePath);
 	if (propsType == META_PROPS) {
-		currentDriver->h.type = zui::driver::DRIVERTYPE_METALANGUAGE;
+		ctxt->driver->h.type = zui::driver::DRIVERTYPE_METALANGUAGE;
 	} else {
-		currentDriver->h.type = zui::driver::DRIVERTYPE_DRIVER;
+		ctxt->driver->h.type = zui::driver::DRIVERTYPE_DRIVER;
 	};
 
 	return 1;
 }
 
-struct zui::driver::sDriver *parser_getCurrentDriverState(void)
+struct zui::driver::sDriver *parser_getCurrentDriverState(
+	struct parserContextS *ctxt
+	)
 {
-	return currentDriver;
+	return ctxt->driver;
 }
 
-int parser_getNSupportedDevices(void)
+int parser_getNSupportedDevices(struct parserContextS *ctxt)
 {
-	return currentDriver->h.nDevices;
+	return ctxt->driver->h.nDevices;
 }
 
-int parser_getNSupportedMetas(void)
+int parser_getNSupportedMetas(struct parserContextS *ctxt)
 {
-	return currentDriver->h.nProvisions;
+	return ctxt->driver->h.nProvisions;
 }
 
-void parser_releaseState(void)
+void parser_releaseState(struct parserContextS *ctxt)
 {
-	if (currentDriver != NULL)
+	if (ctxt->driver != NULL)
 	{
-		free(currentDriver);
-		currentDriver = NULL;
+		delete ctxt->driver;
+		ctxt->driver = NULL;
 	};
+
+	arena_free(&ctxt->arena);
 }
 
 static const char *skipWhitespaceIn(const char *str)
@@ -123,7 +138,41 @@ static inline int hasSlashes(const char *str)
 		free(*__varPtr); \
 		return NULL
 
-static void *parseMessage(const char *line)
+/* Adds to the verbose description of a line. Device and rank lines can have
+ * any number of attributes, so a long description is cut short.
+ **/
+static void appendVerbose(
+	struct parserContextS *ctxt, int *printLen, const char *fmt, ...
+	)
+{
+	va_list		args;
+	int		len;
+
+	if (*printLen >= PARSER_VERBOSEBUFF_SIZE - 1) { return; };
+
+	va_start(args, fmt);
+	len = vsnprintf(
+		&ctxt->verboseBuff[*printLen],
+		PARSER_VERBOSEBUFF_SIZE - *printLen, fmt, args);
+	va_end(args);
+
+	if (len > 0) { *printLen += len; };
+}
+
+// Makes room for one more record in an array of "n" of them.
+template <class T>
+static int growRecordArray(struct parserContextS *ctxt, T **array, uint32_t n)
+{
+	if (n >= PARSER_MAX_NRECORDS)
+		{ printf("%s.\n", limitExceededMessage); return 0; };
+
+	if (arena_grow(&ctxt->arena, array, n) != EX_SUCCESS)
+		{ printf("Malloc failed.\n"); return 0; };
+
+	return 1;
+}
+
+static void *parseMessage(struct parserContextS *ctxt, const char *line)
 {
 	struct zui::driver::_sMessage	*ret;
 	char				*tmp;
@@ -139,21 +188,40 @@ static void *parseMessage(const char *line)
 
 	if (strlen(line) >= ZUI_MESSAGE_MAXLEN) { goto releaseAndExit; };
 	strcpy(ret->message, line);
-	ret->driverId = currentDriver->h.id;
+	strcpy(ret->locale, ctxt->locale);
+	ret->driverId = ctxt->driver->h.id;
 
 	if (verboseMode)
 	{
 		sprintf(
-			verboseBuff, "MESSAGE(%05d): \"%s\"",
-			ret->index, ret->message);
+			ctxt->verboseBuff, "MESSAGE(%05d, %s): \"%s\"",
+			ret->index, ret->locale, ret->message);
 	};
 
-	currentDriver->h.nMessages++;
+	ctxt->driver->h.nMessages++;
 	return ret;
 PARSER_RELEASE_AND_EXIT(&ret);
 }
 
-static void *parseDisasterMessage(const char *line)
+// Sets the locale of the message lines that follow.
+static int parseLocale(struct parserContextS *ctxt, const char *line)
+{
+	const char	*white;
+	size_t		len;
+
+	line = skipWhitespaceIn(line);
+	white = findWhitespaceAfter(line);
+	len = (white != NULL) ? (size_t)(white - line) : strlen(line);
+	if (len == 0 || len >= ZUI_LOCALE_MAXLEN) { return 0; };
+	// Nothing may follow the locale name.
+	if (white != NULL && *skipWhitespaceIn(white) != '\0') { return 0; };
+
+	memcpy(ctxt->locale, line, len);
+	ctxt->locale[len] = '\0';
+	return 1;
+}
+
+static void *parseDisasterMessage(struct parserContextS *ctxt, const char *line)
 {
 	struct zui::driver::_sDisasterMessage	*ret;
 	char					*tmp;
@@ -169,21 +237,21 @@ static void *parseDisasterMessage(const char *line)
 
 	if (strlen(line) >= ZUI_MESSAGE_MAXLEN) { goto releaseAndExit; };
 	strcpy(ret->message, line);
-	ret->driverId = currentDriver->h.id;
+	ret->driverId = ctxt->driver->h.id;
 
 	if (verboseMode)
 	{
 		sprintf(
-			verboseBuff, "DISASTER_MESSAGE(%02d): \"%s\"",
+			ctxt->verboseBuff, "DISASTER_MESSAGE(%02d): \"%s\"",
 			ret->index, ret->message);
 	};
 
-	currentDriver->h.nDisasterMessages++;
+	ctxt->driver->h.nDisasterMessages++;
 	return ret;
 PARSER_RELEASE_AND_EXIT(&ret);
 }
 
-static void *parseMessageFile(const char *line)
+static void *parseMessageFile(struct parserContextS *ctxt, const char *line)
 {
 	struct zui::driver::_sMessageFile	*ret;
 
@@ -194,19 +262,21 @@ static void *parseMessageFile(const char *line)
 
 	if (hasSlashes(line)) { goto releaseAndExit; };
 	strcpy(ret->fileName, line);
-	ret->driverId = currentDriver->h.id;
-	ret->index = currentDriver->h.nMessageFiles;
+	ret->driverId = ctxt->driver->h.id;
+	ret->index = ctxt->driver->h.nMessageFiles;
 
 	if (verboseMode) {
-		sprintf(verboseBuff, "MESSAGE_FILE: \"%s\"", ret->fileName);
+		sprintf(
+			ctxt->verboseBuff, "MESSAGE_FILE: \"%s\"",
+			ret->fileName);
 	};
 
-	currentDriver->h.nMessageFiles++;
+	ctxt->driver->h.nMessageFiles++;
 	return ret;
 PARSER_RELEASE_AND_EXIT(&ret);
 }
 
-static void *parseReadableFile(const char *line)
+static void *parseReadableFile(struct parserContextS *ctxt, const char *line)
 {
 	struct zui::driver::_sReadableFile	*ret;
 
@@ -217,19 +287,21 @@ static void *parseReadableFile(const char *line)
 
 	if (hasSlashes(line)) { goto releaseAndExit; };
 	strcpy(ret->fileName, line);
-	ret->driverId = currentDriver->h.id;
-	ret->index = currentDriver->h.nReadableFiles;
+	ret->driverId = ctxt->driver->h.id;
+	ret->index = ctxt->driver->h.nReadableFiles;
 
 	if (verboseMode) {
-		sprintf(verboseBuff, "READABLE_FILE: \"%s\"", ret->fileName);
+		sprintf(
+			ctxt->verboseBuff, "READABLE_FILE: \"%s\"",
+			ret->fileName);
 	};
 
-	currentDriver->h.nReadableFiles++;
+	ctxt->driver->h.nReadableFiles++;
 	return ret;
 PARSER_RELEASE_AND_EXIT(&ret);
 }
 
-static int parseShortName(const char *line)
+static int parseShortName(struct parserContextS *ctxt, const char *line)
 {
 	const char	*white;
 
@@ -240,79 +312,79 @@ static int parseShortName(const char *line)
 		{ return 0; };
 
 	// No whitespace is allowed in the shortname.
-	strcpyUpToWhitespace(currentDriver->h.shortName, line, white);
+	strcpyUpToWhitespace(ctxt->driver->h.shortName, line, white);
 
 	if (verboseMode)
 	{
-		sprintf(verboseBuff, "SHORT_NAME: \"%s\"",
-			currentDriver->h.shortName);
+		sprintf(ctxt->verboseBuff, "SHORT_NAME: \"%s\"",
+			ctxt->driver->h.shortName);
 	};
 
 	return 1;
 }
 
-static int parseSupplier(const char *line)
+static int parseSupplier(struct parserContextS *ctxt, const char *line)
 {
 	char		*tmp;
 
 	line = skipWhitespaceIn(line);
 	// strtol returns 0 when it fails to convert.
-	currentDriver->h.supplierIndex = strtoul(line, &tmp, 10);
-	if (line == tmp || currentDriver->h.supplierIndex == 0) { return 0; };
+	ctxt->driver->h.supplierIndex = strtoul(line, &tmp, 10);
+	if (line == tmp || ctxt->driver->h.supplierIndex == 0) { return 0; };
 
 	if (verboseMode)
 	{
-		sprintf(verboseBuff, "SUPPLIER: %d",
-			currentDriver->h.supplierIndex);
+		sprintf(ctxt->verboseBuff, "SUPPLIER: %d",
+			ctxt->driver->h.supplierIndex);
 	};
 
 	return 1;
 }
 
-static int parseContact(const char *line)
+static int parseContact(struct parserContextS *ctxt, const char *line)
 {
 	char		*tmp;
 
 	line = skipWhitespaceIn(line);
 	// strtol returns 0 when it fails to convert.
-	currentDriver->h.contactIndex = strtoul(line, &tmp, 10);
-	if (line == tmp || currentDriver->h.contactIndex == 0) { return 0; };
+	ctxt->driver->h.contactIndex = strtoul(line, &tmp, 10);
+	if (line == tmp || ctxt->driver->h.contactIndex == 0) { return 0; };
 
 	if (verboseMode)
 	{
-		sprintf(verboseBuff, "CONTACT: %d",
-			currentDriver->h.contactIndex);
+		sprintf(ctxt->verboseBuff, "CONTACT: %d",
+			ctxt->driver->h.contactIndex);
 	};
 
 	return 1;
 }
 
-static int parseName(const char *line)
+static int parseName(struct parserContextS *ctxt, const char *line)
 {
 	char		*tmp;
 
 	line = skipWhitespaceIn(line);
 	// strtol returns 0 when it fails to convert.
-	currentDriver->h.nameIndex = strtoul(line, &tmp, 10);
-	if (line == tmp || currentDriver->h.nameIndex == 0) { return 0; };
+	ctxt->driver->h.nameIndex = strtoul(line, &tmp, 10);
+	if (line == tmp || ctxt->driver->h.nameIndex == 0) { return 0; };
 
 	if (verboseMode)
 	{
-		sprintf(verboseBuff, "NAME: %d",
-			currentDriver->h.nameIndex);
+		sprintf(ctxt->verboseBuff, "NAME: %d",
+			ctxt->driver->h.nameIndex);
 	};
 
 	return 1;
 }
 
-static int parseRelease(const char *line)
+static int parseRelease(struct parserContextS *ctxt, const char *line)
 {
 	char		*tmp;
 
 	line = skipWhitespaceIn(line);
 	// strtol returns 0 when it fails to convert.
-	currentDriver->h.releaseStringIndex = strtoul(line, &tmp, 10);
-	if (line == tmp || currentDriver->h.releaseStringIndex == 0)
+	ctxt->driver->h.releaseStringIndex = strtoul(line, &tmp, 10);
+	if (line == tmp || ctxt->driver->h.releaseStringIndex == 0)
 		{ return 0; };
 
 	/* Spaces in the release string are expected to be escaped.
@@ -323,24 +395,26 @@ static int parseRelease(const char *line)
 	if (strlenUpToWhitespace(line, tmp) >= ZUI_DRIVER_RELEASE_MAXLEN)
 		{ return 0; };
 
-	strcpyUpToWhitespace(currentDriver->h.releaseString, line, tmp);
+	strcpyUpToWhitespace(ctxt->driver->h.releaseString, line, tmp);
 
 	if (verboseMode)
 	{
-		sprintf(verboseBuff, "RELEASE: %d \"%s\"",
-			currentDriver->h.releaseStringIndex,
-			currentDriver->h.releaseString);
+		sprintf(ctxt->verboseBuff, "RELEASE: %d \"%s\"",
+			ctxt->driver->h.releaseStringIndex,
+			ctxt->driver->h.releaseString);
 	};
 
 	return 1;
 }
 
-static int parseRequires(const char *line)
+static int parseRequires(struct parserContextS *ctxt, const char *line)
 {
 	char		*tmp;
 	line = skipWhitespaceIn(line);
-	if (currentDriver->h.nRequirements >= ZUI_DRIVER_MAX_NREQUIREMENTS)
-		{ printf("%s.\n", limitExceededMessage); return 0; };
+	if (!growRecordArray(
+		ctxt, &ctxt->driver->requirements,
+		ctxt->driver->h.nRequirements))
+		{ return 0; };
 
 	tmp = findWhitespaceAfter(line);
 	// If no whitespace, line is invalid.
@@ -350,56 +424,58 @@ static int parseRequires(const char *line)
 		{ return 0; };
 
 	strcpyUpToWhitespace(
-		currentDriver->requirements[currentDriver->h.nRequirements].name,
+		ctxt->driver->requirements[ctxt->driver->h.nRequirements].name,
 		line, tmp);
 
 	line = skipWhitespaceIn(tmp);
-	currentDriver->requirements[currentDriver->h.nRequirements].version =
+	ctxt->driver->requirements[ctxt->driver->h.nRequirements].version =
 		strtoul(line, &tmp, 16);
 
 	if (line == tmp) { return 0; };
 
 	if (verboseMode)
 	{
-		sprintf(verboseBuff, "REQUIRES[%d]: v%x; \"%s\"",
-			currentDriver->h.nRequirements,
-			currentDriver->requirements[
-				currentDriver->h.nRequirements].version,
-			currentDriver->requirements[
-				currentDriver->h.nRequirements].name);
+		sprintf(ctxt->verboseBuff, "REQUIRES[%d]: v%x; \"%s\"",
+			ctxt->driver->h.nRequirements,
+			ctxt->driver->requirements[
+				ctxt->driver->h.nRequirements].version,
+			ctxt->driver->requirements[
+				ctxt->driver->h.nRequirements].name);
 	};
 
 	if (!strcmp(
-		currentDriver->requirements[currentDriver->h.nRequirements].name,
+		ctxt->driver->requirements[ctxt->driver->h.nRequirements].name,
 		"udi"))
 	{
-		hasRequiresUdi = 1;
-		currentDriver->h.requiredUdiVersion = currentDriver->requirements[
-			currentDriver->h.nRequirements].version;
+		ctxt->hasRequiresUdi = 1;
+		ctxt->driver->h.requiredUdiVersion = ctxt->driver->requirements[
+			ctxt->driver->h.nRequirements].version;
 
 		return 1;
 	};
 
-	currentDriver->h.nRequirements++;
+	ctxt->driver->h.nRequirements++;
 	return 1;
 }
 
-static int parseMeta(const char *line)
+static int parseMeta(struct parserContextS *ctxt, const char *line)
 {
 	char		*tmp;
 
-	if (currentDriver->h.nMetalanguages >= ZUI_DRIVER_MAX_NMETALANGUAGES)
-		{ printf("%s.\n", limitExceededMessage); return 0; };
+	if (!growRecordArray(
+		ctxt, &ctxt->driver->metalanguages,
+		ctxt->driver->h.nMetalanguages))
+		{ return 0; };
 
 	line = skipWhitespaceIn(line);
-	currentDriver->metalanguages[currentDriver->h.nMetalanguages].index =
+	ctxt->driver->metalanguages[ctxt->driver->h.nMetalanguages].index =
 		strtoul(line, &tmp, 10);
 
 	/* Meta index 0 is reserved, and strtoul() returns 0 when it can't
 	 * convert. Regardless of the reason, 0 is an invalid return value for
 	 * this situation.
 	 **/
-	if (!currentDriver->metalanguages[currentDriver->h.nMetalanguages].index)
+	if (!ctxt->driver->metalanguages[ctxt->driver->h.nMetalanguages].index)
 		{ return 0; };
 
 	line = skipWhitespaceIn(tmp);
@@ -409,100 +485,102 @@ static int parseMeta(const char *line)
 		{ return 0; };
 
 	strcpyUpToWhitespace(
-		currentDriver->metalanguages[
-			currentDriver->h.nMetalanguages].name,
+		ctxt->driver->metalanguages[
+			ctxt->driver->h.nMetalanguages].name,
 		line, tmp);
 
 	if (verboseMode)
 	{
-		sprintf(verboseBuff, "META[%d]: %d \"%s\"",
-			currentDriver->h.nMetalanguages,
-			currentDriver->metalanguages[
-				currentDriver->h.nMetalanguages].index,
-			currentDriver->metalanguages[
-				currentDriver->h.nMetalanguages].name);
+		sprintf(ctxt->verboseBuff, "META[%d]: %d \"%s\"",
+			ctxt->driver->h.nMetalanguages,
+			ctxt->driver->metalanguages[
+				ctxt->driver->h.nMetalanguages].index,
+			ctxt->driver->metalanguages[
+				ctxt->driver->h.nMetalanguages].name);
 	};
 
-	currentDriver->h.nMetalanguages++;
+	ctxt->driver->h.nMetalanguages++;
 	return 1;
 }
 
-static int parseChildBops(const char *line)
+static int parseChildBops(struct parserContextS *ctxt, const char *line)
 {
 	char		*end;
 
-	if (currentDriver->h.nChildBops >= ZUI_DRIVER_MAX_NCHILD_BOPS)
-		{ printf("%s.\n", limitExceededMessage); return 0; };
+	if (!growRecordArray(
+		ctxt, &ctxt->driver->childBops, ctxt->driver->h.nChildBops))
+		{ return 0; };
 
 	line = skipWhitespaceIn(line);
-	currentDriver->childBops[currentDriver->h.nChildBops].metaIndex =
+	ctxt->driver->childBops[ctxt->driver->h.nChildBops].metaIndex =
 		strtoul(line, &end, 10);
 
 	// Regardless of the reason, 0 is an invalid return value here.
-	if (!currentDriver->childBops[currentDriver->h.nChildBops].metaIndex)
+	if (!ctxt->driver->childBops[ctxt->driver->h.nChildBops].metaIndex)
 		{ return 0; };
 
 	line = skipWhitespaceIn(end);
-	currentDriver->childBops[currentDriver->h.nChildBops].regionIndex =
+	ctxt->driver->childBops[ctxt->driver->h.nChildBops].regionIndex =
 		strtoul(line, &end, 10);
 
 	// Region index 0 is valid.
 	if (line == end) { return 0; };
 
 	line = skipWhitespaceIn(end);
-	currentDriver->childBops[currentDriver->h.nChildBops].opsIndex =
+	ctxt->driver->childBops[ctxt->driver->h.nChildBops].opsIndex =
 		strtoul(line, &end, 10);
 
 	// 0 is also invalid here.
-	if (!currentDriver->childBops[currentDriver->h.nChildBops].opsIndex)
+	if (!ctxt->driver->childBops[ctxt->driver->h.nChildBops].opsIndex)
 		{ return 0; };
 
 	if (verboseMode)
 	{
-		sprintf(verboseBuff, "CHILD_BOPS[%d]: %d %d %d",
-			currentDriver->h.nChildBops,
-			currentDriver->childBops[currentDriver->h.nChildBops]
+		sprintf(ctxt->verboseBuff, "CHILD_BOPS[%d]: %d %d %d",
+			ctxt->driver->h.nChildBops,
+			ctxt->driver->childBops[ctxt->driver->h.nChildBops]
 				.metaIndex,
-			currentDriver->childBops[currentDriver->h.nChildBops]
+			ctxt->driver->childBops[ctxt->driver->h.nChildBops]
 				.regionIndex,
-			currentDriver->childBops[currentDriver->h.nChildBops]
+			ctxt->driver->childBops[ctxt->driver->h.nChildBops]
 				.opsIndex);
 	};
 
-	currentDriver->h.nChildBops++;
+	ctxt->driver->h.nChildBops++;
 	return 1;
 }
 
-static int parseParentBops(const char *line)
+static int parseParentBops(struct parserContextS *ctxt, const char *line)
 {
 	char		*end;
 
-	if (currentDriver->h.nChildBops >= ZUI_DRIVER_MAX_NPARENT_BOPS)
-		{ printf("%s.\n", limitExceededMessage); return 0; };
+	if (!growRecordArray(
+		ctxt, &ctxt->driver->parentBops, ctxt->driver->h.nParentBops))
+		{ return 0; };
 
 	line = skipWhitespaceIn(line);
-	currentDriver->parentBops[currentDriver->h.nParentBops].metaIndex =
+	ctxt->driver->parentBops[ctxt->driver->h.nParentBops].metaIndex =
 		strtoul(line, &end, 10);
 
-	if (!currentDriver->parentBops[currentDriver->h.nParentBops].metaIndex)
+	if (!ctxt->driver->parentBops[ctxt->driver->h.nParentBops].metaIndex)
 		{ return 0; };
 
 	line = skipWhitespaceIn(end);
-	currentDriver->parentBops[currentDriver->h.nParentBops].regionIndex =
+	ctxt->driver->parentBops[ctxt->driver->h.nParentBops].regionIndex =
 		strtoul(line, &end, 10);
 
 	// 0 is a valid value for region_idx.
 	if (line == end) { return 0; };
 
 	line = skipWhitespaceIn(end);
-	currentDriver->parentBops[currentDriver->h.nParentBops].opsIndex =
+	ctxt->driver->parentBops[ctxt->driver->h.nParentBops].opsIndex =
 		strtoul(line, &end, 10);
 
-	if (!currentDriver->parentBops[currentDriver->h.nParentBops].opsIndex)
+	if (!ctxt->driver->parentBops[ctxt->driver->h.nParentBops].opsIndex)
 		{ return 0; };
 
 	line = skipWhitespaceIn(end);
-	currentDriver->parentBops[currentDriver->h.nParentBops].bindCbIndex =
+	ctxt->driver->parentBops[ctxt->driver->h.nParentBops].bindCbIndex =
 		strtoul(line, &end, 10);
 
 	// 0 is a valid index value for bind_cb_idx.
@@ -510,72 +588,74 @@ static int parseParentBops(const char *line)
 
 	if (verboseMode)
 	{
-		sprintf(verboseBuff, "PARENT_BOPS[%d]: %d %d %d %d",
-			currentDriver->h.nParentBops,
-			currentDriver->parentBops[currentDriver->h.nParentBops]
+		sprintf(ctxt->verboseBuff, "PARENT_BOPS[%d]: %d %d %d %d",
+			ctxt->driver->h.nParentBops,
+			ctxt->driver->parentBops[ctxt->driver->h.nParentBops]
 				.metaIndex,
-			currentDriver->parentBops[currentDriver->h.nParentBops]
+			ctxt->driver->parentBops[ctxt->driver->h.nParentBops]
 				.regionIndex,
-			currentDriver->parentBops[currentDriver->h.nParentBops]
+			ctxt->driver->parentBops[ctxt->driver->h.nParentBops]
 				.opsIndex,
-			currentDriver->parentBops[currentDriver->h.nParentBops]
+			ctxt->driver->parentBops[ctxt->driver->h.nParentBops]
 				.bindCbIndex);
 	};
 
-	currentDriver->h.nParentBops++;
+	ctxt->driver->h.nParentBops++;
 	return 1;
 }
 
-static int parseInternalBops(const char *line)
+static int parseInternalBops(struct parserContextS *ctxt, const char *line)
 {
 	char		*end;
 
-	if (currentDriver->h.nChildBops >= ZUI_DRIVER_MAX_NPARENT_BOPS)
-		{ printf("%s.\n", limitExceededMessage); return 0; };
+	if (!growRecordArray(
+		ctxt, &ctxt->driver->internalBops,
+		ctxt->driver->h.nInternalBops))
+		{ return 0; };
 
 	line = skipWhitespaceIn(line);
-	currentDriver->internalBops[currentDriver->h.nInternalBops].metaIndex =
+	ctxt->driver->internalBops[ctxt->driver->h.nInternalBops].metaIndex =
 		strtoul(line, &end, 10);
 
-	if (!currentDriver->internalBops[currentDriver->h.nInternalBops]
+	if (!ctxt->driver->internalBops[ctxt->driver->h.nInternalBops]
 		.metaIndex)
 	{
 		return 0;
 	};
 
 	line = skipWhitespaceIn(end);
-	currentDriver->internalBops[currentDriver->h.nInternalBops].regionIndex =
+	ctxt->driver->internalBops[ctxt->driver->h.nInternalBops].regionIndex =
 		strtoul(line, &end, 10);
 
 	// 0 is actually not a valid value for region_idx in this case.
-	if (!currentDriver->internalBops[currentDriver->h.nInternalBops]
+	if (!ctxt->driver->internalBops[ctxt->driver->h.nInternalBops]
 		.regionIndex)
 	{
 		return 0;
 	};
 
 	line = skipWhitespaceIn(end);
-	currentDriver->internalBops[currentDriver->h.nInternalBops].opsIndex0 =
+	ctxt->driver->internalBops[ctxt->driver->h.nInternalBops].opsIndex0 =
 		strtoul(line, &end, 10);
 
-	if (!currentDriver->internalBops[currentDriver->h.nInternalBops]
+	if (!ctxt->driver->internalBops[ctxt->driver->h.nInternalBops]
 		.opsIndex0)
 	{
 		return 0;
 	};
 
 	line = skipWhitespaceIn(end);
-	currentDriver->internalBops[currentDriver->h.nInternalBops].opsIndex1 =
+	ctxt->driver->internalBops[ctxt->driver->h.nInternalBops].opsIndex1 =
 		strtoul(line, &end, 10);
 
-	if (!currentDriver->internalBops[currentDriver->h.nInternalBops]
+	if (!ctxt->driver->internalBops[ctxt->driver->h.nInternalBops]
 		.opsIndex1)
 	{
 		return 0;
 	};
 
 	line = skipWhitespaceIn(end);
-	currentDriver->internalBops[currentDriver->h.nInternalBops].bindCbIndex =
+	ctxt->driver->internalBops[ctxt->driver->h.nInternalBops].bindCbIndex =
 		strtoul(line, &end, 10);
 
 	// 0 is a valid value for bind_cb_idx.
@@ -583,48 +663,49 @@ static int parseInternalBops(const char *line)
 
 	if (verboseMode)
 	{
-		sprintf(verboseBuff, "INTERNAL_BOPS[%d]: %d %d %d %d %d",
-			currentDriver->h.nInternalBops,
-			currentDriver->internalBops[
-				currentDriver->h.nInternalBops].metaIndex,
-			currentDriver->internalBops[
-				currentDriver->h.nInternalBops].regionIndex,
-			currentDriver->internalBops[
-				currentDriver->h.nInternalBops].opsIndex0,
-			currentDriver->internalBops[
-				currentDriver->h.nInternalBops].opsIndex1,
-			currentDriver->internalBops[
-				currentDriver->h.nInternalBops].bindCbIndex);
+		sprintf(ctxt->verboseBuff, "INTERNAL_BOPS[%d]: %d %d %d %d %d",
+			ctxt->driver->h.nInternalBops,
+			ctxt->driver->internalBops[
+				ctxt->driver->h.nInternalBops].metaIndex,
+			ctxt->driver->internalBops[
+				ctxt->driver->h.nInternalBops].regionIndex,
+			ctxt->driver->internalBops[
+				ctxt->driver->h.nInternalBops].opsIndex0,
+			ctxt->driver->internalBops[
+				ctxt->driver->h.nInternalBops].opsIndex1,
+			ctxt->driver->internalBops[
+				ctxt->driver->h.nInternalBops].bindCbIndex);
 	};
 
-	currentDriver->h.nInternalBops++;
+	ctxt->driver->h.nInternalBops++;
 	return 1;
 }
 
-static int parseModule(const char *line)
+static int parseModule(struct parserContextS *ctxt, const char *line)
 {
-	if (currentDriver->h.nModules >= ZUI_DRIVER_MAX_NMODULES)
-		{ printf("%s.\n", limitExceededMessage); return 0; };
+	if (!growRecordArray(
+		ctxt, &ctxt->driver->modules, ctxt->driver->h.nModules))
+		{ return 0; };
 
 	line = skipWhitespaceIn(line);
 
 	if (strlen(line) >= ZUI_FILENAME_MAXLEN) { return 0; };
-	strcpy(currentDriver->modules[currentDriver->h.nModules].fileName, line);
+	strcpy(ctxt->driver->modules[ctxt->driver->h.nModules].fileName, line);
 
 	// We assign a custom module index to each module for convenience.
-	currentDriver->modules[currentDriver->h.nModules].index =
-		currentDriver->h.nModules;
+	ctxt->driver->modules[ctxt->driver->h.nModules].index =
+		ctxt->driver->h.nModules;
 
 	if (verboseMode)
 	{
-		sprintf(verboseBuff, "MODULE[%d]: (%d) \"%s\"",
-			currentDriver->h.nModules,
-			currentDriver->modules[currentDriver->h.nModules].index,
-			currentDriver->modules[currentDriver->h.nModules]
+		sprintf(ctxt->verboseBuff, "MODULE[%d]: (%d) \"%s\"",
+			ctxt->driver->h.nModules,
+			ctxt->driver->modules[ctxt->driver->h.nModules].index,
+			ctxt->driver->modules[ctxt->driver->h.nModules]
 				.fileName);
 	};
 
-	currentDriver->h.nModules++;
+	ctxt->driver->h.nModules++;
 	return 1;
 }
 
@@ -722,7 +803,7 @@ fail:
 	return NULL;
 }
 
-static void *parseRegion(const char *line)
+static void *parseRegion(struct parserContextS *ctxt, const char *line)
 {
 	struct zui::driver::sRegion	*ret;
 	char				*tmp;
@@ -731,8 +812,8 @@ static void *parseRegion(const char *line)
 	PARSER_MALLOC(&ret, struct zui::driver::sRegion);
 	line = skipWhitespaceIn(line);
 
-	ret->driverId = currentDriver->h.id;
-	if (currentDriver->h.nModules == 0)
+	ret->driverId = ctxt->driver->h.id;
+	if (ctxt->driver->h.nModules == 0)
 	{
 		printf("Error: a module statement must precede any regions.\n"
 			"Regions must belong to a module.\n");
@@ -740,7 +821,7 @@ static void *parseRegion(const char *line)
 		goto releaseAndExit;
 	};
 
-	ret->moduleIndex = currentDriver->h.nModules - 1;
+	ret->moduleIndex = ctxt->driver->h.nModules - 1;
 	ret->index = strtoul(line, &tmp, 10);
 	if (line == tmp) { goto releaseAndExit; };
 
@@ -760,18 +841,18 @@ static void *parseRegion(const char *line)
 
 	if (verboseMode)
 	{
-		sprintf(verboseBuff, "REGION(%d): (module %d \"%s\"): "
+		sprintf(ctxt->verboseBuff, "REGION(%d): (module %d \"%s\"): "
 			"Prio: %d, latency %d, dyn.? %c, FP? %c, intr.? %c",
 			ret->index,
 			ret->moduleIndex,
-			currentDriver->modules[ret->moduleIndex].fileName,
+			ctxt->driver->modules[ret->moduleIndex].fileName,
 			(int)ret->priority, (int)ret->latency,
 			(ret->flags & ZUI_REGION_FLAGS_DYNAMIC) ? 'y' : 'n',
 			(ret->flags & ZUI_REGION_FLAGS_FP) ? 'y' : 'n',
 			(ret->flags & ZUI_REGION_FLAGS_INTERRUPT) ? 'y' : 'n');
 	};
 
-	currentDriver->h.nRegions++;
+	ctxt->driver->h.nRegions++;
 	return ret;
 PARSER_RELEASE_AND_EXIT(&ret);
 }
@@ -903,14 +984,14 @@ success:
 	return line + retOffset;
 }
 
-static void *parseDevice(const char *line)
+static void *parseDevice(struct parserContextS *ctxt, const char *line)
 {
 	struct zui::device::_sDevice	*ret;
 	char				*tmp;
 	int				status, i, j, printLen;
 
 	PARSER_MALLOC(&ret, struct zui::device::_sDevice);
-	ret->h.index = currentDriver->h.nDevices;
+	ret->h.index = ctxt->driver->h.nDevices;
 	line = skipWhitespaceIn(line);
 	ret->h.messageIndex = strtoul(line, &tmp, 10);
 	// 0 is invalid regardless of the reason.
@@ -924,6 +1005,10 @@ static void *parseDevice(const char *line)
 	{
 		do
 		{
+			if (!growRecordArray(
+				ctxt, &ret->d, ret->h.nAttributes))
+				{ goto releaseAndExit; };
+
 			line = parseDeviceAttribute(ret, line, &status);
 			if (status == 0) { goto releaseAndExit; };
 			ret->h.nAttributes++;
@@ -934,51 +1019,51 @@ static void *parseDevice(const char *line)
 	if (verboseMode)
 	{
 		printLen = sprintf(
-			verboseBuff,
+			ctxt->verboseBuff,
 			"DEVICE(index %d, %d, %d, %d attrs)",
 			ret->h.index, ret->h.messageIndex, ret->h.metaIndex,
 			ret->h.nAttributes);
 
 		for (i=0; i<ret->h.nAttributes; i++)
 		{
-			printLen += sprintf(&verboseBuff[printLen], ".\n");
+			appendVerbose(ctxt, &printLen, ".\n");
 			switch (ret->d[i].attr_type)
 			{
 			case UDI_ATTR_STRING:
-				printLen += sprintf(
-					&verboseBuff[printLen],
+				appendVerbose(
+					ctxt, &printLen,
 					"\tSTR %s: \"%s\"",
 					ret->d[i].attr_name,
 					ret->d[i].attr_value);
 
 				break;
 			case UDI_ATTR_ARRAY8:
-				printLen += sprintf(
-					&verboseBuff[printLen],
+				appendVerbose(
+					ctxt, &printLen,
 					"\tARR %s: size %d: ",
 					ret->d[i].attr_name,
 					ret->d[i].attr_length);
 
 				for (j=0; j<ret->d[i].attr_length; j++)
 				{
-					printLen += sprintf(
-						&verboseBuff[printLen],
+					appendVerbose(
+						ctxt, &printLen,
 						"%02X",
 						ret->d[i].attr_value[j]);
 				};
 
 				break;
 			case UDI_ATTR_BOOLEAN:
-				printLen += sprintf(
-					&verboseBuff[printLen],
+				appendVerbose(
+					ctxt, &printLen,
 					"\tBOOL %s: %d",
 					ret->d[i].attr_name,
 					ret->d[i].attr_value[0]);
 
 				break;
 			case UDI_ATTR_UBIT32:
-				printLen += sprintf(
-					&verboseBuff[printLen],
+				appendVerbose(
+					ctxt, &printLen,
 					"\tU32 %s: 0x%x",
 					ret->d[i].attr_name,
 					UDI_ATTR32_GET(ret->d[i].attr_value));
@@ -988,13 +1073,13 @@ static void *parseDevice(const char *line)
 		};
 	};
 
-	ret->h.driverId = currentDriver->h.id;
-	currentDriver->h.nDevices++;
+	ret->h.driverId = ctxt->driver->h.id;
+	ctxt->driver->h.nDevices++;
 	return ret;
 PARSER_RELEASE_AND_EXIT(&ret);
 }
 
-static void *parseProvides(const char *line)
+static void *parseProvides(struct parserContextS *ctxt, const char *line)
 {
 	struct zui::driver::_sProvision	*ret;
 	char				*tmp;
@@ -1014,15 +1099,15 @@ static void *parseProvides(const char *line)
 	ret->version = strtoul(line, &tmp, 0);
 	if (line == tmp) { goto releaseAndExit; };
 
-	ret->driverId = currentDriver->h.id;
+	ret->driverId = ctxt->driver->h.id;
 
 	if (verboseMode)
 	{
-		sprintf(verboseBuff, "PROVIDES (v0x%x): \"%s\"",
+		sprintf(ctxt->verboseBuff, "PROVIDES (v0x%x): \"%s\"",
 			ret->version, ret->name);
 	};
 
-	currentDriver->h.nProvisions++;
+	ctxt->driver->h.nProvisions++;
 	return ret;
 PARSER_RELEASE_AND_EXIT(&ret);
 }
@@ -1039,14 +1124,14 @@ static int parseRankAttribute(struct zui::rank::_sRank *rank, const char *line)
 	return 1;
 }
 
-static void *parseRank(const char *line)
+static void *parseRank(struct parserContextS *ctxt, const char *line)
 {
 	struct zui::rank::_sRank		*ret;
 	char				*tmp;
 	int				status, i, printLen=0;
 
 	PARSER_MALLOC(&ret, struct zui::rank::_sRank);
-	ret->h.driverId = currentDriver->h.id;
+	ret->h.driverId = ctxt->driver->h.id;
 
 	line = skipWhitespaceIn(line);
 
@@ -1061,11 +1146,8 @@ static void *parseRank(const char *line)
 
 	do
 	{
-		if (ret->h.nAttributes >= ZUI_RANK_MAX_NATTRS)
-		{
-			fprintf(stderr, "%s.\n", limitExceededMessage);
-			goto releaseAndExit;
-		};
+		if (!growRecordArray(ctxt, &ret->d, ret->h.nAttributes))
+			{ goto releaseAndExit; };
 
 		status = parseRankAttribute(ret, line);
 		if (!status) { goto releaseAndExit; };
@@ -1075,18 +1157,18 @@ static void *parseRank(const char *line)
 		line = skipWhitespaceIn(line);
 	} while (line != NULL && *line != '\0');
 
-	currentDriver->h.nRanks++;
+	ctxt->driver->h.nRanks++;
 
 	if (verboseMode)
 	{
 		printLen += sprintf(
-			verboseBuff, "RANK %d: %d attribs",
+			ctxt->verboseBuff, "RANK %d: %d attribs",
 			ret->h.rank, ret->h.nAttributes);
 
 		for (i=0; i<ret->h.nAttributes; i++)
 		{
-			printLen += sprintf(
-				&verboseBuff[printLen], ".\n\tAttr: \"%s\"",
+			appendVerbose(
+				ctxt, &printLen, ".\n\tAttr: \"%s\"",
 				ret->d[i].name);
 		};
 	};
@@ -1095,29 +1177,31 @@ static void *parseRank(const char *line)
 PARSER_RELEASE_AND_EXIT(&ret);
 }
 
-static int parseCategory(const char *line)
+static int parseCategory(struct parserContextS *ctxt, const char *line)
 {
 	char		*tmp;
 
 	line = skipWhitespaceIn(line);
 
-	currentDriver->h.categoryIndex = strtoul(line, &tmp, 10);
-	if (currentDriver->h.categoryIndex == 0) { return 0; };
+	ctxt->driver->h.categoryIndex = strtoul(line, &tmp, 10);
+	if (ctxt->driver->h.categoryIndex == 0) { return 0; };
 
 	if (verboseMode)
 	{
-		sprintf(verboseBuff, "CATEGORY: %d",
-			currentDriver->h.categoryIndex);
+		sprintf(ctxt->verboseBuff, "CATEGORY: %d",
+			ctxt->driver->h.categoryIndex);
 	};
 
 	return 1;
 }
 
-enum parser_lineTypeE parser_parseLine(const char *line, void **ret)
+enum parser_lineTypeE parser_parseLine(
+	struct parserContextS *ctxt, const char *line, void **ret
+	)
 {
 	int			slen;
 
-	if (currentDriver == NULL) { return LT_UNKNOWN; };
+	if (ctxt->driver == NULL) { return LT_UNKNOWN; };
 	line = skipWhitespaceIn(line);
 	// Skip lines with only whitespace.
 	if (line[0] == '\0') { return LT_MISC; };
@@ -1126,17 +1210,18 @@ enum parser_lineTypeE parser_parseLine(const char *line, void **ret)
 	 * message_file lines as well.
 	 **/
 	if (!strncmp(line, "message_file", slen = strlen("message_file"))) {
-		*ret = parseMessageFile(&line[slen]);
+		*ret = parseMessageFile(ctxt, &line[slen]);
 		return (*ret == NULL) ? LT_INVALID : LT_MESSAGE_FILE;
 	};
 
 	if (!strncmp(line, "message", slen = strlen("message"))) {
-		*ret = parseMessage(&line[slen]);
+		*ret = parseMessage(ctxt, &line[slen]);
 		return (*ret == NULL) ? LT_INVALID : LT_MESSAGE;
 	};
 
 	if (!strncmp(line, "requires", slen = strlen("requires"))) {
-		return (parseRequires(&line[slen])) ? LT_DRIVER : LT_INVALID;
+		return (parseRequires(ctxt, &line[slen]))
+			? LT_DRIVER : LT_INVALID;
 	};
 
 	if (!strncmp(
@@ -1157,26 +1242,39 @@ enum parser_lineTypeE parser_parseLine(const char *line, void **ret)
 		{ return LT_MISC; };
 
 	if (!strncmp(line, "module", slen = strlen("module"))) {
-		return (parseModule(&line[slen])) ? LT_DRIVER : LT_INVALID;
+		return (parseModule(ctxt, &line[slen]))
+			? LT_DRIVER : LT_INVALID;
 	};
 
 	if (!strncmp(
 		line, "disaster_message", slen = strlen("disaster_message"))) {
-		*ret = parseDisasterMessage(&line[slen]);
+		*ret = parseDisasterMessage(ctxt, &line[slen]);
 		return (*ret == NULL) ? LT_INVALID : LT_DISASTER_MESSAGE;
 	};
 
 	if (!strncmp(line, "locale", slen = strlen("locale")))
-		{ return LT_MISC; };
+	{
+		return (parseLocale(ctxt, &line[slen]))
+			? LT_MISC : LT_INVALID;
+	};
 
 	if (!strncmp(line, "release", slen = strlen("release")))
-		{ return (parseRelease(&line[slen])) ? LT_DRIVER:LT_INVALID; };
+	{
+		return (parseRelease(ctxt, &line[slen]))
+			? LT_DRIVER : LT_INVALID;
+	};
 
 	if (!strncmp(line, "name", slen = strlen("name")))
-		{ return (parseName(&line[slen])) ? LT_DRIVER : LT_INVALID; };
+	{
+		return (parseName(ctxt, &line[slen]))
+			? LT_DRIVER : LT_INVALID;
+	};
 
 	if (!strncmp(line, "contact", slen = strlen("contact")))
-		{ return (parseContact(&line[slen])) ? LT_DRIVER:LT_INVALID; };
+	{
+		return (parseContact(ctxt, &line[slen]))
+			? LT_DRIVER : LT_INVALID;
+	};
 
 	if (!strncmp(
 		line, "properties_version",
@@ -1184,10 +1282,14 @@ enum parser_lineTypeE parser_parseLine(const char *line, void **ret)
 		{ return LT_MISC; };
 
 	if (!strncmp(line, "supplier", slen = strlen("supplier")))
-		{ return (parseSupplier(&line[slen])) ? LT_DRIVER:LT_INVALID; };
+	{
+		return (parseSupplier(ctxt, &line[slen]))
+			? LT_DRIVER : LT_INVALID;
+	};
 
 	if (!strncmp(line, "shortname", slen = strlen("shortname"))) {
-		return (parseShortName(&line[slen])) ? LT_DRIVER : LT_INVALID;
+		return (parseShortName(ctxt, &line[slen]))
+			? LT_DRIVER : LT_INVALID;
 	};
 
 	if (!strncmp(line, "source_requires", slen = strlen("source_requires")))
@@ -1204,37 +1306,38 @@ enum parser_lineTypeE parser_parseLine(const char *line, void **ret)
 		if (!strncmp(
 			line, "internal_bind_ops", slen = strlen("internal_bind_ops")))
 		{
-			return (parseInternalBops(&line[slen]))
+			return (parseInternalBops(ctxt, &line[slen]))
 				? LT_INTERNAL_BOPS : LT_INVALID;
 		};
 
 		if (!strncmp(line, "parent_bind_ops", slen=strlen("parent_bind_ops"))) {
-			return (parseParentBops(&line[slen]))
+			return (parseParentBops(ctxt, &line[slen]))
 				? LT_PARENT_BOPS : LT_INVALID;
 		};
 
 		if (!strncmp(line, "child_bind_ops", slen = strlen("child_bind_ops"))) {
-			return (parseChildBops(&line[slen]))
+			return (parseChildBops(ctxt, &line[slen]))
 				? LT_CHILD_BOPS : LT_INVALID;
 		};
 
 		if (!strncmp(line, "meta", slen = strlen("meta"))) {
-			return (parseMeta(&line[slen])) ? LT_METALANGUAGE : LT_INVALID;
+			return (parseMeta(ctxt, &line[slen]))
+				? LT_METALANGUAGE : LT_INVALID;
 		};
 
 		if (!strncmp(line, "device", slen = strlen("device"))) {
-			*ret = parseDevice(&line[slen]);
+			*ret = parseDevice(ctxt, &line[slen]);
 			return (*ret == NULL) ? LT_INVALID : LT_DEVICE;
 		};
 
 		if (!strncmp(line, "region", slen = strlen("region"))) {
-			*ret = parseRegion(&line[slen]);
+			*ret = parseRegion(ctxt, &line[slen]);
 			return (*ret == NULL) ? LT_INVALID : LT_REGION;
 		};
 
 		if (!strncmp(line, "readable_file", slen = strlen("readable_file"))) {
-			*ret = parseReadableFile(&line[slen]);
-			return (*ret == NULL) ? LT_INVALID : LT_DISASTER_MESSAGE;
+			*ret = parseReadableFile(ctxt, &line[slen]);
+			return (*ret == NULL) ? LT_INVALID : LT_READABLE_FILE;
 		};
 
 		if (!strncmp(line, "custom", slen = strlen("custom")))
@@ -1247,7 +1350,7 @@ enum parser_lineTypeE parser_parseLine(const char *line, void **ret)
 	if (propsType == META_PROPS)
 	{
 		if (!strncmp(line, "provides", slen = strlen("provides"))) {
-			*ret = parseProvides(&line[slen]);
+			*ret = parseProvides(ctxt, &line[slen]);
 			return (*ret == NULL) ? LT_INVALID : LT_PROVIDES;
 		};
 
@@ -1255,13 +1358,13 @@ enum parser_lineTypeE parser_parseLine(const char *line, void **ret)
 			{ return LT_MISC; };
 
 		if (!strncmp(line, "category", slen = strlen("category"))) {
-			return (parseCategory(&line[slen]))
+			return (parseCategory(ctxt, &line[slen]))
 				? LT_DRIVER : LT_INVALID;
 		};
 
 		// Does not seem like rank is supported by the spec anymore.
 		if (!strncmp(line, "rank", slen = strlen("rank"))) {
-			*ret = parseRank(&line[slen]);
+			*ret = parseRank(ctxt, &line[slen]);
 			return (*ret == NULL) ? LT_INVALID : LT_RANK;
 		};
 	};
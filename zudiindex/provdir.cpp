@@ -0,0 +1,134 @@
+#include "zudipropsc.h"
+#include <string.h>
+#include <unistd.h>
+
+
+/**	EXPLANATION:
+ * Provision directory (see zui.h), kept at the end of provisions.zudi-index.
+ *
+ * It is maintained the same way as the device match table (see match.cpp):
+ * the provisions written out in this run are collected as index_writeToDisk()
+ * emits them, and when an update that appended to the index commits, the
+ * entries of the committed directory are read back, minus those of the
+ * drivers that the update removed, and the whole directory is written anew.
+ * After a compaction it is built from this run's entries alone.
+ *
+ * The requirement closure table (see closure.cpp) follows the directory.
+ **/
+static struct sectionS		entries, removedDrivers;
+
+int provdir_addProvision(const struct zui::driver::_sProvision *prov)
+{
+	struct zui::driver::sProvisionDirEntry	e;
+
+	e.nameHash = zui::driver::provisionHash(prov->name);
+	e.version = prov->version;
+	e.driverId = prov->driverId;
+	// The provision record interned the name already; this finds it.
+	if (strtab_internString(
+		&indexSections[IDXF_STRINGS], prov->name, &e.nameOff)
+		!= EX_SUCCESS)
+	{
+		return EX_NOMEM;
+	};
+
+	return section_append(&entries, &e, sizeof(e), NULL);
+}
+
+int provdir_removeDriver(uint32_t driverId)
+{
+	return section_append(
+		&removedDrivers, &driverId, sizeof(driverId), NULL);
+}
+
+int provdir_isRemoved(uint32_t driverId)
+{
+	const uint32_t	*ids=(const uint32_t *)removedDrivers.buff;
+
+	for (uint32_t i=0; i<removedDrivers.len / sizeof(*ids); i++)
+	{
+		if (ids[i] == driverId) { return 1; };
+	};
+
+	return 0;
+}
+
+int provdir_loadCommitted(int fd)
+{
+	struct zui::driver::sProvisionDirEntry	e;
+	uint8_t					*buff;
+	uint32_t				len=indexHeader.provisionDirLen;
+	int					ret=EX_SUCCESS;
+
+	if (len == 0) { return EX_SUCCESS; };
+	if (len % sizeof(e) != 0) { return EX_GENERAL; };
+
+	buff = (uint8_t *)malloc(len);
+	if (buff == NULL) { return EX_NOMEM; };
+
+	if (pread(fd, buff, len, indexHeader.provisionDirOff) != (ssize_t)len)
+		{ free(buff); return EX_FILE_IO; };
+
+	for (uint32_t off=0; off<len && ret == EX_SUCCESS; off += sizeof(e))
+	{
+		memcpy(&e, &buff[off], sizeof(e));
+		serial_decode(&e);
+		if (provdir_isRemoved(e.driverId)) { continue; };
+
+		ret = section_append(&entries, &e, sizeof(e), NULL);
+	};
+
+	free(buff);
+	return ret;
+}
+
+static int provdir_compareEntries(const void *_a, const void *_b)
+{
+	const struct zui::driver::sProvisionDirEntry	*a, *b;
+
+	a = (const struct zui::driver::sProvisionDirEntry *)_a;
+	b = (const struct zui::driver::sProvisionDirEntry *)_b;
+	if (a->nameHash != b->nameHash)
+		{ return (a->nameHash < b->nameHash) ? -1 : 1; };
+
+	if (a->driverId != b->driverId)
+		{ return (a->driverId < b->driverId) ? -1 : 1; };
+
+	if (a->version != b->version)
+		{ return (a->version < b->version) ? -1 : 1; };
+
+	if (a->nameOff != b->nameOff)
+		{ return (a->nameOff < b->nameOff) ? -1 : 1; };
+
+	return 0;
+}
+
+int provdir_writeTable(struct sectionS *provS, uint32_t *tableLen)
+{
+	struct zui::driver::sProvisionDirEntry	*e;
+	uint32_t				nEntries, i;
+	uint32_t				tableStart=section_tell(provS);
+
+	e = (struct zui::driver::sProvisionDirEntry *)entries.buff;
+	nEntries = entries.len / sizeof(*e);
+	if (nEntries > 0)
+		{ qsort(e, nEntries, sizeof(*e), &provdir_compareEntries); };
+
+	for (i=0; i<nEntries; i++)
+	{
+		if (serial_append(provS, &e[i], NULL) != EX_SUCCESS)
+			{ return EX_NOMEM; };
+	};
+
+	*tableLen = section_tell(provS) - tableStart;
+	// The requirement closures are resolved against the new directory.
+	return closure_writeTable(provS, e, nEntries);
+}
+
+void provdir_free(void)
+{
+	free(entries.buff);
+	free(removedDrivers.buff);
+	memset(&entries, 0, sizeof(entries));
+	memset(&removedDrivers, 0, sizeof(removedDrivers));
+}
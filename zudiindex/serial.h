@@ -0,0 +1,264 @@
+#ifndef _Z_UDIPROPS_SERIAL_H
+	#define _Z_UDIPROPS_SERIAL_H
+
+	#include <stdint.h>
+	#include <zui.h>
+
+/**	EXPLANATION:
+ * Byte order of the index records.
+ *
+ * Every multi-byte field in the index is stored in the byte order that the
+ * index was created for ("le" or "be" in the index header), so that the
+ * kernel can use the mapped records in place, without swapping anything.
+ *
+ * Each on-disk record type has a serial_swapRecord() overload which lists
+ * its fields. Records are encoded on their way into a section by
+ * serial_append(), and decoded on their way out by image_readRecord(). A
+ * record type without an overload won't compile, rather than silently
+ * being written in host order. When the index is in host order, nothing is
+ * swapped at all.
+ **/
+extern int		serialNeedsSwap;
+
+int serial_setTargetOrder(const char *endianness);
+
+static inline uint8_t serial_swap(uint8_t v) { return v; }
+static inline uint16_t serial_swap(uint16_t v) { return __builtin_bswap16(v); }
+static inline uint32_t serial_swap(uint32_t v) { return __builtin_bswap32(v); }
+static inline uint64_t serial_swap(uint64_t v) { return __builtin_bswap64(v); }
+
+template <class T>
+static inline void serial_field(T &field) { field = serial_swap(field); }
+
+template <class T, size_t N>
+static inline void serial_field(T (&field)[N])
+{
+	for (size_t i=0; i<N; i++) { serial_field(field[i]); };
+}
+
+// Converts a single value between host and index order.
+template <class T>
+static inline T serial_value(T v)
+{
+	return (serialNeedsSwap) ? serial_swap(v) : v;
+}
+
+/* Bare arrays of integers, such as the driver IDs of the closure table and
+ * the slots of a message table.
+ **/
+static inline void serial_swapRecord(uint16_t &r) { serial_field(r); }
+static inline void serial_swapRecord(uint32_t &r) { serial_field(r); }
+
+static inline void serial_swapRecord(struct zui::sHeader &r)
+{
+	serial_field(r.majorVersion); serial_field(r.minorVersion);
+	serial_field(r.nRecords); serial_field(r.nextDriverId);
+	serial_field(r.nSupportedDevices); serial_field(r.nSupportedMetas);
+	serial_field(r.fileSizes);
+	serial_field(r.matchTableOff); serial_field(r.matchTableLen);
+	serial_field(r.attrColumnsOff); serial_field(r.attrColumnsLen);
+	serial_field(r.attrNamesOff); serial_field(r.attrNamesLen);
+	serial_field(r.provisionDirOff); serial_field(r.provisionDirLen);
+	serial_field(r.closureTableOff); serial_field(r.closureTableLen);
+	serial_field(r.fileChecksums); serial_field(r.headerChecksum);
+}
+
+static inline void serial_swapRecord(struct zui::sAttrNameDict &r)
+	{ serial_field(r.nNames); serial_field(r.nBuckets); }
+
+static inline void serial_swapRecord(struct zui::device::sHeader &r)
+{
+	serial_field(r.driverId); serial_field(r.index);
+	serial_field(r.messageIndex); serial_field(r.metaIndex);
+	serial_field(r.dataOff);
+}
+
+static inline void serial_swapRecord(struct zui::device::sAttrData &r)
+{
+	serial_field(r.attr_valueOff); serial_field(r.attr_nameId);
+}
+
+static inline void serial_swapRecord(struct zui::device::sMatchTable &r)
+	{ serial_field(r.nBuckets); serial_field(r.nEntries); }
+
+static inline void serial_swapRecord(struct zui::device::sMatchEntry &r)
+	{ serial_field(r.hash); serial_field(r.deviceOff); }
+
+static inline void serial_swapRecord(struct zui::device::sAttrColumns &r)
+{
+	serial_field(r.nRows);
+	serial_field(r.nameIdsOff); serial_field(r.valuesOff);
+	serial_field(r.deviceOffsOff); serial_field(r.typesOff);
+}
+
+static inline void serial_swapRecord(struct zui::driver::sHeader &r)
+{
+	serial_field(r.id); serial_field(r.type);
+	serial_field(r.nameIndex); serial_field(r.supplierIndex);
+	serial_field(r.contactIndex); serial_field(r.categoryIndex);
+	serial_field(r.releaseStringIndex);
+	serial_field(r.requiredUdiVersion);
+	serial_field(r.dataFileOffset); serial_field(r.rankFileOffset);
+	serial_field(r.deviceFileOffset); serial_field(r.provisionFileOffset);
+	serial_field(r.requirementsOffset); serial_field(r.metalanguagesOffset);
+	serial_field(r.childBopsOffset); serial_field(r.parentBopsOffset);
+	serial_field(r.internalBopsOffset); serial_field(r.modulesOffset);
+	serial_field(r.regionsOffset); serial_field(r.messagesOffset);
+	serial_field(r.disasterMessagesOffset);
+	serial_field(r.messageFilesOffset); serial_field(r.readableFilesOffset);
+	serial_field(r.contentHash);
+	serial_field(r.sourcePathOff); serial_field(r.flags);
+	serial_field(r.dataFileLength);
+	serial_field(r.stringFileOffset); serial_field(r.stringFileLength);
+	serial_field(r.messageLocalesOffset); serial_field(r.matchFilter);
+}
+
+static inline void serial_swapRecord(struct zui::driver::sRequirement &r)
+	{ serial_field(r.version); serial_field(r.nameOff); }
+
+static inline void serial_swapRecord(struct zui::driver::sMetalanguage &r)
+	{ serial_field(r.index); serial_field(r.nameOff); }
+
+static inline void serial_swapRecord(struct zui::driver::sChildBop &r)
+{
+	serial_field(r.metaIndex); serial_field(r.regionIndex);
+	serial_field(r.opsIndex);
+}
+
+static inline void serial_swapRecord(struct zui::driver::sParentBop &r)
+{
+	serial_field(r.metaIndex); serial_field(r.regionIndex);
+	serial_field(r.opsIndex); serial_field(r.bindCbIndex);
+}
+
+static inline void serial_swapRecord(struct zui::driver::sInternalBop &r)
+{
+	serial_field(r.metaIndex); serial_field(r.regionIndex);
+	serial_field(r.opsIndex0); serial_field(r.opsIndex1);
+	serial_field(r.bindCbIndex);
+}
+
+static inline void serial_swapRecord(struct zui::driver::sModule &r)
+	{ serial_field(r.index); serial_field(r.fileNameOff); }
+
+static inline void serial_swapRecord(struct zui::driver::sRegion &r)
+{
+	serial_field(r.driverId); serial_field(r.index);
+	serial_field(r.moduleIndex); serial_field(r.flags);
+}
+
+static inline void serial_swapRecord(struct zui::driver::sMessage &r)
+{
+	serial_field(r.driverId); serial_field(r.index);
+	serial_field(r.messageOff); serial_field(r.textOff);
+}
+
+static inline void serial_swapRecord(struct zui::driver::sMessageBlock &r)
+	{ serial_field(r.length); serial_field(r.compressedLength); }
+
+static inline void serial_swapRecord(
+	struct zui::driver::sMessageLocaleDir &r
+	)
+{
+	serial_field(r.nLocales);
+}
+
+static inline void serial_swapRecord(struct zui::driver::sMessageLocale &r)
+{
+	serial_field(r.nameHash); serial_field(r.nameOff);
+	serial_field(r.tableOffset);
+	serial_field(r.firstMessage); serial_field(r.nMessages);
+}
+
+static inline void serial_swapRecord(struct zui::driver::sMessageTable &r)
+	{ serial_field(r.firstIndex); serial_field(r.nSlots); }
+
+static inline void serial_swapRecord(struct zui::driver::sDisasterMessage &r)
+{
+	serial_field(r.driverId); serial_field(r.index);
+	serial_field(r.messageOff);
+}
+
+static inline void serial_swapRecord(struct zui::driver::sMessageFile &r)
+{
+	serial_field(r.driverId); serial_field(r.index);
+	serial_field(r.fileNameOff);
+}
+
+static inline void serial_swapRecord(struct zui::driver::sReadableFile &r)
+{
+	serial_field(r.driverId); serial_field(r.index);
+	serial_field(r.fileNameOff);
+}
+
+static inline void serial_swapRecord(struct zui::driver::sProvision &r)
+{
+	serial_field(r.driverId); serial_field(r.version);
+	serial_field(r.nameOff);
+}
+
+static inline void serial_swapRecord(
+	struct zui::driver::sProvisionDirEntry &r
+	)
+{
+	serial_field(r.nameHash); serial_field(r.version);
+	serial_field(r.driverId); serial_field(r.nameOff);
+}
+
+static inline void serial_swapRecord(struct zui::driver::sClosureTable &r)
+	{ serial_field(r.nDrivers); serial_field(r.nIds); }
+
+static inline void serial_swapRecord(struct zui::driver::sClosure &r)
+{
+	serial_field(r.driverId); serial_field(r.idsIndex);
+	serial_field(r.nIds); serial_field(r.flags);
+}
+
+static inline void serial_swapRecord(struct zui::rank::sHeader &r)
+	{ serial_field(r.driverId); serial_field(r.dataOff); }
+
+static inline void serial_swapRecord(struct zui::rank::sRankAttr &r)
+	{ serial_field(r.nameId); }
+
+static inline void serial_swapRecord(struct zui::container::sHeader &r)
+{
+	serial_field(r.majorVersion); serial_field(r.minorVersion);
+	serial_field(r.fileSize);
+	serial_field(r.nSections); serial_field(r.sectionTableOff);
+	serial_field(r.checksum);
+}
+
+static inline void serial_swapRecord(struct zui::container::sSection &r)
+{
+	serial_field(r.type); serial_field(r.alignment);
+	serial_field(r.offset); serial_field(r.length);
+}
+
+// Swapping is its own inverse, so encoding and decoding are the same thing.
+template <class T>
+static inline void serial_encode(T *rec)
+{
+	if (serialNeedsSwap) { serial_swapRecord(*rec); };
+}
+
+template <class T>
+static inline void serial_decode(T *rec)
+{
+	if (serialNeedsSwap) { serial_swapRecord(*rec); };
+}
+
+/* Appends a copy of a record to a section, in index byte order. This file
+ * is included by zudipropsc.h, after section_append() is declared.
+ **/
+template <class T>
+static inline int serial_append(
+	struct sectionS *s, const T *rec, uint32_t *offset
+	)
+{
+	T	tmp=*rec;
+
+	serial_encode(&tmp);
+	return section_append(s, &tmp, sizeof(tmp), offset);
+}
+
+#endif
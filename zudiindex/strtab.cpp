@@ -0,0 +1,235 @@
+#include "zudipropsc.h"
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+
+/**	EXPLANATION:
+ * Deduplicating string table for strings.zudi-index.
+ *
+ * The same few strings ("udi", "udi_gio", "bus_type", "pci_vendor_id", module
+ * names, etc.) are referenced by almost every driver in the index, so rather
+ * than appending a new copy of a string each time a record refers to it, each
+ * distinct string is stored once and every record that names it reuses its
+ * offset.
+ *
+ * The table lives for the whole run, and is seeded from the existing contents
+ * of strings.zudi-index when the index is opened, so strings are also shared
+ * with drivers that were added by earlier runs. The string section buffer
+ * holds the whole string file, so candidate matches are compared against it.
+ *
+ * Entries are keyed on raw bytes and length. For NUL-terminated strings the
+ * terminator is part of the key, so an entry can be reused by any later
+ * string or ARRAY8 value whose bytes match exactly.
+ *
+ * In the contiguous layout ("--contiguous"), index_writeToDisk() raises the
+ * floor to the end of the string section before it writes each driver out.
+ * A string below the floor belongs to some other driver, so it is appended
+ * again instead of being reused, and the table then points at the new copy.
+ * Every string of the driver thus ends up in its own string extent.
+ **/
+struct strtabEntryS
+{
+	uint32_t	hash, offset, length;
+};
+
+static struct
+{
+	struct sectionS		*section;
+	struct strtabEntryS	*entries;
+	uint32_t		nEntries, nSlots;
+	// Strings below this offset aren't reused.
+	uint32_t		floor;
+} strtab;
+
+static uint32_t strtab_hash(const uint8_t *data, uint32_t len)
+{
+	uint32_t	hash=2166136261u;
+
+	// FNV-1a.
+	for (uint32_t i=0; i<len; i++)
+	{
+		hash ^= data[i];
+		hash *= 16777619u;
+	};
+
+	return hash;
+}
+
+static int strtab_growTable(void)
+{
+	struct strtabEntryS	*old=strtab.entries;
+	uint32_t		oldNSlots=strtab.nSlots, i, slot;
+
+	strtab.nSlots = (oldNSlots == 0) ? 1024 : oldNSlots * 2;
+	strtab.entries = new strtabEntryS[strtab.nSlots];
+	if (strtab.entries == NULL) { return EX_NOMEM; };
+	memset(strtab.entries, 0, sizeof(*strtab.entries) * strtab.nSlots);
+
+	for (i=0; i<oldNSlots; i++)
+	{
+		if (old[i].length == 0) { continue; };
+
+		slot = old[i].hash & (strtab.nSlots - 1);
+		while (strtab.entries[slot].length != 0)
+			{ slot = (slot + 1) & (strtab.nSlots - 1); };
+
+		strtab.entries[slot] = old[i];
+	};
+
+	delete[] old;
+	return EX_SUCCESS;
+}
+
+/* Returns the slot that either holds the matching entry, or the empty slot
+ * where it should be inserted.
+ **/
+static uint32_t strtab_findSlot(
+	const uint8_t *data, uint32_t len, uint32_t hash
+	)
+{
+	uint32_t	slot=hash & (strtab.nSlots - 1);
+
+	for (;; slot = (slot + 1) & (strtab.nSlots - 1))
+	{
+		struct strtabEntryS	*e=&strtab.entries[slot];
+
+		if (e->length == 0) { return slot; };
+		if (e->hash == hash && e->length == len
+			&& !memcmp(&strtab.section->buff[e->offset], data, len))
+		{
+			return slot;
+		};
+	};
+}
+
+static int strtab_insert(uint32_t offset, uint32_t len)
+{
+	uint32_t	hash, slot;
+
+	// Keep the load factor under 1/2.
+	if ((strtab.nEntries + 1) * 2 > strtab.nSlots
+		&& strtab_growTable() != EX_SUCCESS)
+	{
+		return EX_NOMEM;
+	};
+
+	hash = strtab_hash(&strtab.section->buff[offset], len);
+	slot = strtab_findSlot(&strtab.section->buff[offset], len, hash);
+	// Keep the first (lowest) offset if the same string occurs twice.
+	if (strtab.entries[slot].length != 0) { return EX_SUCCESS; };
+
+	strtab.entries[slot].hash = hash;
+	strtab.entries[slot].offset = offset;
+	strtab.entries[slot].length = len;
+	strtab.nEntries++;
+	return EX_SUCCESS;
+}
+
+int strtab_load(struct sectionS *stringS, int fd)
+{
+	uint32_t	fileSize, start, i;
+	ssize_t		nRead;
+
+	/**	EXPLANATION:
+	 * Reads in the current contents of the string file and enters every
+	 * NUL-terminated run of bytes in it into the table. Bytes trailing the
+	 * last NUL (e.g. an unterminated ARRAY8 value) can't be reused as a
+	 * string and are left out.
+	 *
+	 * Must be called before anything is appended to the string section.
+	 * From then on the section covers the whole file, with the existing
+	 * contents marked clean so that only new strings are flushed.
+	 **/
+	strtab_free();
+	strtab.section = stringS;
+	if (strtab_growTable() != EX_SUCCESS) { return EX_NOMEM; };
+
+	fileSize = stringS->base;
+	if (section_reserve(stringS, fileSize) != EX_SUCCESS)
+		{ return EX_NOMEM; };
+
+	stringS->base = 0;
+	stringS->len = stringS->clean = fileSize;
+
+	for (i=0; i<stringS->clean; i += nRead)
+	{
+		nRead = pread(fd, &stringS->buff[i], stringS->clean - i, i);
+		if (nRead < 0 && errno == EINTR) { nRead = 0; continue; };
+		if (nRead <= 0)
+		{
+			fprintf(stderr, "Error: Failed to read in string index.\n");
+			return EX_FILE_IO;
+		};
+	};
+
+	for (start=0, i=0; i<stringS->clean; i++)
+	{
+		if (stringS->buff[i] != '\0') { continue; };
+		if (strtab_insert(start, i - start + 1) != EX_SUCCESS)
+			{ return EX_NOMEM; };
+
+		start = i + 1;
+	};
+
+	return EX_SUCCESS;
+}
+
+int strtab_appendRaw(
+	struct sectionS *stringS, const void *data, uint32_t len,
+	uint32_t *offset
+	)
+{
+	return section_append(stringS, data, len, offset);
+}
+
+int strtab_intern(
+	struct sectionS *stringS, const void *data, uint32_t len,
+	uint32_t *offset
+	)
+{
+	uint32_t	hash, slot;
+	int		ret;
+
+	// Zero-length values have nothing to share; just hand back the end.
+	if (len == 0) { *offset = section_tell(stringS); return EX_SUCCESS; };
+
+	hash = strtab_hash((const uint8_t *)data, len);
+	slot = strtab_findSlot((const uint8_t *)data, len, hash);
+	if (strtab.entries[slot].length != 0
+		&& strtab.entries[slot].offset >= strtab.floor)
+	{
+		*offset = strtab.entries[slot].offset;
+		return EX_SUCCESS;
+	};
+
+	ret = strtab_appendRaw(stringS, data, len, offset);
+	if (ret != EX_SUCCESS) { return ret; };
+
+	// A copy below the floor is superseded by the new one.
+	if (strtab.entries[slot].length != 0)
+	{
+		strtab.entries[slot].offset = *offset;
+		return EX_SUCCESS;
+	};
+
+	return strtab_insert(*offset, len);
+}
+
+int strtab_internString(
+	struct sectionS *stringS, const char *str, uint32_t *offset
+	)
+{
+	return strtab_intern(stringS, str, strlen(str) + 1, offset);
+}
+
+void strtab_setFloor(uint32_t offset)
+{
+	strtab.floor = offset;
+}
+
+void strtab_free(void)
+{
+	delete[] strtab.entries;
+	memset(&strtab, 0, sizeof(strtab));
+}
@@ -0,0 +1,298 @@
+#include "zudipropsc.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+/**	EXPLANATION:
+ * Incremental re-indexing ("--sync").
+ *
+ * Every driver records the absolute path of the file it was compiled from,
+ * and a hash of its udiprops. In sync mode the input list is compared
+ * against the drivers of the same type (driver or metalanguage) that are
+ * already in the index:
+ *	* An input whose path and hash both match a live driver is skipped.
+ *	* An input whose path matches but whose hash doesn't replaces the old
+ *	  driver: the old one is marked removed and the input is compiled.
+ *	* An input with no matching driver is compiled as usual.
+ *	* A live driver whose source file no longer exists is marked removed.
+ *
+ * Removal only sets ZUI_DRIVER_FLAGS_REMOVED in the driver's header, through
+ * a transaction patch, so it commits atomically along with the new drivers.
+ * The dead records stay in the other index files until the index is
+ * compacted; only their entries in the device match table, the provision
+ * directory and the requirement closure table are dropped.
+ **/
+static struct zui::driver::sHeader	*driverHeaders=NULL;
+static uint32_t				nDriverHeaders=0;
+
+static inline uint32_t sync_driverHeaderOffset(uint32_t index)
+{
+	return sizeof(struct zui::sHeader)
+		+ index * sizeof(struct zui::driver::sHeader);
+}
+
+int sync_hashInputFile(const char *fileName, uint64_t *hash)
+{
+	struct stat	st;
+	uint8_t		*image;
+	const char	*props;
+	size_t		propsSize;
+	int		fd, ret=EX_SUCCESS;
+
+	/**	EXPLANATION:
+	 * Text udiprops are hashed whole. For a compiled driver only its
+	 * .udiprops section is hashed, so that a driver that was rebuilt with
+	 * the same properties isn't needlessly re-indexed.
+	 **/
+	fd = open(fileName, O_RDONLY);
+	if (fd < 0) { return EX_INVALID_INPUT_FILE; };
+
+	if (fstat(fd, &st) != 0) { close(fd); return EX_FILE_IO; };
+	if (st.st_size == 0)
+	{
+		close(fd);
+		*hash = hash_fnv1a64(NULL, 0);
+		return EX_SUCCESS;
+	};
+
+	image = (uint8_t *)mmap(
+		NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+	close(fd);
+	if (image == MAP_FAILED) { return EX_FILE_IO; };
+
+	if (parseMode == PARSE_BINARY)
+	{
+		ret = elf_findSection(
+			image, st.st_size, ".udiprops", &props, &propsSize);
+
+		if (ret == EX_SUCCESS)
+			{ *hash = hash_fnv1a64(props, propsSize); };
+	}
+	else { *hash = hash_fnv1a64(image, st.st_size); };
+
+	munmap(image, st.st_size);
+	return ret;
+}
+
+static int sync_loadDriverHeaders(void)
+{
+	ssize_t		nRead;
+	uint32_t	size;
+
+	size = indexHeader.fileSizes[IDXF_DRIVERS] - sizeof(indexHeader);
+	nDriverHeaders = size / sizeof(*driverHeaders);
+	if (nDriverHeaders == 0) { return EX_SUCCESS; };
+
+	driverHeaders = new zui::driver::sHeader[nDriverHeaders];
+	if (driverHeaders == NULL) { return EX_NOMEM; };
+
+	for (uint32_t done=0; done < size; done += nRead)
+	{
+		nRead = pread(
+			indexFds[IDXF_DRIVERS], (uint8_t *)driverHeaders + done,
+			size - done, sizeof(indexHeader) + done);
+
+		if (nRead < 0 && errno == EINTR) { nRead = 0; continue; };
+		if (nRead <= 0) { return EX_FILE_IO; };
+	};
+
+	for (uint32_t i=0; i<nDriverHeaders; i++)
+		{ serial_decode(&driverHeaders[i]); };
+
+	return EX_SUCCESS;
+}
+
+static const char *sync_getSourcePath(struct zui::driver::sHeader *h)
+{
+	struct sectionS		*stringS=&indexSections[IDXF_STRINGS];
+
+	// The string section holds the whole string file after strtab_load().
+	if (h->sourcePathOff >= stringS->len
+		|| memchr(
+			&stringS->buff[h->sourcePathOff], '\0',
+			stringS->len - h->sourcePathOff) == NULL)
+	{
+		return NULL;
+	};
+
+	return (const char *)&stringS->buff[h->sourcePathOff];
+}
+
+int sync_removeDriver(uint32_t index)
+{
+	struct zui::driver::sHeader	*h=&driverHeaders[index];
+	uint32_t			flags;
+
+	h->flags |= ZUI_DRIVER_FLAGS_REMOVED;
+	flags = serial_value(h->flags);
+	if (txn_addPatch(
+		IDXF_DRIVERS,
+		sync_driverHeaderOffset(index)
+			+ offsetof(struct zui::driver::sHeader, flags),
+		&flags, sizeof(flags)) != EX_SUCCESS
+		|| match_removeDevices(h->deviceFileOffset, h->nDevices)
+			!= EX_SUCCESS
+		|| provdir_removeDriver(h->id) != EX_SUCCESS)
+	{
+		return EX_NOMEM;
+	};
+
+	indexHeader.nRecords--;
+	indexHeader.nSupportedDevices -= h->nDevices;
+	indexHeader.nSupportedMetas -= h->nProvisions;
+	return EX_SUCCESS;
+}
+
+static int sync_isLiveCandidate(struct zui::driver::sHeader *h)
+{
+	uint32_t	type;
+
+	type = (propsType == META_PROPS)
+		? zui::driver::DRIVERTYPE_METALANGUAGE
+		: zui::driver::DRIVERTYPE_DRIVER;
+
+	return !(h->flags & ZUI_DRIVER_FLAGS_REMOVED) && h->type == type;
+}
+
+static int sync_comparePaths(const void *a, const void *b)
+{
+	const char	*pa, *pb;
+
+	pa = sync_getSourcePath(&driverHeaders[*(const uint32_t *)a]);
+	pb = sync_getSourcePath(&driverHeaders[*(const uint32_t *)b]);
+	return strcmp(pa, pb);
+}
+
+static int sync_compareKey(const void *key, const void *b)
+{
+	return strcmp(
+		(const char *)key,
+		sync_getSourcePath(&driverHeaders[*(const uint32_t *)b]));
+}
+
+int sync_planUpdate(void)
+{
+	char		resolved[PATH_MAX];
+	const char	*path;
+	uint8_t		*seen;
+	uint32_t	*byPath, nByPath=0, *match, j;
+	uint64_t	hash;
+	int		i, nKept=0, nUnchanged=0, nReplaced=0, nRemoved=0,
+			unchanged, ret;
+
+	if ((ret = sync_loadDriverHeaders()) != EX_SUCCESS)
+	{
+		fprintf(stderr, "Error: Failed to read in driver headers.\n");
+		return ret;
+	};
+
+	seen = (uint8_t *)calloc(nDriverHeaders + 1, 1);
+	byPath = (uint32_t *)malloc(sizeof(*byPath) * (nDriverHeaders + 1));
+	if (seen == NULL || byPath == NULL)
+		{ free(seen); free(byPath); return EX_NOMEM; };
+
+	// Sort the live drivers by source path so inputs can be looked up.
+	for (j=0; j<nDriverHeaders; j++)
+	{
+		if (!sync_isLiveCandidate(&driverHeaders[j])) { continue; };
+
+		path = sync_getSourcePath(&driverHeaders[j]);
+		if (path == NULL || path[0] == '\0') { continue; };
+		byPath[nByPath++] = j;
+	};
+
+	qsort(byPath, nByPath, sizeof(*byPath), sync_comparePaths);
+
+	for (i=0; i<nInputFiles; i++)
+	{
+		/* Inputs that can't be resolved or hashed are left in the list
+		 * so that the compile stage reports them.
+		 **/
+		if (realpath(inputFileNames[i], resolved) == NULL
+			|| sync_hashInputFile(inputFileNames[i], &hash)
+				!= EX_SUCCESS)
+		{
+			inputFileNames[nKept++] = inputFileNames[i];
+			continue;
+		};
+
+		match = (uint32_t *)bsearch(
+			resolved, byPath, nByPath, sizeof(*byPath),
+			sync_compareKey);
+
+		if (match != NULL)
+		{
+			// Step back to the first driver with this path.
+			while (match > byPath
+				&& !sync_compareKey(resolved, match - 1))
+				{ match--; };
+
+			/* If the same file was added more than once, only one
+			 * up to date copy is kept; every other one is removed.
+			 **/
+			unchanged = 0;
+			for (; match < byPath + nByPath
+				&& !sync_compareKey(resolved, match); match++)
+			{
+				if (seen[*match]) { continue; };
+				seen[*match] = 1;
+
+				if (!unchanged
+					&& driverHeaders[*match].contentHash == hash)
+				{
+					unchanged = 1;
+					continue;
+				};
+
+				ret = sync_removeDriver(*match);
+				if (ret != EX_SUCCESS) { goto out; };
+			};
+
+			if (unchanged) { nUnchanged++; continue; };
+			nReplaced++;
+		};
+
+		inputFileNames[nKept++] = inputFileNames[i];
+	};
+
+	// Drop drivers whose source files have disappeared.
+	for (j=0; j<nByPath; j++)
+	{
+		if (seen[byPath[j]]) { continue; };
+
+		path = sync_getSourcePath(&driverHeaders[byPath[j]]);
+		if (access(path, F_OK) == 0) { continue; };
+
+		ret = sync_removeDriver(byPath[j]);
+		if (ret != EX_SUCCESS) { goto out; };
+		nRemoved++;
+	};
+
+	if (verboseMode)
+	{
+		printf("Sync: %d unchanged, %d changed, %d new, %d removed.\n",
+			nUnchanged, nReplaced, nKept - nReplaced, nRemoved);
+	};
+
+	nInputFiles = nKept;
+	ret = EX_SUCCESS;
+
+out:
+	free(byPath);
+	free(seen);
+	return ret;
+}
+
+void sync_free(void)
+{
+	delete[] driverHeaders;
+	driverHeaders = NULL;
+	nDriverHeaders = 0;
+}
@@ -0,0 +1,871 @@
+#include "zudipropsc.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+
+/**	EXPLANATION:
+ * Crash-safe, concurrency-safe updates to the index.
+ *
+ * Every modification of the index happens inside a transaction:
+ *
+ *	txn_begin():
+ *		Takes an exclusive flock() on the index's lock file, so that
+ *		any number of zudiindex processes may safely work on the same
+ *		index; they simply queue up behind each other. Then it finishes
+ *		any update that was interrupted after it committed (see below),
+ *		reads the index header, and truncates every index file back to
+ *		the size recorded in the header, discarding the appends of any
+ *		update that was interrupted before it committed.
+ *
+ *	txn_commit():
+ *		Writes out all of the staged section appends past the committed
+ *		end of each file, and fsync()s them. Nothing refers to these
+ *		bytes yet. Then the new header (with the new committed file sizes
+ *		and record counts), along with any other in-place changes queued
+ *		by txn_addPatch(), is written to a journal file which is fsync()ed
+ *		and renamed into place: this rename is the commit point. Finally
+ *		the patches are applied to the index files and the journal is
+ *		deleted. The new header carries the checksum of every file (see
+ *		crc.cpp), worked out over what the file will hold once the
+ *		patches are applied.
+ *
+ *		devices.zudi-index and provisions.zudi-index are the exception:
+ *		they end with a table (the device match table, see match.cpp,
+ *		and the provision directory, see provdir.cpp) which has to be
+ *		rebuilt behind any new records. So these files are staged anew,
+ *		and replaced the same way that txn_commitRewrite() replaces
+ *		files.
+ *
+ *	txn_commitRewrite():
+ *		Commits an update that rebuilt every index file from scratch
+ *		instead of appending to it (see compact.cpp). The new files are
+ *		staged beside the old ones, and the journal lists them to be
+ *		renamed over the old ones.
+ *
+ *	txn_end():
+ *		Closes the index and drops the lock.
+ *
+ * A run that fails before txn_commit() leaves no trace in the index: driver
+ * IDs are only taken from the in-memory header, and are only consumed when
+ * the header is committed.
+ **/
+struct zui::sHeader		indexHeader;
+
+static_assert(IDXF_N_FILES <= ZUI_HEADER_MAX_NFILES,
+	"The index header has no room for the size of every index file.");
+
+#define TXN_LOCK_FILENAME		"lock.zudi-index"
+#define TXN_JOURNAL_FILENAME		"journal.zudi-index"
+#define TXN_JOURNAL_TMP_FILENAME	"journal.zudi-index.tmp"
+#define TXN_JOURNAL_MAGIC		"ZUIJRNL"
+// Suffix of the staged copy of an index file that a rewrite replaces.
+#define TXN_REWRITE_SUFFIX		".new"
+// Files are read back this many bytes at a time to be checksummed.
+#define TXN_CHECKSUM_CHUNK_SIZE		(1u << 20)
+
+struct txnJournalHeaderS
+{
+	char		magic[8];
+	uint32_t	nPatches, length, checksum;
+};
+
+/* Each patch in the journal is one of these, followed by its data. A WRITE
+ * patch overwrites bytes of an index file in place. A REPLACE patch has no
+ * data; it renames the staged copy of the index file over the original.
+ **/
+enum txnPatchTypeE { TXN_PATCH_WRITE=0, TXN_PATCH_REPLACE };
+
+struct txnJournalPatchS
+{
+	uint32_t	type, fileIndex, offset, length;
+};
+
+struct txnPatchS
+{
+	struct txnPatchS	*next;
+	struct txnJournalPatchS	h;
+	uint8_t			*data;
+};
+
+/* An index file which ends with tables that are rebuilt on every commit.
+ * tableOff and tableLen are the fields of the index header that locate the
+ * first of them; everything from tableOff to the end of the file is
+ * rebuilt, and writeTable() fills in the header fields of any others.
+ **/
+struct txnTrailerS
+{
+	enum indexFileE	fileIndex;
+	uint32_t	*tableOff, *tableLen;
+	int		(*loadCommitted)(int fd);
+	int		(*writeTable)(struct sectionS *s, uint32_t *tableLen);
+};
+
+static const struct txnTrailerS	trailers[] =
+{
+	{
+		IDXF_DEVICES,
+		&indexHeader.matchTableOff, &indexHeader.matchTableLen,
+		&match_loadCommitted, &match_writeTable
+	},
+	{
+		IDXF_PROVISIONS,
+		&indexHeader.provisionDirOff, &indexHeader.provisionDirLen,
+		&provdir_loadCommitted, &provdir_writeTable
+	}
+};
+
+#define TXN_N_TRAILERS		(sizeof(trailers) / sizeof(*trailers))
+
+static int			lockFd=-1;
+static struct txnPatchS		*patchList=NULL, **patchListTail=&patchList;
+
+static uint32_t txn_checksum(const uint8_t *data, uint32_t len)
+{
+	uint32_t	hash=2166136261u;
+
+	// FNV-1a.
+	for (uint32_t i=0; i<len; i++)
+	{
+		hash ^= data[i];
+		hash *= 16777619u;
+	};
+
+	return hash;
+}
+
+static int txn_writeAll(int fd, const void *buff, uint32_t len, off_t off)
+{
+	ssize_t		nWritten;
+
+	while (len > 0)
+	{
+		nWritten = pwrite(fd, buff, len, off);
+		if (nWritten < 0 && errno == EINTR) { continue; };
+		if (nWritten <= 0) { return EX_FILE_IO; };
+
+		buff = (const uint8_t *)buff + nWritten;
+		len -= nWritten;
+		off += nWritten;
+	};
+
+	return EX_SUCCESS;
+}
+
+static int txn_syncIndexDir(void)
+{
+	int		dirFd, ret;
+
+	dirFd = open(indexPath, O_RDONLY | O_DIRECTORY);
+	if (dirFd < 0) { return EX_FILE_OPEN; };
+	ret = fsync(dirFd);
+	close(dirFd);
+	return (ret == 0) ? EX_SUCCESS : EX_FILE_IO;
+}
+
+static void txn_freePatches(void)
+{
+	struct txnPatchS	*tmp;
+
+	while (patchList != NULL)
+	{
+		tmp = patchList;
+		patchList = patchList->next;
+		free(tmp);
+	};
+
+	patchListTail = &patchList;
+}
+
+int txn_addPatch(
+	enum indexFileE fileIndex, uint32_t offset, const void *data,
+	uint32_t length
+	)
+{
+	struct txnPatchS	*patch;
+
+	/**	EXPLANATION:
+	 * Queues an in-place change to already committed bytes of an index
+	 * file. It is journaled along with the header, so it takes effect
+	 * atomically with the rest of the transaction.
+	 **/
+	patch = (struct txnPatchS *)malloc(sizeof(*patch) + length);
+	if (patch == NULL) { return EX_NOMEM; };
+
+	patch->next = NULL;
+	patch->h.type = TXN_PATCH_WRITE;
+	patch->h.fileIndex = fileIndex;
+	patch->h.offset = offset;
+	patch->h.length = length;
+	patch->data = (uint8_t *)(patch + 1);
+	memcpy(patch->data, data, length);
+
+	*patchListTail = patch;
+	patchListTail = &patch->next;
+	return EX_SUCCESS;
+}
+
+// Returns the name of the staged copy of an index file, for a rewrite.
+static char *txn_makeStagedName(char *reallocMem, uint32_t fileIndex)
+{
+	char		*ret, *tmp;
+
+	ret = makeFullName(reallocMem, indexPath, indexFileNames[fileIndex]);
+	if (ret == NULL) { return NULL; };
+
+	tmp = (char *)realloc(
+		ret, strlen(ret) + strlen(TXN_REWRITE_SUFFIX) + 1);
+
+	if (tmp == NULL) { free(ret); return NULL; };
+	strcat(tmp, TXN_REWRITE_SUFFIX);
+	return tmp;
+}
+
+static int txn_replaceFile(uint32_t fileIndex)
+{
+	char		*fullName, *tmpName;
+	int		ret=EX_SUCCESS;
+
+	fullName = makeFullName(NULL, indexPath, indexFileNames[fileIndex]);
+	tmpName = txn_makeStagedName(NULL, fileIndex);
+	if (fullName == NULL || tmpName == NULL)
+		{ free(fullName); free(tmpName); return EX_NOMEM; };
+
+	// If the staged copy is gone, the rename already happened.
+	if (rename(tmpName, fullName) != 0 && errno != ENOENT)
+		{ ret = EX_FILE_IO; };
+
+	free(fullName);
+	free(tmpName);
+	return ret;
+}
+
+/* Writes out the new contents of an index file beside it, and queues the
+ * REPLACE patch that renames it into place.
+ **/
+static int txn_stageFile(
+	uint32_t fileIndex, const uint8_t *buff, uint32_t len
+	)
+{
+	struct txnPatchS	*patch;
+	char			*tmpName;
+	int			fd, ret=EX_FILE_IO;
+
+	tmpName = txn_makeStagedName(NULL, fileIndex);
+	if (tmpName == NULL) { return EX_NOMEM; };
+
+	fd = open(tmpName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd >= 0
+		&& txn_writeAll(fd, buff, len, 0) == EX_SUCCESS
+		&& fsync(fd) == 0)
+	{
+		ret = EX_SUCCESS;
+	};
+
+	if (fd >= 0) { close(fd); };
+	if (ret != EX_SUCCESS)
+	{
+		fprintf(stderr, "Error: Failed to write out %s.\n", tmpName);
+		free(tmpName);
+		return ret;
+	};
+
+	free(tmpName);
+	patch = (struct txnPatchS *)malloc(sizeof(*patch));
+	if (patch == NULL) { return EX_NOMEM; };
+
+	memset(patch, 0, sizeof(*patch));
+	patch->h.type = TXN_PATCH_REPLACE;
+	patch->h.fileIndex = fileIndex;
+	*patchListTail = patch;
+	patchListTail = &patch->next;
+	return EX_SUCCESS;
+}
+
+static int txn_applyJournal(const uint8_t *body, uint32_t nPatches)
+{
+	struct txnJournalPatchS	patch;
+	uint32_t		i;
+	int			nReplaced=0, ret;
+
+	for (i=0; i<nPatches; i++)
+	{
+		memcpy(&patch, body, sizeof(patch));
+		body += sizeof(patch);
+		if (patch.fileIndex >= IDXF_N_FILES) { return EX_GENERAL; };
+
+		if (patch.type == TXN_PATCH_REPLACE)
+		{
+			ret = txn_replaceFile(patch.fileIndex);
+			if (ret != EX_SUCCESS) { return ret; };
+			nReplaced++;
+			continue;
+		};
+
+		if (txn_writeAll(
+			indexFds[patch.fileIndex], body, patch.length,
+			patch.offset) != EX_SUCCESS)
+		{
+			return EX_FILE_IO;
+		};
+
+		body += patch.length;
+	};
+
+	for (i=0; i<IDXF_N_FILES; i++)
+	{
+		if (fsync(indexFds[i]) != 0) { return EX_FILE_IO; };
+	};
+
+	if (nReplaced == 0) { return EX_SUCCESS; };
+
+	// The open descriptors still refer to the files that were replaced.
+	if (txn_syncIndexDir() != EX_SUCCESS) { return EX_FILE_IO; };
+	index_closeFiles();
+	return index_openFiles();
+}
+
+static int txn_recover(void)
+{
+	char				*fullName;
+	struct txnJournalHeaderS	jh;
+	uint8_t				*body=NULL;
+	int				fd, ret=EX_SUCCESS;
+
+	/**	EXPLANATION:
+	 * If a journal exists, the transaction that wrote it had committed
+	 * but may not have finished applying its patches. A journal that is
+	 * incomplete or fails its checksum never committed (the commit point
+	 * is its rename into place), and is just thrown away.
+	 **/
+	fullName = makeFullName(NULL, indexPath, TXN_JOURNAL_FILENAME);
+	if (fullName == NULL) { return EX_NOMEM; };
+
+	fd = open(fullName, O_RDONLY);
+	if (fd < 0)
+	{
+		free(fullName);
+		return (errno == ENOENT) ? EX_SUCCESS : EX_FILE_OPEN;
+	};
+
+	if (pread(fd, &jh, sizeof(jh), 0) == (ssize_t)sizeof(jh)
+		&& !memcmp(jh.magic, TXN_JOURNAL_MAGIC, sizeof(jh.magic))
+		&& (body = (uint8_t *)malloc(jh.length)) != NULL
+		&& pread(fd, body, jh.length, sizeof(jh)) == (ssize_t)jh.length
+		&& txn_checksum(body, jh.length) == jh.checksum)
+	{
+		fprintf(stderr, "Warning: Completing an interrupted index "
+			"update.\n");
+
+		ret = txn_applyJournal(body, jh.nPatches);
+	};
+
+	free(body);
+	close(fd);
+	if (ret == EX_SUCCESS && unlink(fullName) != 0) { ret = EX_FILE_IO; };
+	free(fullName);
+	return ret;
+}
+
+static int txn_writeJournal(void)
+{
+	char				*tmpName, *fullName;
+	struct txnJournalHeaderS	jh;
+	struct txnPatchS		*patch;
+	struct sectionS			body;
+	int				fd, ret;
+
+	memset(&body, 0, sizeof(body));
+	memset(&jh, 0, sizeof(jh));
+	memcpy(jh.magic, TXN_JOURNAL_MAGIC, sizeof(jh.magic));
+
+	for (patch = patchList; patch != NULL; patch = patch->next)
+	{
+		if (section_append(&body, &patch->h, sizeof(patch->h), NULL)
+			!= EX_SUCCESS
+			|| (patch->h.length > 0 && section_append(
+				&body, patch->data, patch->h.length, NULL)
+			!= EX_SUCCESS))
+		{
+			free(body.buff);
+			return EX_NOMEM;
+		};
+
+		jh.nPatches++;
+	};
+
+	jh.length = body.len;
+	jh.checksum = txn_checksum(body.buff, body.len);
+
+	tmpName = makeFullName(NULL, indexPath, TXN_JOURNAL_TMP_FILENAME);
+	fullName = makeFullName(NULL, indexPath, TXN_JOURNAL_FILENAME);
+	if (tmpName == NULL || fullName == NULL)
+	{
+		free(body.buff); free(tmpName); free(fullName);
+		return EX_NOMEM;
+	};
+
+	ret = EX_FILE_IO;
+	fd = open(tmpName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd >= 0
+		&& txn_writeAll(fd, &jh, sizeof(jh), 0) == EX_SUCCESS
+		&& txn_writeAll(fd, body.buff, body.len, sizeof(jh)) == EX_SUCCESS
+		&& fsync(fd) == 0
+		&& rename(tmpName, fullName) == 0
+		&& txn_syncIndexDir() == EX_SUCCESS)
+	{
+		ret = EX_SUCCESS;
+	};
+
+	if (fd >= 0) { close(fd); };
+	free(body.buff);
+	free(tmpName);
+	free(fullName);
+	return ret;
+}
+
+static void txn_unlock(void)
+{
+	if (lockFd < 0) { return; };
+
+	// Closing the lock file's descriptor drops the lock.
+	close(lockFd);
+	lockFd = -1;
+}
+
+static int txn_lock(void)
+{
+	char		*fullName;
+
+	fullName = makeFullName(NULL, indexPath, TXN_LOCK_FILENAME);
+	if (fullName == NULL) { return EX_NOMEM; };
+
+	lockFd = open(fullName, O_RDWR | O_CREAT, 0644);
+	free(fullName);
+	if (lockFd < 0)
+	{
+		fprintf(stderr, "Error: Failed to open index lock file.\n");
+		return EX_FILE_OPEN;
+	};
+
+	while (flock(lockFd, LOCK_EX) != 0)
+	{
+		if (errno == EINTR) { continue; };
+		fprintf(stderr, "Error: Failed to lock index.\n");
+		txn_unlock();
+		return EX_FILE_IO;
+	};
+
+	return EX_SUCCESS;
+}
+
+int txn_begin(void)
+{
+	struct zui::sHeader	rawHeader;
+	struct stat		st;
+	int			i, ret;
+
+	if ((ret = txn_lock()) != EX_SUCCESS) { return ret; };
+
+	if ((ret = index_openFiles()) != EX_SUCCESS)
+		{ txn_unlock(); return ret; };
+
+	if ((ret = txn_recover()) != EX_SUCCESS)
+		{ txn_end(); return ret; };
+
+	if (pread(indexFds[IDXF_DRIVERS], &indexHeader, sizeof(indexHeader), 0)
+		!= (ssize_t)sizeof(indexHeader))
+	{
+		fprintf(stderr, "Error: Failed to read index header.\n");
+		txn_end();
+		return EX_FILE_IO;
+	};
+
+	// Everything after the endianness string is in index byte order.
+	indexHeader.endianness[sizeof(indexHeader.endianness) - 1] = '\0';
+	if (serial_setTargetOrder(indexHeader.endianness) != EX_SUCCESS)
+	{
+		fprintf(stderr, "Error: Index header has an invalid "
+			"endianness.\n");
+
+		txn_end();
+		return EX_NO_INDEX;
+	};
+
+	rawHeader = indexHeader;
+	serial_decode(&indexHeader);
+	if (indexHeader.majorVersion != ZUI_VERSION_MAJOR
+		|| indexHeader.minorVersion != ZUI_VERSION_MINOR)
+	{
+		fprintf(stderr, "Error: Index record format v%d.%d is not "
+			"supported. Re-create the index with -c.\n",
+			indexHeader.majorVersion, indexHeader.minorVersion);
+
+		txn_end();
+		return EX_NO_INDEX;
+	};
+
+	if (crc_checkHeader(&rawHeader) != EX_SUCCESS)
+	{
+		fprintf(stderr, "Error: Index header is corrupt (checksum "
+			"mismatch).\n");
+
+		txn_end();
+		return EX_NO_INDEX;
+	};
+
+	for (i=0; i<IDXF_N_FILES; i++)
+	{
+		if (fstat(indexFds[i], &st) != 0)
+			{ txn_end(); return EX_FILE_IO; };
+
+		if ((uint32_t)st.st_size < indexHeader.fileSizes[i])
+		{
+			fprintf(stderr, "Error: Index file %s is shorter than "
+				"the index header says it is.\n",
+				indexFileNames[i]);
+
+			txn_end();
+			return EX_GENERAL;
+		};
+
+		// Roll back the appends of an update that never committed.
+		if ((uint32_t)st.st_size > indexHeader.fileSizes[i]
+			&& ftruncate(indexFds[i], indexHeader.fileSizes[i]) != 0)
+		{
+			txn_end();
+			return EX_FILE_IO;
+		};
+
+		indexSections[i].base = indexHeader.fileSizes[i];
+	};
+
+	/* New records go in front of the tables at the ends of the files.
+	 * tableOff is where the records end even if the tables are empty.
+	 **/
+	for (i=0; i<(int)TXN_N_TRAILERS; i++)
+	{
+		if ((uint64_t)*trailers[i].tableOff + *trailers[i].tableLen
+			> indexHeader.fileSizes[trailers[i].fileIndex])
+		{
+			fprintf(stderr, "Error: Index header has an invalid "
+				"table offset for %s.\n",
+				indexFileNames[trailers[i].fileIndex]);
+
+			txn_end();
+			return EX_GENERAL;
+		};
+
+		indexSections[trailers[i].fileIndex].base =
+			*trailers[i].tableOff;
+	};
+
+	return EX_SUCCESS;
+}
+
+/* Stages the new copy of an index file that ends with a table: its
+ * committed records, then the ones added by this transaction, then the
+ * rebuilt table.
+ **/
+static int txn_stageTrailer(const struct txnTrailerS *t)
+{
+	struct sectionS		*s=&indexSections[t->fileIndex], staged;
+	int			fd=indexFds[t->fileIndex], ret;
+	uint32_t		recordsEnd=s->base;
+
+	memset(&staged, 0, sizeof(staged));
+	if ((ret = section_reserve(&staged, recordsEnd + s->len))
+		!= EX_SUCCESS)
+	{
+		return ret;
+	};
+
+	if (pread(fd, staged.buff, recordsEnd, 0) != (ssize_t)recordsEnd)
+	{
+		free(staged.buff);
+		return EX_FILE_IO;
+	};
+
+	staged.len = recordsEnd;
+	ret = section_append(&staged, s->buff, s->len, NULL);
+	if (ret == EX_SUCCESS) { ret = t->loadCommitted(fd); };
+
+	if (ret == EX_SUCCESS)
+	{
+		*t->tableOff = staged.len;
+		ret = t->writeTable(&staged, t->tableLen);
+	};
+
+	if (ret == EX_SUCCESS)
+	{
+		indexHeader.fileSizes[t->fileIndex] = staged.len;
+		indexHeader.fileChecksums[t->fileIndex] = crc_compute(
+			0, staged.buff, staged.len);
+
+		ret = txn_stageFile(t->fileIndex, staged.buff, staged.len);
+	};
+
+	free(staged.buff);
+	return ret;
+}
+
+static int txn_isTrailer(int fileIndex)
+{
+	for (uint32_t i=0; i<TXN_N_TRAILERS; i++)
+	{
+		if (trailers[i].fileIndex == fileIndex) { return 1; };
+	};
+
+	return 0;
+}
+
+/* Checksums the committed contents that an index file will have once the
+ * queued patches are applied: the bytes written to it so far, with the
+ * patches laid over them. The index header isn't part of its file's
+ * checksum.
+ **/
+static int txn_checksumFile(int fileIndex, uint32_t *crc)
+{
+	const struct txnPatchS	*p;
+	uint8_t			*buff;
+	uint32_t		off, end=indexHeader.fileSizes[fileIndex], len;
+	uint64_t		pStart, pEnd;
+
+	buff = (uint8_t *)malloc(TXN_CHECKSUM_CHUNK_SIZE);
+	if (buff == NULL) { return EX_NOMEM; };
+
+	off = (fileIndex == IDXF_DRIVERS) ? sizeof(indexHeader) : 0;
+	for (*crc = 0; off < end; off += len)
+	{
+		len = end - off;
+		if (len > TXN_CHECKSUM_CHUNK_SIZE)
+			{ len = TXN_CHECKSUM_CHUNK_SIZE; };
+
+		if (pread(indexFds[fileIndex], buff, len, off) != (ssize_t)len)
+			{ free(buff); return EX_FILE_IO; };
+
+		for (p = patchList; p != NULL; p = p->next)
+		{
+			if (p->h.type != TXN_PATCH_WRITE
+				|| p->h.fileIndex != (uint32_t)fileIndex)
+			{
+				continue;
+			};
+
+			pStart = (p->h.offset > off) ? p->h.offset : off;
+			pEnd = (uint64_t)p->h.offset + p->h.length;
+			if (pEnd > off + len) { pEnd = off + len; };
+			if (pStart >= pEnd) { continue; };
+
+			memcpy(
+				&buff[pStart - off],
+				&p->data[pStart - p->h.offset],
+				pEnd - pStart);
+		};
+
+		*crc = crc_compute(*crc, buff, len);
+	};
+
+	free(buff);
+	return EX_SUCCESS;
+}
+
+int txn_commit(void)
+{
+	struct zui::sHeader	header;
+	char			*fullName;
+	int			i, ret, nReplaced=0;
+
+	if ((ret = index_flushFiles()) != EX_SUCCESS) { return ret; };
+
+	for (i=0; i<IDXF_N_FILES; i++)
+	{
+		if (fsync(indexFds[i]) != 0) { return EX_FILE_IO; };
+		indexHeader.fileSizes[i] = section_tell(&indexSections[i]);
+	};
+
+	for (i=0; i<(int)TXN_N_TRAILERS; i++)
+	{
+		if ((ret = txn_stageTrailer(&trailers[i])) != EX_SUCCESS)
+		{
+			fprintf(stderr, "Error: Failed to write out %s.\n",
+				indexFileNames[trailers[i].fileIndex]);
+
+			txn_freePatches();
+			return ret;
+		};
+	};
+
+	// The files that end with tables were checksummed as they were staged.
+	for (i=0; i<IDXF_N_FILES; i++)
+	{
+		if (txn_isTrailer(i)) { continue; };
+
+		ret = txn_checksumFile(i, &indexHeader.fileChecksums[i]);
+		if (ret != EX_SUCCESS) { txn_freePatches(); return ret; };
+	};
+
+	if ((ret = txn_syncIndexDir()) != EX_SUCCESS)
+		{ txn_freePatches(); return ret; };
+
+	header = indexHeader;
+	serial_encode(&header);
+	crc_sealHeader(&header);
+	ret = txn_addPatch(IDXF_DRIVERS, 0, &header, sizeof(header));
+	if (ret != EX_SUCCESS) { return ret; };
+
+	if ((ret = txn_writeJournal()) != EX_SUCCESS)
+	{
+		fprintf(stderr, "Error: Failed to write index journal.\n");
+		txn_freePatches();
+		return ret;
+	};
+
+	// Committed. If anything fails from here on, txn_recover() redoes it.
+	ret = EX_SUCCESS;
+	for (struct txnPatchS *p = patchList; p != NULL; p = p->next)
+	{
+		if (p->h.type == TXN_PATCH_REPLACE)
+		{
+			if (txn_replaceFile(p->h.fileIndex) != EX_SUCCESS)
+				{ ret = EX_FILE_IO; };
+
+			nReplaced++;
+			continue;
+		};
+
+		if (txn_writeAll(
+			indexFds[p->h.fileIndex], p->data, p->h.length,
+			p->h.offset) != EX_SUCCESS)
+		{
+			ret = EX_FILE_IO;
+		};
+	};
+
+	txn_freePatches();
+	for (i=0; ret == EX_SUCCESS && i<IDXF_N_FILES; i++)
+	{
+		if (fsync(indexFds[i]) != 0) { ret = EX_FILE_IO; };
+	};
+
+	if (ret == EX_SUCCESS && nReplaced > 0) { ret = txn_syncIndexDir(); };
+	if (ret != EX_SUCCESS) { return ret; };
+
+	fullName = makeFullName(NULL, indexPath, TXN_JOURNAL_FILENAME);
+	if (fullName == NULL) { return EX_NOMEM; };
+	unlink(fullName);
+	free(fullName);
+	return EX_SUCCESS;
+}
+
+int txn_commitRewrite(void)
+{
+	struct sectionS		*s;
+	char			*tmpName;
+	uint32_t		start;
+	int			i, ret;
+
+	/**	EXPLANATION:
+	 * Commits a transaction which rewrote the whole index, rather than
+	 * appending to it. Each of indexSections[] must hold the entire new
+	 * contents of its file (base 0), with the drivers section starting
+	 * with room for the index header.
+	 *
+	 * The new files are staged beside the old ones and fsync()ed. The
+	 * journal then lists a REPLACE patch for every file, and once it is
+	 * in place the staged files are renamed over the old ones.
+	 **/
+	for (i=0; i<(int)TXN_N_TRAILERS; i++)
+	{
+		s = &indexSections[trailers[i].fileIndex];
+		*trailers[i].tableOff = section_tell(s);
+		ret = trailers[i].writeTable(s, trailers[i].tableLen);
+		if (ret != EX_SUCCESS) { return ret; };
+	};
+
+	for (i=0; i<IDXF_N_FILES; i++)
+	{
+		s = &indexSections[i];
+		start = (i == IDXF_DRIVERS) ? sizeof(indexHeader) : 0;
+		indexHeader.fileSizes[i] = s->len;
+		indexHeader.fileChecksums[i] = crc_compute(
+			0, s->buff + start, s->len - start);
+	};
+
+	memcpy(
+		indexSections[IDXF_DRIVERS].buff, &indexHeader,
+		sizeof(indexHeader));
+
+	serial_encode((struct zui::sHeader *)indexSections[IDXF_DRIVERS].buff);
+	crc_sealHeader((struct zui::sHeader *)indexSections[IDXF_DRIVERS].buff);
+
+	for (i=0; i<IDXF_N_FILES; i++)
+	{
+		ret = txn_stageFile(
+			i, indexSections[i].buff, indexSections[i].len);
+
+		if (ret != EX_SUCCESS) { txn_freePatches(); return ret; };
+	};
+
+	if ((ret = txn_syncIndexDir()) != EX_SUCCESS
+		|| (ret = txn_writeJournal()) != EX_SUCCESS)
+	{
+		fprintf(stderr, "Error: Failed to write index journal.\n");
+		txn_freePatches();
+		return ret;
+	};
+
+	// Committed. If anything fails from here on, txn_recover() redoes it.
+	for (i=0; i<IDXF_N_FILES; i++)
+	{
+		if ((ret = txn_replaceFile(i)) != EX_SUCCESS) { return ret; };
+	};
+
+	txn_freePatches();
+	if ((ret = txn_syncIndexDir()) != EX_SUCCESS) { return ret; };
+
+	tmpName = makeFullName(NULL, indexPath, TXN_JOURNAL_FILENAME);
+	if (tmpName == NULL) { return EX_NOMEM; };
+	unlink(tmpName);
+	free(tmpName);
+	return EX_SUCCESS;
+}
+
+void txn_end(void)
+{
+	txn_freePatches();
+	match_free();
+	attrcol_free();
+	attrname_free();
+	provdir_free();
+	index_closeFiles();
+	txn_unlock();
+}
+
+int txn_lockForCreate(void)
+{
+	char		*fullName;
+	int		ret;
+
+	/**	EXPLANATION:
+	 * CREATE mode doesn't go through a transaction since it throws away
+	 * the whole index, but it must still wait for any update that is in
+	 * progress to finish first. It also discards any journal left behind
+	 * for the old index. The lock is dropped by txn_unlockForCreate().
+	 **/
+	if ((ret = txn_lock()) != EX_SUCCESS) { return ret; };
+
+	fullName = makeFullName(NULL, indexPath, TXN_JOURNAL_FILENAME);
+	if (fullName == NULL) { txn_unlock(); return EX_NOMEM; };
+	unlink(fullName);
+	free(fullName);
+	return EX_SUCCESS;
+}
+
+void txn_unlockForCreate(void)
+{
+	txn_unlock();
+}
@@ -0,0 +1,771 @@
+#include "zudipropsc.h"
+#include <stdarg.h>
+#include <string.h>
+
+
+/**	EXPLANATION:
+ * Verify mode ("--verify").
+ *
+ * Checks that the index, or the index container given with "--container",
+ * is whole and consistent, without changing anything:
+ *	* The checksum of every index file (see zui.h) matches the one in the
+ *	  index header.
+ *	* The tables at the ends of devices.zudi-index and
+ *	  provisions.zudi-index lie within their files, and are laid out the
+ *	  way their headers say.
+ *	* Every offset of every driver, from its header out to its records in
+ *	  data.zudi-index, its ranks, devices and provisions, and from those
+ *	  on to strings.zudi-index, leads to whole records, or to a string
+ *	  which is terminated within the string file.
+ *
+ * The files are walked through their mappings (see image.cpp): each one is
+ * checksummed in a single pass, and the drivers are then visited in the
+ * order they were written, so the records are read at increasing offsets.
+ * Every problem found is reported, not just the first.
+ **/
+static struct indexImageS	image;
+static uint32_t			nProblems, nAttrNames;
+
+static void verify_report(
+	const struct zui::driver::sHeader *h, const char *fmt, ...
+	)
+{
+	va_list		args;
+
+	nProblems++;
+	if (h == NULL) { fprintf(stderr, "Error: "); }
+	else
+	{
+		fprintf(stderr, "Error: Driver %u (%.*s): ",
+			h->id, ZUI_DRIVER_SHORTNAME_MAXLEN, h->shortName);
+	};
+
+	va_start(args, fmt);
+	vfprintf(stderr, fmt, args);
+	va_end(args);
+	fprintf(stderr, ".\n");
+}
+
+// Whether "n" items of "size" bytes at "offset" are within the file.
+static int verify_inFile(
+	enum indexFileE f, uint32_t offset, uint64_t n, uint32_t size
+	)
+{
+	return offset <= image.sizes[f] && n * size <= image.sizes[f] - offset;
+}
+
+static int verify_string(
+	const struct zui::driver::sHeader *h, uint32_t offset,
+	const char *what
+	)
+{
+	if (image_getString(&image, offset) != NULL) { return 1; };
+
+	verify_report(h, "%s string at 0x%x is out of bounds", what, offset);
+	return 0;
+}
+
+static void verify_checksums(void)
+{
+	uint32_t	start, crc;
+
+	for (int i=0; i<IDXF_N_FILES; i++)
+	{
+		// The index header has a checksum of its own.
+		start = (i == IDXF_DRIVERS) ? sizeof(struct zui::sHeader) : 0;
+		crc = (image.sizes[i] > start)
+			? crc_compute(
+				0, &image.files[i][start],
+				image.sizes[i] - start)
+			: 0;
+
+		if (crc != indexHeader.fileChecksums[i])
+		{
+			verify_report(
+				NULL, "%s is corrupt (checksum 0x%08x, "
+				"expected 0x%08x)",
+				indexFileNames[i], crc,
+				indexHeader.fileChecksums[i]);
+		};
+	};
+}
+
+static int verify_table(
+	enum indexFileE f, uint32_t off, uint32_t len, const char *what
+	)
+{
+	if (verify_inFile(f, off, len, 1)) { return 1; };
+
+	verify_report(NULL, "The %s is out of bounds", what);
+	return 0;
+}
+
+static void verify_matchTable(void)
+{
+	struct zui::device::sMatchTable	t;
+	struct zui::device::sMatchEntry	e;
+	uint32_t			off=indexHeader.matchTableOff;
+	uint64_t			entriesOff;
+
+	if (indexHeader.matchTableLen == 0
+		|| !verify_table(
+			IDXF_DEVICES, off, indexHeader.matchTableLen,
+			"device match table"))
+	{
+		return;
+	};
+
+	if (image_readRecord(&image, IDXF_DEVICES, off, 0, &t) != EX_SUCCESS)
+	{
+		verify_report(NULL, "The device match table is cut short");
+		return;
+	};
+
+	entriesOff = sizeof(t) + ((uint64_t)t.nBuckets + 1) * sizeof(uint32_t);
+	if (entriesOff + (uint64_t)t.nEntries * sizeof(e)
+		!= indexHeader.matchTableLen)
+	{
+		verify_report(NULL, "The device match table's size is wrong");
+		return;
+	};
+
+	for (uint32_t i=0; i<t.nEntries; i++)
+	{
+		if (image_readRecord(
+			&image, IDXF_DEVICES, off + entriesOff, i, &e)
+			!= EX_SUCCESS)
+			{ break; };
+
+		// Device records come before the match table.
+		if ((uint64_t)e.deviceOff + sizeof(struct zui::device::sHeader)
+			> off)
+		{
+			verify_report(
+				NULL, "Match table entry %u points past the "
+				"device records", i);
+		};
+	};
+}
+
+static void verify_attrTables(void)
+{
+	struct zui::device::sAttrColumns	c;
+	struct zui::sAttrNameDict		d;
+	uint32_t				off, len, nameOff;
+	uint64_t				namesOff;
+
+	off = indexHeader.attrColumnsOff;
+	len = indexHeader.attrColumnsLen;
+	if (len > 0
+		&& verify_table(IDXF_DEVICES, off, len, "attribute table"))
+	{
+		if (image_readRecord(&image, IDXF_DEVICES, off, 0, &c)
+			!= EX_SUCCESS
+			|| c.nameIdsOff > len || c.valuesOff > len
+			|| c.deviceOffsOff > len || c.typesOff > len
+			|| (uint64_t)c.nRows * 4 > len - c.nameIdsOff
+			|| (uint64_t)c.nRows * 4 > len - c.valuesOff
+			|| (uint64_t)c.nRows * 4 > len - c.deviceOffsOff
+			|| c.nRows > len - c.typesOff)
+		{
+			verify_report(
+				NULL, "A column of the attribute table is "
+				"out of bounds");
+		};
+	};
+
+	nAttrNames = 0;
+	off = indexHeader.attrNamesOff;
+	len = indexHeader.attrNamesLen;
+	if (len == 0
+		|| !verify_table(
+			IDXF_DEVICES, off, len, "attribute name dictionary"))
+	{
+		return;
+	};
+
+	if (image_readRecord(&image, IDXF_DEVICES, off, 0, &d) != EX_SUCCESS)
+	{
+		verify_report(
+			NULL, "The attribute name dictionary is cut short");
+
+		return;
+	};
+
+	namesOff = sizeof(d)
+		+ ((uint64_t)d.nBuckets + d.nNames) * sizeof(uint32_t);
+
+	if (namesOff + (uint64_t)d.nNames * sizeof(uint32_t) != len)
+	{
+		verify_report(
+			NULL, "The attribute name dictionary's size is wrong");
+
+		return;
+	};
+
+	nAttrNames = d.nNames;
+	for (uint32_t i=0; i<d.nNames; i++)
+	{
+		if (image_readRecord(
+			&image, IDXF_DEVICES, off + namesOff, i, &nameOff)
+			!= EX_SUCCESS)
+			{ break; };
+
+		verify_string(NULL, nameOff, "Attribute name");
+	};
+}
+
+static void verify_provisionTables(void)
+{
+	struct zui::driver::sProvisionDirEntry	e;
+	struct zui::driver::sClosureTable	t;
+	struct zui::driver::sClosure		c;
+	uint32_t				off, len, n, id;
+	uint64_t				idsOff;
+
+	off = indexHeader.provisionDirOff;
+	len = indexHeader.provisionDirLen;
+	if (len > 0
+		&& verify_table(
+			IDXF_PROVISIONS, off, len, "provision directory"))
+	{
+		if (len % sizeof(e) != 0)
+		{
+			verify_report(
+				NULL, "The provision directory's size is "
+				"wrong");
+		};
+
+		n = len / sizeof(e);
+		for (uint32_t i=0; i<n; i++)
+		{
+			if (image_readRecord(
+				&image, IDXF_PROVISIONS, off, i, &e)
+				!= EX_SUCCESS)
+				{ break; };
+
+			verify_string(NULL, e.nameOff, "Provision name");
+		};
+	};
+
+	off = indexHeader.closureTableOff;
+	len = indexHeader.closureTableLen;
+	if (len == 0
+		|| !verify_table(
+			IDXF_PROVISIONS, off, len, "requirement closure table"))
+	{
+		return;
+	};
+
+	if (image_readRecord(&image, IDXF_PROVISIONS, off, 0, &t)
+		!= EX_SUCCESS
+		|| sizeof(t) + (uint64_t)t.nDrivers * sizeof(c)
+			+ (uint64_t)t.nIds * sizeof(uint32_t) != len)
+	{
+		verify_report(
+			NULL, "The requirement closure table's size is wrong");
+
+		return;
+	};
+
+	idsOff = off + sizeof(t) + (uint64_t)t.nDrivers * sizeof(c);
+	for (uint32_t i=0; i<t.nIds; i++)
+	{
+		if (image_readRecord(&image, IDXF_PROVISIONS, idsOff, i, &id)
+			!= EX_SUCCESS)
+			{ break; };
+
+		if (id >= indexHeader.nextDriverId)
+		{
+			verify_report(
+				NULL, "The closure table lists driver %u, "
+				"which doesn't exist", id);
+		};
+	};
+
+	for (uint32_t i=0; i<t.nDrivers; i++)
+	{
+		if (image_readRecord(
+			&image, IDXF_PROVISIONS, off + sizeof(t), i, &c)
+			!= EX_SUCCESS)
+			{ break; };
+
+		if ((uint64_t)c.idsIndex + c.nIds > t.nIds)
+		{
+			verify_report(
+				NULL, "The closure of driver %u is out of "
+				"bounds", c.driverId);
+		};
+	};
+}
+
+/* Checks that "n" records of "size" bytes at "offset" of file "f" are within
+ * the file. Returns 0 if they aren't, so their contents can be skipped.
+ **/
+static int verify_records(
+	const struct zui::driver::sHeader *h, enum indexFileE f,
+	uint32_t offset, uint32_t n, uint32_t size, const char *what
+	)
+{
+	if (verify_inFile(f, offset, n, size)) { return 1; };
+
+	verify_report(
+		h, "%u %s records at 0x%x of %s are out of bounds",
+		n, what, offset, indexFileNames[f]);
+
+	return 0;
+}
+
+static void verify_driverData(const struct zui::driver::sHeader *h)
+{
+	struct zui::driver::sRequirement	req;
+	struct zui::driver::sMetalanguage	meta;
+	struct zui::driver::sModule		mod;
+	struct zui::driver::sDisasterMessage	dis;
+	struct zui::driver::sMessageFile	msgFile;
+	struct zui::driver::sReadableFile	readable;
+
+	verify_records(
+		h, IDXF_DATA, h->dataFileOffset, h->dataFileLength, 1,
+		"data");
+
+	verify_records(
+		h, IDXF_STRINGS, h->stringFileOffset, h->stringFileLength, 1,
+		"string");
+
+	// A driver which wasn't compiled from a file has no source path.
+	if (h->sourcePathOff != 0 || image.sizes[IDXF_STRINGS] > 0)
+		{ verify_string(h, h->sourcePathOff, "Source path"); };
+
+	if (verify_records(
+		h, IDXF_DATA, h->requirementsOffset, h->nRequirements,
+		sizeof(req), "requirement"))
+	{
+		for (int i=0; i<h->nRequirements; i++)
+		{
+			if (image_readRecord(
+				&image, IDXF_DATA, h->requirementsOffset, i,
+				&req) != EX_SUCCESS)
+				{ break; };
+
+			verify_string(h, req.nameOff, "Requirement name");
+		};
+	};
+
+	if (verify_records(
+		h, IDXF_DATA, h->metalanguagesOffset, h->nMetalanguages,
+		sizeof(meta), "metalanguage"))
+	{
+		for (int i=0; i<h->nMetalanguages; i++)
+		{
+			if (image_readRecord(
+				&image, IDXF_DATA, h->metalanguagesOffset, i,
+				&meta) != EX_SUCCESS)
+				{ break; };
+
+			verify_string(h, meta.nameOff, "Metalanguage name");
+		};
+	};
+
+	verify_records(
+		h, IDXF_DATA, h->childBopsOffset, h->nChildBops,
+		sizeof(struct zui::driver::sChildBop), "child bind ops");
+
+	verify_records(
+		h, IDXF_DATA, h->parentBopsOffset, h->nParentBops,
+		sizeof(struct zui::driver::sParentBop), "parent bind ops");
+
+	verify_records(
+		h, IDXF_DATA, h->internalBopsOffset, h->nInternalBops,
+		sizeof(struct zui::driver::sInternalBop),
+		"internal bind ops");
+
+	if (verify_records(
+		h, IDXF_DATA, h->modulesOffset, h->nModules, sizeof(mod),
+		"module"))
+	{
+		for (int i=0; i<h->nModules; i++)
+		{
+			if (image_readRecord(
+				&image, IDXF_DATA, h->modulesOffset, i, &mod)
+				!= EX_SUCCESS)
+				{ break; };
+
+			verify_string(h, mod.fileNameOff, "Module file name");
+		};
+	};
+
+	verify_records(
+		h, IDXF_DATA, h->regionsOffset, h->nRegions,
+		sizeof(struct zui::driver::sRegion), "region");
+
+	if (verify_records(
+		h, IDXF_DATA, h->disasterMessagesOffset, h->nDisasterMessages,
+		sizeof(dis), "disaster message"))
+	{
+		for (int i=0; i<h->nDisasterMessages; i++)
+		{
+			if (image_readRecord(
+				&image, IDXF_DATA, h->disasterMessagesOffset, i,
+				&dis) != EX_SUCCESS)
+				{ break; };
+
+			verify_string(h, dis.messageOff, "Disaster message");
+		};
+	};
+
+	if (verify_records(
+		h, IDXF_DATA, h->messageFilesOffset, h->nMessageFiles,
+		sizeof(msgFile), "message file"))
+	{
+		for (int i=0; i<h->nMessageFiles; i++)
+		{
+			if (image_readRecord(
+				&image, IDXF_DATA, h->messageFilesOffset, i,
+				&msgFile) != EX_SUCCESS)
+				{ break; };
+
+			verify_string(
+				h, msgFile.fileNameOff, "Message file name");
+		};
+	};
+
+	if (verify_records(
+		h, IDXF_DATA, h->readableFilesOffset, h->nReadableFiles,
+		sizeof(readable), "readable file"))
+	{
+		for (int i=0; i<h->nReadableFiles; i++)
+		{
+			if (image_readRecord(
+				&image, IDXF_DATA, h->readableFilesOffset, i,
+				&readable) != EX_SUCCESS)
+				{ break; };
+
+			verify_string(
+				h, readable.fileNameOff, "Readable file name");
+		};
+	};
+}
+
+static void verify_messageTable(
+	const struct zui::driver::sHeader *h,
+	const struct zui::driver::sMessageLocale *loc
+	)
+{
+	struct zui::driver::sMessageTable	t;
+	uint16_t				slot;
+
+	if (image_readRecord(&image, IDXF_DATA, loc->tableOffset, 0, &t)
+		!= EX_SUCCESS)
+	{
+		verify_report(
+			h, "The message table at 0x%x is out of bounds",
+			loc->tableOffset);
+
+		return;
+	};
+
+	if (!verify_records(
+		h, IDXF_DATA, loc->tableOffset + sizeof(t), t.nSlots,
+		sizeof(slot), "message table slot"))
+	{
+		return;
+	};
+
+	for (uint32_t i=0; i<t.nSlots; i++)
+	{
+		if (image_readRecord(
+			&image, IDXF_DATA, loc->tableOffset + sizeof(t), i,
+			&slot) != EX_SUCCESS)
+			{ break; };
+
+		if (slot != ZUI_MESSAGE_TABLE_NONE && slot >= loc->nMessages)
+		{
+			verify_report(
+				h, "Message table slot %u is out of bounds",
+				i);
+		};
+	};
+}
+
+static void verify_messages(const struct zui::driver::sHeader *h)
+{
+	struct zui::driver::sMessage		msg;
+	struct zui::driver::sMessageLocaleDir	dir;
+	struct zui::driver::sMessageLocale	loc;
+	char					text[ZUI_MESSAGE_MAXLEN];
+	uint32_t				off=h->messageLocalesOffset;
+
+	if (verify_records(
+		h, IDXF_DATA, h->messagesOffset, h->nMessages, sizeof(msg),
+		"message"))
+	{
+		for (int i=0; i<h->nMessages; i++)
+		{
+			if (image_readRecord(
+				&image, IDXF_DATA, h->messagesOffset, i, &msg)
+				!= EX_SUCCESS)
+				{ break; };
+
+			if (image_readMessage(
+				&image, h, &msg, text, sizeof(text))
+				!= EX_SUCCESS)
+			{
+				verify_report(
+					h, "The text of message %u is out of "
+					"bounds", msg.index);
+			};
+		};
+	};
+
+	if (off == 0) { return; };
+
+	if (image_readRecord(&image, IDXF_DATA, off, 0, &dir) != EX_SUCCESS)
+	{
+		verify_report(h, "The message locale directory is cut short");
+		return;
+	};
+
+	if (!verify_records(
+		h, IDXF_DATA, off + sizeof(dir), dir.nLocales, sizeof(loc),
+		"message locale"))
+	{
+		return;
+	};
+
+	for (int i=0; i<dir.nLocales; i++)
+	{
+		if (image_readRecord(
+			&image, IDXF_DATA, off + sizeof(dir), i, &loc)
+			!= EX_SUCCESS)
+			{ break; };
+
+		verify_string(h, loc.nameOff, "Locale name");
+		if ((uint32_t)loc.firstMessage + loc.nMessages > h->nMessages)
+		{
+			verify_report(
+				h, "Locale %u's messages are out of bounds",
+				i);
+		};
+
+		if (loc.tableOffset != 0) { verify_messageTable(h, &loc); };
+	};
+}
+
+static void verify_attrName(
+	const struct zui::driver::sHeader *h, uint16_t nameId
+	)
+{
+	if (nameId < nAttrNames) { return; };
+
+	verify_report(h, "Attribute name ID %u is out of bounds", nameId);
+}
+
+static void verify_ranks(const struct zui::driver::sHeader *h)
+{
+	struct zui::rank::sHeader	rank;
+	struct zui::rank::sRankAttr	attr;
+
+	if (!verify_records(
+		h, IDXF_RANKS, h->rankFileOffset, h->nRanks, sizeof(rank),
+		"rank"))
+	{
+		return;
+	};
+
+	for (int i=0; i<h->nRanks; i++)
+	{
+		if (image_readRecord(
+			&image, IDXF_RANKS, h->rankFileOffset, i, &rank)
+			!= EX_SUCCESS)
+			{ break; };
+
+		if (!verify_records(
+			h, IDXF_DATA, rank.dataOff, rank.nAttributes,
+			sizeof(attr), "rank attribute"))
+		{
+			continue;
+		};
+
+		for (int j=0; j<rank.nAttributes; j++)
+		{
+			if (image_readRecord(
+				&image, IDXF_DATA, rank.dataOff, j, &attr)
+				!= EX_SUCCESS)
+				{ break; };
+
+			verify_attrName(h, attr.nameId);
+		};
+	};
+}
+
+static void verify_deviceAttr(
+	const struct zui::driver::sHeader *h,
+	const struct zui::device::sAttrData *attr
+	)
+{
+	verify_attrName(h, attr->attr_nameId);
+	if (attr->attr_type == UDI_ATTR_STRING)
+		{ verify_string(h, attr->attr_valueOff, "Attribute value"); };
+
+	if (attr->attr_type == UDI_ATTR_ARRAY8)
+	{
+		verify_records(
+			h, IDXF_STRINGS, attr->attr_valueOff,
+			attr->attr_length, 1, "attribute value");
+	};
+}
+
+static void verify_devices(const struct zui::driver::sHeader *h)
+{
+	struct zui::device::sHeader	dev;
+	struct zui::device::sAttrData	attr;
+
+	// Device records come before the match table.
+	if (!verify_records(
+		h, IDXF_DEVICES, h->deviceFileOffset, h->nDevices, sizeof(dev),
+		"device"))
+	{
+		return;
+	};
+
+	if ((uint64_t)h->deviceFileOffset + h->nDevices * sizeof(dev)
+		> indexHeader.matchTableOff)
+	{
+		verify_report(h, "Its devices overlap the device match table");
+	};
+
+	for (int i=0; i<h->nDevices; i++)
+	{
+		if (image_readRecord(
+			&image, IDXF_DEVICES, h->deviceFileOffset, i, &dev)
+			!= EX_SUCCESS)
+			{ break; };
+
+		if (dev.driverId != h->id)
+		{
+			verify_report(
+				h, "Device %u belongs to driver %u", i,
+				dev.driverId);
+		};
+
+		if (!verify_records(
+			h, IDXF_DATA, dev.dataOff, dev.nAttributes,
+			sizeof(attr), "device attribute"))
+		{
+			continue;
+		};
+
+		for (int j=0; j<dev.nAttributes; j++)
+		{
+			if (image_readRecord(
+				&image, IDXF_DATA, dev.dataOff, j, &attr)
+				!= EX_SUCCESS)
+				{ break; };
+
+			verify_deviceAttr(h, &attr);
+		};
+	};
+}
+
+static void verify_provisions(const struct zui::driver::sHeader *h)
+{
+	struct zui::driver::sProvision	prov;
+
+	if (!verify_records(
+		h, IDXF_PROVISIONS, h->provisionFileOffset, h->nProvisions,
+		sizeof(prov), "provision"))
+	{
+		return;
+	};
+
+	if ((uint64_t)h->provisionFileOffset + h->nProvisions * sizeof(prov)
+		> indexHeader.provisionDirOff)
+	{
+		verify_report(
+			h, "Its provisions overlap the provision directory");
+	};
+
+	for (int i=0; i<h->nProvisions; i++)
+	{
+		if (image_readRecord(
+			&image, IDXF_PROVISIONS, h->provisionFileOffset, i,
+			&prov) != EX_SUCCESS)
+			{ break; };
+
+		verify_string(h, prov.nameOff, "Provision name");
+	};
+}
+
+int verify_checkIndex(void)
+{
+	struct zui::driver::sHeader	h;
+	uint32_t			nDrivers, nLive=0;
+	uint64_t			nBytes=0;
+	int				ret;
+
+	ret = (containerFileName != NULL)
+		? image_mapContainer(&image, containerFileName)
+		: image_map(&image);
+
+	if (ret != EX_SUCCESS) { return ret; };
+
+	nProblems = 0;
+	verify_checksums();
+	verify_matchTable();
+	verify_attrTables();
+	verify_provisionTables();
+
+	nDrivers = image_getNDrivers(&image);
+	if (image.sizes[IDXF_DRIVERS] - sizeof(struct zui::sHeader)
+		!= nDrivers * sizeof(h))
+	{
+		verify_report(NULL, "%s ends in part of a driver record",
+			indexFileNames[IDXF_DRIVERS]);
+	};
+
+	for (uint32_t i=0; i<nDrivers; i++)
+	{
+		if (image_readRecord(
+			&image, IDXF_DRIVERS, sizeof(struct zui::sHeader), i,
+			&h) != EX_SUCCESS)
+			{ break; };
+
+		if (!(h.flags & ZUI_DRIVER_FLAGS_REMOVED)) { nLive++; };
+		if (h.id >= indexHeader.nextDriverId)
+		{
+			verify_report(
+				&h, "Its ID is past the index's next driver "
+				"ID, %u", indexHeader.nextDriverId);
+		};
+
+		verify_driverData(&h);
+		verify_messages(&h);
+		verify_ranks(&h);
+		verify_devices(&h);
+		verify_provisions(&h);
+	};
+
+	if (nLive != indexHeader.nRecords)
+	{
+		verify_report(
+			NULL, "The index header counts %u drivers, but %u are "
+			"in the index", indexHeader.nRecords, nLive);
+	};
+
+	for (int i=0; i<IDXF_N_FILES; i++) { nBytes += image.sizes[i]; };
+	image_unmap(&image);
+
+	if (nProblems > 0)
+	{
+		fprintf(stderr, "Error: Found %u problems in the index.\n",
+			nProblems);
+
+		return EX_GENERAL;
+	};
+
+	printf("The index is intact: %u drivers, %llu bytes.\n",
+		nLive, (unsigned long long)nBytes);
+
+	return EX_SUCCESS;
+}
@@ -5,6 +5,9 @@
 #include <cstdlib>
 #include <iostream>
 #include <iomanip>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include "zudipropsc.h"
 
@@ -17,41 +20,119 @@
  *
  * Mode 1: "Kernel-index":
  *	This mode is meant to be used when building the Zambesii kernel itself.
- *	It will take the name of an input file (second argument) which contains
- *	a newline separated list of udiprops files.
+ *	It will take the name of an input file (-A <list-file>) which contains
+ *	a newline separated list of udiprops files. Any number of "-a <file>"
+ *	arguments may be given as well, or instead.
  *
- *	It will then parse each of these udiprops files, building an index of
- *	unified driver properties which it will then dump in a format
- *	appropriate for the Zambesii kernel. The output files will constitute
- *	the in-kernel-driver index.
+ *	It will then parse each of these udiprops files in a single run,
+ *	building an index of unified driver properties which it will then dump
+ *	in a format appropriate for the Zambesii kernel. The index files are
+ *	opened and their header is read and written back only once per run.
+ *	The output files will constitute the in-kernel-driver index.
+ *
+ *	Each run is a single transaction (see transaction.cpp): either every
+ *	driver in the run is added, or the index is left untouched. Several
+ *	zudiindex processes may be run on the same index in parallel.
+ *
+ *	With "-j <n>", the udiprops files are parsed on <n> threads at once
+ *	and merged into the index in input order; the output is identical to
+ *	that of a single threaded run.
+ *
+ *	With "--sync", the run brings the index up to date with its inputs
+ *	instead: unchanged inputs are skipped and changed ones replace their
+ *	old drivers (see sync.cpp).
+ *
+ *	"-r <shortname|driver-id|*>" removes the matching drivers (only those
+ *	with the base path given by "-b", if any) and compacts the index, so
+ *	that none of their records are left behind (see compact.cpp).
+ *
+ *	With "--contiguous", every driver that the run writes out gets its own
+ *	copy of each string it uses, right beside its other strings, instead
+ *	of sharing strings with the drivers before it (see strtab.cpp). It
+ *	can be given with "-a" and "-A", or with "-r", which writes out every
+ *	driver that it keeps.
+ *
+ *	"--compress-messages" works the same way, and stores the text of each
+ *	driver's messages in small compressed blocks in data.zudi-index,
+ *	rather than in strings.zudi-index (see driver::sMessageBlock).
+ *
+ *	"-l <shortname|driver-id|*>" lists the matching drivers and their
+ *	records (see list.cpp). The listing can be narrowed with "-b", and
+ *	with "--uses-meta <name>", "--provides <name>" and
+ *	"--attr <name>=<value>". With "--container <file>", it lists the
+ *	drivers in an index container instead, and needs no index directory.
+ *
+ *	"-p <container-file>" packs the index into a single index container
+ *	file, which can be loaded with one mmap() (see pack.cpp).
+ *
+ *	"--verify" checks the checksums of the index files, and every offset
+ *	in them, without changing anything (see verify.cpp). With
+ *	"--container <file>", it checks an index container instead.
  *
  * Mode 2: "User-index":
  *	This mode of operation is meant to be used when building the userspace
- *	driver index, or the kernel's ram-disk's index. It will take an input
- *	file (second argument) which contains a newline-separated list of
- *	already-compiled binary UDI drivers.
+ *	driver index, or the kernel's ram-disk's index. It is selected with
+ *	"-bin", and takes its input files the same way as mode 1, except that
+ *	they are already-compiled binary UDI drivers (ELF32 or ELF64, of either
+ *	byte order).
  *
- *	Each of these drivers will be opened, and their .udiprops section read,
- *	and the index will be built from these binary UDI drivers.
+ *	Each of these drivers will be mapped in, and their .udiprops section
+ *	parsed in place, and the index will be built from these binary UDI
+ *	drivers.
  **/
 #define UDIPROPS_LINE_MAXLEN		(512)
 
-static const char *usageMessage = "Usage:\n\tzudiindex -<c|a|l|r> "
-					"<file|endianness> "
-					"[-txt|-bin] "
+static const char *usageMessage = "Usage:\n\tzudiindex -<c|a|A|l|r|p> "
+					"<file|list-file|endianness> "
+					"[-a <file>...] [-txt|-bin] [-j <n>]"
 					" [-i <index-dir>] [-b <base-path>]\n"
+					"Note: -j compiles with <n> threads, or "
+					"one per CPU if <n> is 0.\n"
+					"Note: --sync only compiles new and "
+					"changed inputs, and removes drivers "
+					"whose sources are gone.\n"
+					"Note: -r takes a driver shortname, "
+					"driver ID or \"*\", and may be "
+					"narrowed with -b.\n"
+					"Note: --contiguous stores the strings "
+					"of each driver added by -a, -A or -r "
+					"beside each other, unshared.\n"
+					"Note: --compress-messages stores the "
+					"messages of the drivers that -a, -A "
+					"or -r write in compressed blocks.\n"
+					"Note: -l takes the same argument as -r, "
+					"and may be narrowed with -b, "
+					"--uses-meta <name>, --provides <name> "
+					"and --attr <name>=<value>; "
+					"--container <file> lists an index "
+					"container instead.\n"
+					"Note: -p takes the name of the index "
+					"container file to write.\n"
+					"Note: --verify checks the index, or "
+					"the index container given with "
+					"--container <file>.\n"
+					"Note: -A takes a newline separated list "
+					"of input files, or \"-\" for stdin.\n"
 					"Note: For --printsizes, include one "
 					"or more dummy arguments";
 
 enum parseModeE		parseMode=PARSE_NONE;
 enum programModeE	programMode=MODE_NONE;
 enum propsTypeE		propsType=DRIVER_PROPS;
-int			hasRequiresUdi=0, hasRequiresUdiPhysio=0, verboseMode=0,
-			ignoreInvalidBasePath=0;
-
-const char		*indexPath=NULL, *basePath=NULL, *inputFileName=NULL;
-char			propsLineBuffMem[515];
-char			verboseBuff[1024];
+int			verboseMode=0, ignoreInvalidBasePath=0, syncMode=0,
+			// Keep the strings of each driver together; see strtab.cpp.
+			contiguousLayout=0,
+			// Store message text in compressed blocks; see zui.h.
+			compressMessages=0,
+			// Number of compile threads to use in ADD mode.
+			nJobs=1;
+
+const char		*indexPath=NULL, *basePath=NULL, *inputFileName=NULL,
+			*listFileName=NULL, *containerFileName=NULL;
+// Every input file to be added to the index in this run.
+const char		**inputFileNames=NULL;
+int			nInputFiles=0;
+static struct listFiltersS	listFilters;
 
 static void parseCommandLine(int argc, char **argv)
 {
@@ -71,6 +152,57 @@ static void parseCommandLine(int argc, char **argv)
 
 		if (!strcmp(argv[i], "--ignore-invalid-basepath"))
 			{ ignoreInvalidBasePath = 1; continue; };
+
+		if (!strcmp(argv[i], "--sync"))
+			{ syncMode = 1; continue; };
+
+		if (!strcmp(argv[i], "--contiguous"))
+			{ contiguousLayout = 1; continue; };
+
+		if (!strcmp(argv[i], "--compress-messages"))
+			{ compressMessages = 1; continue; };
+
+		if (!strcmp(argv[i], "--uses-meta") && i + 1 < argc)
+			{ listFilters.meta = argv[++i]; continue; };
+
+		if (!strcmp(argv[i], "--container") && i + 1 < argc)
+			{ containerFileName = argv[++i]; continue; };
+
+		if (!strcmp(argv[i], "--provides") && i + 1 < argc)
+			{ listFilters.provision = argv[++i]; continue; };
+
+		if (!strcmp(argv[i], "--attr") && i + 1 < argc)
+		{
+			char	*value;
+
+			listFilters.attrName = argv[++i];
+			value = strchr(argv[i], '=');
+			if (value == NULL)
+			{
+				exit(printAndReturn(
+					argv[0], "--attr takes <name>=<value>",
+					EX_BAD_COMMAND_LINE));
+			};
+
+			*value = '\0';
+			listFilters.attrValue = value + 1;
+			continue;
+		};
+
+		if (!strcmp(argv[i], "-j") && i + 1 < argc)
+		{
+			nJobs = atoi(argv[++i]);
+			// "-j 0" uses one thread per online CPU.
+			if (nJobs == 0) { nJobs = sysconf(_SC_NPROCESSORS_ONLN); };
+			if (nJobs < 1)
+			{
+				exit(printAndReturn(
+					argv[0], "Invalid number of jobs",
+					EX_BAD_COMMAND_LINE));
+			};
+
+			continue;
+		};
 	};
 
 	// First find out the action we are to carry out.
@@ -80,7 +212,7 @@ static void parseCommandLine(int argc, char **argv)
 		if (!strcmp(argv[i], "--printsizes"))
 			{ programMode = MODE_PRINT_SIZES; return; };
 
-		if (!strcmp(argv[i], "-a"))
+		if (!strcmp(argv[i], "-a") || !strcmp(argv[i], "-A"))
 			{ programMode = MODE_ADD; break; };
 
 		if (!strcmp(argv[i], "-l"))
@@ -91,6 +223,12 @@ static void parseCommandLine(int argc, char **argv)
 
 		if (!strcmp(argv[i], "-c"))
 			{ programMode = MODE_CREATE; break; };
+
+		if (!strcmp(argv[i], "-p"))
+			{ programMode = MODE_PACK; break; };
+
+		if (!strcmp(argv[i], "--verify"))
+			{ programMode = MODE_VERIFY; break; };
 	};
 
 	actionArgIndex = i;
@@ -121,26 +259,40 @@ static void parseCommandLine(int argc, char **argv)
 	};
 
 	/* If no mode was detected or if the index of the action switch was
-	 * invalid (that is, it overflows "argc"), we exit the program.
+	 * invalid (that is, it overflows "argc"), we exit the program. VERIFY
+	 * is the only mode whose switch takes no argument.
 	 **/
-	if (programMode == MODE_NONE || actionArgIndex + 1 >= argc)
+	if (programMode == MODE_NONE
+		|| (programMode != MODE_VERIFY && actionArgIndex + 1 >= argc))
 	{
 		exit(
 			printAndReturn(
 				argv[0], usageMessage, EX_BAD_COMMAND_LINE));
 	};
 
-	inputFileName = argv[actionArgIndex + 1];
+	if (programMode != MODE_VERIFY)
+		{ inputFileName = argv[actionArgIndex + 1]; };
 
-	// In list mode, no more than 5 arguments are valid.
-	if (programMode == MODE_LIST)
+	/* ADD mode accepts any number of "-a <file>" pairs, and/or a list file
+	 * via "-A <list-file>". They are all compiled into the index in a
+	 * single run.
+	 **/
+	if (programMode == MODE_ADD)
 	{
-		if (argc > 5)
+		inputFileNames = (const char **)malloc(sizeof(*inputFileNames) * argc);
+		if (inputFileNames == NULL)
 		{
-			exit(
-				printAndReturn(
-					argv[0], usageMessage,
-					EX_BAD_COMMAND_LINE));
+			exit(printAndReturn(
+				argv[0], "Out of memory", EX_NOMEM));
+		};
+
+		for (i=1; i<argc - 1; i++)
+		{
+			if (!strcmp(argv[i], "-a"))
+				{ inputFileNames[nInputFiles++] = argv[++i]; continue; };
+
+			if (!strcmp(argv[i], "-A"))
+				{ listFileName = argv[++i]; continue; };
 		};
 	};
 
@@ -165,7 +317,7 @@ static void parseCommandLine(int argc, char **argv)
 	else { indexPath = argv[indexPathArgIndex + 1]; };
 
 	// CREATE mode only needs the endianness and the index path.
-	if (programMode == MODE_CREATE || programMode == MODE_LIST) { return; };
+	if (programMode == MODE_CREATE) { return; };
 
 	if (basePathArgIndex == -1 && programMode == MODE_ADD)
 	{
@@ -178,7 +330,7 @@ static void parseCommandLine(int argc, char **argv)
 	};
 
 	if (basePathArgIndex != -1) { basePath = argv[basePathArgIndex + 1]; };
-	// basepath is required in ADD and accepted in REMOVE.
+	// basepath is required in ADD and accepted in LIST and REMOVE.
 	if (basePath != NULL && strlen(basePath) >= ZUI_DRIVER_BASEPATH_MAXLEN)
 	{
 		std::cout <<"This program accepts basepaths with up to "
@@ -245,6 +397,17 @@ static int createMode(int argc, char **argv)
 
 	// The rest of the fields can remain blank for now.
 	strcpy(indexHeader->endianness, inputFileName);
+	indexHeader->majorVersion = ZUI_VERSION_MAJOR;
+	indexHeader->minorVersion = ZUI_VERSION_MINOR;
+	indexHeader->fileSizes[IDXF_DRIVERS] = sizeof(*indexHeader);
+
+	// Every file is empty, so every file checksum is 0.
+	serial_setTargetOrder(indexHeader->endianness);
+	serial_encode(indexHeader);
+	crc_sealHeader(indexHeader);
+
+	// Wait for any update of the old index that is in progress.
+	if (txn_lockForCreate() != EX_SUCCESS) { return EX_FILE_IO; };
 
 	for (i=0; indexFileNames[i] != NULL; i++)
 	{
@@ -255,6 +418,7 @@ static int createMode(int argc, char **argv)
 			std::cerr <<"Error: Failed to create index file "
 				<<fullName <<" .\n";
 
+			txn_unlockForCreate();
 			return EX_FILE_OPEN;
 		};
 
@@ -272,29 +436,14 @@ static int createMode(int argc, char **argv)
 			std::cerr <<"Error: Failed to write index header "
 				"to driver index file.\n";
 
+			txn_unlockForCreate();
 			return EX_FILE_IO;
 		};
 
 		fclose(currFile);
 	};
 
-	return EXIT_SUCCESS;
-}
-
-static int binaryParse(FILE *propsFile, char *propsLineBuff)
-{
-	(void) propsFile;
-	(void) propsLineBuff;
-	/**	EXPLANATION:
-	 * In user-index mode, the filenames in the list file are all compiled
-	 * UDI driver binaries. They contain udiprops within their .udiprops
-	 * executable section. This function will be called once for each driver
-	 * in the list.
-	 *
-	 * Open the driver file, parse the ELF headers to find the offset and
-	 * length of the .udiprops section, extract it from the driver file
-	 * and then parse it into the index before returning.
-	 **/
+	txn_unlockForCreate();
 	return EXIT_SUCCESS;
 }
 
@@ -373,13 +522,43 @@ static void verboseModePrint(
 
 }
 
-static int textParse(FILE *propsFile, char *propsLineBuff)
+/* Runs one complete, stripped line through the parser and collects the
+ * object it yields. Returns EX_PARSE_ERROR if the line is bad.
+ **/
+static int parseOneLine(
+	struct parserContextS *ctxt, const char *line, int logicalLineNo
+	)
+{
+	enum parser_lineTypeE	lineType;
+	void			*indexObj;
+
+	lineType = parser_parseLine(ctxt, line, &indexObj);
+
+	if (verboseMode)
+	{
+		verboseModePrint(
+			lineType, logicalLineNo, ctxt->verboseBuff, line);
+	};
+
+	if (isBadLineType(lineType))
+	{
+		printBadLineType(lineType, logicalLineNo);
+		return EX_PARSE_ERROR;
+	};
+
+	if (index_insert(ctxt, lineType, indexObj) != EX_SUCCESS)
+		{ return EX_PARSE_ERROR; };
+
+	return EX_SUCCESS;
+}
+
+static int textParse(struct parserContextS *ctxt, FILE *propsFile)
 {
+	char		*propsLineBuff=ctxt->propsLineBuff;
 	int		logicalLineNo, lineSegmentLength, buffIndex,
 			isMultiline, lineLength;
 	char		*comment;
-	enum parser_lineTypeE	lineType=LT_MISC;
-	void			*indexObj, *ptr;
+	void		*ptr;
 	(void) ptr;
 
 	/**	EXPLANATION:
@@ -451,184 +630,613 @@ static int textParse(FILE *propsFile, char *propsLineBuff)
 
 		// Don't waste time calling the parser on 0 length lines.
 		if (lineLength < 2) { continue; };
-		lineType = parser_parseLine(propsLineBuff, &indexObj);
-
-		if (verboseMode)
+		if (parseOneLine(ctxt, propsLineBuff, logicalLineNo)
+			!= EX_SUCCESS)
 		{
-			verboseModePrint(
-				lineType, logicalLineNo, verboseBuff,
-				propsLineBuff);
+			break;
 		};
+	} while (!feof(propsFile));
+
+	return (feof(propsFile)) ? EX_SUCCESS : EX_PARSE_ERROR;
+}
+
+static int binaryParse(struct parserContextS *ctxt, FILE *propsFile)
+{
+	struct stat	st;
+	uint8_t		*image;
+	const char	*props, *line, *end, *next;
+	size_t		propsSize, lineLength;
+	int		logicalLineNo, ret;
+
+	/**	EXPLANATION:
+	 * In user-index mode, the input files are all compiled UDI driver
+	 * binaries. They contain their udiprops within their .udiprops ELF
+	 * section, one NUL-terminated statement after another, already
+	 * stripped of comments and line continuations.
+	 *
+	 * The driver is mapped in rather than read, and its statements are
+	 * handed to the parser straight out of the mapping. Only a final
+	 * statement which lacks its NUL terminator has to be copied out.
+	 **/
+	if (fstat(fileno(propsFile), &st) != 0) { return EX_FILE_IO; };
+	if (st.st_size == 0) { return EX_INVALID_INPUT_FILE; };
+
+	image = (uint8_t *)mmap(
+		NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(propsFile), 0);
+
+	if (image == MAP_FAILED) { return EX_FILE_IO; };
+
+	ret = elf_findSection(
+		image, st.st_size, ".udiprops", &props, &propsSize);
+
+	if (ret != EX_SUCCESS)
+	{
+		std::cerr <<((ret == EX_PARSE_ERROR)
+			? "Error: Driver has no .udiprops section.\n"
+			: "Error: Driver is not a valid ELF file.\n");
+
+		munmap(image, st.st_size);
+		return ret;
+	};
 
-		if (isBadLineType(lineType))
+	end = props + propsSize;
+	for (line = props, logicalLineNo = 1; line < end;
+		line = next + 1, logicalLineNo++)
+	{
+		next = (const char *)memchr(line, '\0', end - line);
+		lineLength = ((next != NULL) ? next : end) - line;
+		if (lineLength > UDIPROPS_LINE_MAXLEN)
 		{
-			printBadLineType(lineType, logicalLineNo);
+			printBadLineType(LT_OVERFLOW, logicalLineNo);
+			ret = EX_PARSE_ERROR;
 			break;
 		};
 
-		if (index_insert(lineType, indexObj) != EX_SUCCESS) { break; };
-	} while (!feof(propsFile));
+		if (next == NULL)
+		{
+			memcpy(ctxt->propsLineBuff, line, lineLength);
+			ctxt->propsLineBuff[lineLength] = '\0';
+			line = ctxt->propsLineBuff;
+			next = end;
+		};
 
-	return (feof(propsFile)) ? EX_SUCCESS : EX_PARSE_ERROR;
+		// Sections are often padded out with NULs.
+		if (lineLength == 0) { continue; };
+		ret = parseOneLine(ctxt, line, logicalLineNo);
+		if (ret != EX_SUCCESS) { break; };
+	};
+
+	munmap(image, st.st_size);
+	return ret;
 }
 
-int incrementNRecords(uint32_t nSupportedDevices, uint32_t nSupportedMetas)
+static int readInputList(const char *fileName)
 {
-	FILE				*dhFile;
-	struct zui::sHeader		*header;
-	char				*fullName=NULL;
+	FILE		*listFile;
+	char		line[PATH_MAX + 2], *name;
+	int		len, capacity=nInputFiles;
+
+	/**	EXPLANATION:
+	 * Reads a newline separated list of input files and appends each of
+	 * them to inputFileNames[]. Empty lines are skipped. A list file name
+	 * of "-" reads the list from stdin.
+	 **/
+	listFile = (!strcmp(fileName, "-")) ? stdin : fopen(fileName, "r");
+	if (listFile == NULL)
+	{
+		std::cerr <<"Error: Failed to open list file " <<fileName <<".\n";
+		return EX_INVALID_INPUT_FILE;
+	};
+
+	while (fgets(line, sizeof(line), listFile) != NULL)
+	{
+		len = strlen(line);
+		while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+			{ line[--len] = '\0'; };
+
+		if (len == 0) { continue; };
+
+		if (nInputFiles >= capacity)
+		{
+			capacity = (capacity < 16) ? 32 : capacity * 2;
+			inputFileNames = (const char **)realloc(
+				inputFileNames, sizeof(*inputFileNames) * capacity);
+
+			if (inputFileNames == NULL) { return EX_NOMEM; };
+		};
+
+		name = strdup(line);
+		if (name == NULL) { return EX_NOMEM; };
+		inputFileNames[nInputFiles++] = name;
+	};
+
+	if (listFile != stdin) { fclose(listFile); };
+	return EX_SUCCESS;
+}
+
+/**	EXPLANATION:
+ * The index header is read by txn_begin() and only written back when the
+ * transaction commits. In between, driver IDs and record counts are just
+ * bumped in the in-memory copy, so a run that fails never burns any IDs.
+ **/
+static void incrementNRecords(
+	uint32_t nSupportedDevices, uint32_t nSupportedMetas
+	)
+{
+	indexHeader.nRecords++;
+	indexHeader.nSupportedDevices += nSupportedDevices;
+	indexHeader.nSupportedMetas += nSupportedMetas;
+}
+
+static uint32_t reserveDriverIds(int nDrivers)
+{
+	uint32_t	ret=indexHeader.nextDriverId;
+
+	/* Each input file's driver ID is fixed by its position in the input
+	 * list, so that drivers may be parsed in any order.
+	 **/
+	indexHeader.nextDriverId += nDrivers;
+	return ret;
+}
 
-	fullName = makeFullName(
-		fullName, indexPath, "drivers.zudi-index");
+static int parseDriver(
+	struct parserContextS *ctxt, const char *fileName, uint32_t driverId
+	)
+{
+	FILE		*iFile;
+	int		ret;
 
-	if (fullName == NULL) { return EX_NOMEM; };
+	index_initialize(ctxt);
 
-	header = new zui::sHeader;
-	if (header == NULL) { return EX_NOMEM; };
+	// Try to open up the input file.
+	iFile = fopen(fileName, ((parseMode == PARSE_TEXT) ? "r" : "rb"));
+	if (iFile == NULL)
+	{
+		std::cerr <<"Error: Invalid input file " <<fileName <<".\n";
+		return EX_INVALID_INPUT_FILE;
+	};
 
-	dhFile = fopen(fullName, "r+");
-	if (dhFile == NULL) { return EX_FILE_OPEN; };
+	if (verboseMode) { std::cout <<fileName <<":\n"; };
 
-	if (fread(header, sizeof(*header), 1, dhFile) < 1)
+	if (!parser_initializeNewDriverState(ctxt, driverId))
 	{
-		std::cerr <<"Error: Failed to read index header for "
-			"nRecords update.\n";
+		fclose(iFile);
+		return EX_NOMEM;
+	};
 
-		return EX_FILE_IO;
+	ctxt->sourcePath = realpath(fileName, NULL);
+	ret = sync_hashInputFile(fileName, &ctxt->driver->h.contentHash);
+	if (ctxt->sourcePath == NULL || ret != EX_SUCCESS)
+	{
+		fclose(iFile);
+		std::cerr <<fileName <<": Error: Failed to hash input file.\n";
+		return (ret != EX_SUCCESS) ? ret : EX_NOMEM;
 	};
 
-	header->nRecords++;
-	header->nSupportedDevices += nSupportedDevices;
-	header->nSupportedMetas += nSupportedMetas;
+	if (parseMode == PARSE_TEXT) {
+		ret = textParse(ctxt, iFile);
+	} else {
+		ret = binaryParse(ctxt, iFile);
+	};
 
-	if (fseek(dhFile, 0, SEEK_SET) != 0)
-		{ fclose(dhFile); return EX_FILE_IO; };
+	fclose(iFile);
+	if (ret != EX_SUCCESS)
+	{
+		std::cerr <<fileName <<": Error: Parse stage returned error.\n";
+		return ret;
+	};
 
-	if (fwrite(header, sizeof(*header), 1, dhFile) < 1)
+	// Some extra checks.
+	if (!ctxt->hasRequiresUdi)
 	{
-		std::cerr <<"Error: Failed to rewrite index header after "
-			"nRecords update.\n";
+		std::cerr <<fileName <<": Error: Driver does not have requires "
+			"udi.\n";
 
-		return EX_FILE_IO;
+		return EX_NO_REQUIRES_UDI;
 	};
 
-	fclose(dhFile);
 	return EX_SUCCESS;
 }
 
-static int getNextDriverId(uint32_t *driverId)
+static int emitDriver(struct parserContextS *ctxt, const char *fileName)
 {
-	struct zui::sHeader		*driverHeader;
-	FILE				*driverHeaderIndex;
-	char				*fullName=NULL;
+	int		ret;
+
+	ret = index_writeToDisk(ctxt);
+	if (ret != EX_SUCCESS)
+	{
+		std::cerr <<fileName <<": Error: Failed to write index to disk "
+			"files.\n";
+
+		return ret;
+	};
 
-	fullName = makeFullName(
-		fullName, indexPath, "drivers.zudi-index");
+	incrementNRecords(
+		parser_getNSupportedDevices(ctxt),
+		parser_getNSupportedMetas(ctxt));
+
+	return EX_SUCCESS;
+}
 
-	if (fullName == NULL) { return 0; };
+static void releaseDriver(struct parserContextS *ctxt)
+{
+	index_free(ctxt);
+	parser_releaseState(ctxt);
+	free(ctxt->sourcePath);
+	ctxt->sourcePath = NULL;
+}
 
-	driverHeader = new zui::sHeader;
-	if (driverHeader == NULL) { return 0; };
+static int compileSerial(uint32_t firstDriverId)
+{
+	struct parserContextS	ctxt;
+	int			i, ret=EX_SUCCESS;
 
-	driverHeaderIndex = fopen(fullName, "r+");
-	if (driverHeaderIndex == NULL)
+	memset(&ctxt, 0, sizeof(ctxt));
+	for (i=0; i<nInputFiles && ret == EX_SUCCESS; i++)
 	{
-		std::cerr <<"Error: Failed to open driver-header index.\n";
-		return 0;
+		ret = parseDriver(&ctxt, inputFileNames[i], firstDriverId + i);
+		if (ret == EX_SUCCESS) {
+			ret = emitDriver(&ctxt, inputFileNames[i]);
+		};
+
+		releaseDriver(&ctxt);
+	};
+
+	return ret;
+}
+
+/**	EXPLANATION:
+ * Multithreaded compilation ("-j <n>"). Worker threads parse the input files,
+ * each into its own parser context, while the main thread writes the parsed
+ * drivers into the index strictly in input order. Driver IDs are fixed by
+ * each file's position in the input list, and string offsets are handed out
+ * as drivers are written, so the output is byte-identical to a serial run.
+ *
+ * Parsed drivers wait in a ring of slots until they are written; workers
+ * can only run COMPILE_SLOTS_PER_THREAD * nThreads files ahead of the main
+ * thread, which bounds memory use on large driver collections.
+ **/
+#define COMPILE_SLOTS_PER_THREAD	(4)
+
+struct compileSlotS
+{
+	struct parserContextS	ctxt;
+	int			ret, done;
+};
+
+static struct
+{
+	pthread_mutex_t		lock;
+	pthread_cond_t		slotDone, slotFree;
+	struct compileSlotS	*slots;
+	int			nSlots, nextFile, nWritten, abort;
+	uint32_t		firstDriverId;
+} pool;
+
+static void *compileWorker(void *)
+{
+	struct compileSlotS	*slot;
+	int			i;
+
+	for (;;)
+	{
+		pthread_mutex_lock(&pool.lock);
+		while (!pool.abort && pool.nextFile < nInputFiles
+			&& pool.nextFile >= pool.nWritten + pool.nSlots)
+		{
+			pthread_cond_wait(&pool.slotFree, &pool.lock);
+		};
+
+		if (pool.abort || pool.nextFile >= nInputFiles)
+		{
+			pthread_mutex_unlock(&pool.lock);
+			return NULL;
+		};
+
+		i = pool.nextFile++;
+		pthread_mutex_unlock(&pool.lock);
+
+		slot = &pool.slots[i % pool.nSlots];
+		slot->ret = parseDriver(
+			&slot->ctxt, inputFileNames[i], pool.firstDriverId + i);
+
+		pthread_mutex_lock(&pool.lock);
+		slot->done = 1;
+		pthread_cond_broadcast(&pool.slotDone);
+		pthread_mutex_unlock(&pool.lock);
 	};
+}
+
+static int compileParallel(uint32_t firstDriverId, int nThreads)
+{
+	pthread_t		*threads;
+	struct compileSlotS	*slot;
+	int			i, nStarted, ret=EX_SUCCESS;
 
-	if (fread(driverHeader, sizeof(*driverHeader), 1, driverHeaderIndex)
-		< 1)
+	pool.nSlots = nThreads * COMPILE_SLOTS_PER_THREAD;
+	if (pool.nSlots > nInputFiles) { pool.nSlots = nInputFiles; };
+
+	pool.slots = (compileSlotS *)calloc(pool.nSlots, sizeof(*pool.slots));
+	threads = new pthread_t[nThreads];
+	if (pool.slots == NULL || threads == NULL)
 	{
-		fclose(driverHeaderIndex);
-		std::cerr <<"Error: Failed to read index header.\n";
-		return 0;
+		free(pool.slots);
+		delete[] threads;
+		return EX_NOMEM;
 	};
 
-	*driverId = driverHeader->nextDriverId++;
+	pthread_mutex_init(&pool.lock, NULL);
+	pthread_cond_init(&pool.slotDone, NULL);
+	pthread_cond_init(&pool.slotFree, NULL);
+	pool.nextFile = pool.nWritten = pool.abort = 0;
+	pool.firstDriverId = firstDriverId;
 
-	if (fseek(driverHeaderIndex, 0, SEEK_SET) != 0)
-		{ fclose(driverHeaderIndex); return 0; };
+	for (nStarted=0; nStarted<nThreads; nStarted++)
+	{
+		if (pthread_create(&threads[nStarted], NULL, compileWorker, NULL)
+			!= 0)
+		{
+			break;
+		};
+	};
 
-	if (fwrite(driverHeader, sizeof(*driverHeader), 1, driverHeaderIndex)
-		< 1)
+	if (nStarted == 0)
 	{
-		fclose(driverHeaderIndex);
-		std::cerr <<"Error: Failed to rewrite index header.\n";
-		return 0;
+		std::cerr <<"Error: Failed to start any compile threads.\n";
+		ret = EX_GENERAL;
 	};
 
-	fclose(driverHeaderIndex);
-	return 1;
+	for (i=0; i<nInputFiles && ret == EX_SUCCESS; i++)
+	{
+		slot = &pool.slots[i % pool.nSlots];
+
+		pthread_mutex_lock(&pool.lock);
+		while (!slot->done) {
+			pthread_cond_wait(&pool.slotDone, &pool.lock);
+		};
+		pthread_mutex_unlock(&pool.lock);
+
+		ret = slot->ret;
+		if (ret == EX_SUCCESS) {
+			ret = emitDriver(&slot->ctxt, inputFileNames[i]);
+		};
+
+		releaseDriver(&slot->ctxt);
+
+		pthread_mutex_lock(&pool.lock);
+		slot->done = 0;
+		pool.nWritten++;
+		if (ret != EX_SUCCESS) { pool.abort = 1; };
+		pthread_cond_broadcast(&pool.slotFree);
+		pthread_mutex_unlock(&pool.lock);
+	};
+
+	for (i=0; i<nStarted; i++) { pthread_join(threads[i], NULL); };
+
+	// Throw away anything that was parsed ahead of a failed driver.
+	for (i=0; i<pool.nSlots; i++) { releaseDriver(&pool.slots[i].ctxt); };
+
+	pthread_cond_destroy(&pool.slotFree);
+	pthread_cond_destroy(&pool.slotDone);
+	pthread_mutex_destroy(&pool.lock);
+	free(pool.slots);
+	delete[] threads;
+	return ret;
 }
 
 static int addMode(int argc, char **argv)
 {
-	FILE		*iFile;
 	int		ret;
+	uint32_t	firstDriverId;
 	(void)		argc;
-	uint32_t	driverId;
-	int		nSupportedDevices, nSupportedMetas;
 
-	// Try to open up the input file.
-	iFile = fopen(
-		inputFileName,
-		((parseMode == PARSE_TEXT) ? "r" : "rb"));
+	if (listFileName != NULL
+		&& (ret = readInputList(listFileName)) != EX_SUCCESS)
+	{
+		exit(printAndReturn(argv[0], "Failed to read list file", ret));
+	};
 
-	if (iFile == NULL)
+	if ((ret = txn_begin()) != EX_SUCCESS)
 	{
-		exit(
-			printAndReturn(
-				argv[0], "Invalid input file",
-				EX_INVALID_INPUT_FILE));
+		exit(printAndReturn(
+			argv[0], "Failed to open index files", ret));
 	};
 
-	if (!getNextDriverId(&driverId))
+	ret = strtab_load(&indexSections[IDXF_STRINGS], indexFds[IDXF_STRINGS]);
+	if (ret != EX_SUCCESS)
 	{
+		txn_end();
 		exit(printAndReturn(
-			argv[0], "Failed to get next driver ID",
-			EX_UNKNOWN));
+			argv[0], "Failed to load string index", ret));
 	};
 
-	parser_initializeNewDriverState(driverId);
-	index_initialize();
-	if (parseMode == PARSE_TEXT) {
-		ret = textParse(iFile, propsLineBuffMem);
+	// Names already in the index keep their IDs.
+	ret = attrname_loadCommitted(indexFds[IDXF_DEVICES]);
+	if (ret != EX_SUCCESS)
+	{
+		txn_end();
+		strtab_free();
+		exit(printAndReturn(
+			argv[0], "Failed to load attribute name dictionary",
+			ret));
+	};
+
+	// Leave out inputs that are already in the index, unchanged.
+	if (syncMode && (ret = sync_planUpdate()) != EX_SUCCESS)
+	{
+		txn_end();
+		strtab_free();
+		sync_free();
+		exit(printAndReturn(argv[0], "Failed to plan index sync", ret));
+	};
+
+	firstDriverId = reserveDriverIds(nInputFiles);
+
+	/* Verbose output is printed as each line is parsed, so it would come
+	 * out garbled if several drivers were parsed at once.
+	 **/
+	if (nJobs > 1 && nInputFiles > 1 && !verboseMode) {
+		ret = compileParallel(firstDriverId, nJobs);
 	} else {
-		ret = binaryParse(iFile, propsLineBuffMem);
+		ret = compileSerial(firstDriverId);
+	};
+
+	/* The batch is added atomically: if any driver failed, nothing is
+	 * committed and the index is left exactly as it was.
+	 **/
+	if (ret == EX_SUCCESS && (ret = txn_commit()) != EX_SUCCESS) {
+		std::cerr <<"Error: Failed to commit index update.\n";
 	};
 
+	txn_end();
+	strtab_free();
+	sync_free();
+
 	if (ret != EX_SUCCESS)
+	{
+		printAndReturn(argv[0], "Error: Failed to add drivers", ret);
+		return ret;
+	};
+
+	return EX_SUCCESS;
+}
+
+static int removeMode(int argc, char **argv)
+{
+	int		ret, nRemoved;
+	(void)		argc;
+
+	if ((ret = txn_begin()) != EX_SUCCESS)
 	{
 		exit(printAndReturn(
-			argv[0], "Error: Parse stage returned error",
-			ret));
+			argv[0], "Failed to open index files", ret));
 	};
 
-	// Some extra checks.
-	if (!hasRequiresUdi)
+	ret = compact_removeDrivers(inputFileName, &nRemoved);
+	if (ret == EX_SUCCESS && nRemoved == 0)
 	{
-		exit(
+		std::cerr <<"Error: No driver in the index matches \""
+			<<inputFileName <<"\".\n";
+
+		ret = EX_INVALID_INPUT_FILE;
+	};
+
+	// Nothing is committed unless the whole index was rebuilt.
+	if (ret == EX_SUCCESS && (ret = txn_commitRewrite()) != EX_SUCCESS) {
+		std::cerr <<"Error: Failed to commit index update.\n";
+	};
+
+	txn_end();
+	strtab_free();
+	compact_free();
+
+	if (ret != EX_SUCCESS)
+	{
+		printAndReturn(argv[0], "Error: Failed to remove drivers", ret);
+		return ret;
+	};
+
+	return EX_SUCCESS;
+}
+
+static int listMode(int argc, char **argv)
+{
+	int		ret;
+	(void)		argc;
+
+	// A container is a snapshot; nothing else writes to it.
+	if (containerFileName != NULL)
+	{
+		ret = list_printDrivers(inputFileName, &listFilters);
+		if (ret != EX_SUCCESS)
+		{
 			printAndReturn(
-				argv[0], "Error: Driver does not have requires "
-				"udi.\n",
-				EX_NO_REQUIRES_UDI));
+				argv[0], "Error: Failed to list drivers", ret);
+		};
+
+		return ret;
 	};
 
-	ret = index_writeToDisk();
+	// The transaction only serves to get a consistent view of the index.
+	if ((ret = txn_begin()) != EX_SUCCESS)
+	{
+		exit(printAndReturn(
+			argv[0], "Failed to open index files", ret));
+	};
+
+	ret = list_printDrivers(inputFileName, &listFilters);
+	txn_end();
+
 	if (ret != EX_SUCCESS)
+	{
+		printAndReturn(argv[0], "Error: Failed to list drivers", ret);
+		return ret;
+	};
+
+	return EX_SUCCESS;
+}
+
+static int verifyMode(int argc, char **argv)
+{
+	int		ret;
+	(void)		argc;
+
+	// A container is a snapshot; nothing else writes to it.
+	if (containerFileName != NULL)
+	{
+		ret = verify_checkIndex();
+		if (ret != EX_SUCCESS)
+		{
+			printAndReturn(
+				argv[0], "Error: The index container failed "
+				"verification", ret);
+		};
+
+		return ret;
+	};
+
+	// The transaction only serves to get a consistent view of the index.
+	if ((ret = txn_begin()) != EX_SUCCESS)
 	{
 		exit(printAndReturn(
-			argv[0], "Error: Failed to write index to disk files",
-			ret));
+			argv[0], "Failed to open index files", ret));
 	};
 
-	index_free();
-	nSupportedDevices = parser_getNSupportedDevices();
-	nSupportedMetas = parser_getNSupportedMetas();
-	parser_releaseState();
-	fclose(iFile);
-	return incrementNRecords(nSupportedDevices, nSupportedMetas);
+	ret = verify_checkIndex();
+	txn_end();
+
+	if (ret != EX_SUCCESS)
+	{
+		printAndReturn(
+			argv[0], "Error: The index failed verification", ret);
+
+		return ret;
+	};
+
+	return EX_SUCCESS;
+}
+
+static int packMode(int argc, char **argv)
+{
+	int		ret;
+	(void)		argc;
+
+	if ((ret = txn_begin()) != EX_SUCCESS)
+	{
+		exit(printAndReturn(
+			argv[0], "Failed to open index files", ret));
+	};
+
+	ret = pack_writeContainer(inputFileName);
+	txn_end();
+
+	if (ret != EX_SUCCESS)
+	{
+		printAndReturn(argv[0], "Error: Failed to pack the index", ret);
+		return ret;
+	};
+
+	return EX_SUCCESS;
 }
 
 static struct stat		dirStat;
@@ -670,6 +1278,13 @@ int main(int argc, char **argv)
 		exit(EXIT_SUCCESS);
 	};
 
+	// An index container stands alone, without the index directory.
+	if (programMode == MODE_LIST && containerFileName != NULL)
+		{ exit(listMode(argc, argv)); };
+
+	if (programMode == MODE_VERIFY && containerFileName != NULL)
+		{ exit(verifyMode(argc, argv)); };
+
 	// Check to see if the index directory exists.
 	if (!folderExists(indexPath))
 	{
@@ -678,13 +1293,6 @@ int main(int argc, char **argv)
 				EX_INVALID_INDEX_PATH));
 	};
 
-	if (programMode != MODE_ADD && programMode != MODE_CREATE)
-	{
-		exit(printAndReturn(
-				argv[0], "Only ADD and CREATE modes are "
-				"supported for now", EX_GENERAL));
-	};
-
 	// Create the new index files and exit.
 	if (programMode == MODE_CREATE) {
 		exit(createMode(argc, argv));
@@ -694,7 +1302,8 @@ int main(int argc, char **argv)
 	 * valid index already in existence.
 	 **/
 	if (programMode == MODE_ADD || programMode == MODE_LIST
-		|| programMode == MODE_REMOVE)
+		|| programMode == MODE_REMOVE || programMode == MODE_PACK
+		|| programMode == MODE_VERIFY)
 	{
 		for (i=0; indexFileNames[i] != NULL; i++)
 		{
@@ -729,6 +1338,11 @@ int main(int argc, char **argv)
 		exit(addMode(argc, argv));
 	};
 
+	if (programMode == MODE_LIST) { exit(listMode(argc, argv)); };
+	if (programMode == MODE_REMOVE) { exit(removeMode(argc, argv)); };
+	if (programMode == MODE_PACK) { exit(packMode(argc, argv)); };
+	if (programMode == MODE_VERIFY) { exit(verifyMode(argc, argv)); };
+
 	exit(EX_UNKNOWN);
 }
 
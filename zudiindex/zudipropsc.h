@@ -3,12 +3,13 @@
 
 	#include <stdio.h>
 	#include <stdlib.h>
+	#include <string.h>
 	#include <zui.h>
 
 enum parseModeE { PARSE_NONE, PARSE_TEXT, PARSE_BINARY };
 enum programModeE {
 	MODE_NONE, MODE_ADD, MODE_LIST, MODE_REMOVE, MODE_PRINT_SIZES,
-	MODE_CREATE };
+	MODE_CREATE, MODE_PACK, MODE_VERIFY };
 
 enum propsTypeE { DRIVER_PROPS, META_PROPS };
 
@@ -20,10 +21,73 @@ enum exitStatusE {
 extern enum parseModeE		parseMode;
 extern enum programModeE	programMode;
 extern enum propsTypeE		propsType;
-extern int			hasRequiresUdi, hasRequiresUdiPhysio,
-				verboseMode;
-extern const char		*basePath, *indexPath;
-extern char			verboseBuff[];
+extern int			verboseMode, contiguousLayout, compressMessages;
+extern const char		*basePath, *indexPath, *containerFileName;
+extern const char		**inputFileNames;
+extern int			nInputFiles;
+
+/* Indexes into indexFileNames[] and indexFiles[]. Keep these in the same order
+ * as the names in indexFileNames[].
+ **/
+enum indexFileE {
+	IDXF_DRIVERS=0, IDXF_DATA, IDXF_DEVICES, IDXF_STRINGS, IDXF_RANKS,
+	IDXF_PROVISIONS, IDXF_N_FILES };
+
+extern const char		*indexFileNames[];
+
+/**	EXPLANATION:
+ * In-memory buffer for the bytes that are to be appended to one index file.
+ * See index.cpp.
+ **/
+struct sectionS
+{
+	uint8_t		*buff;
+	uint32_t	base, clean, len, capacity;
+};
+
+extern int			indexFds[];
+extern struct sectionS		indexSections[];
+
+/**	EXPLANATION:
+ * Grow-only memory for the variable-length parts of one parsed driver. See
+ * arena.cpp.
+ **/
+struct arenaBlockS;
+struct arenaS
+{
+	struct arenaBlockS	*blocks;
+};
+
+void *arena_alloc(struct arenaS *a, size_t len);
+int arena_allocArray(
+	struct arenaS *a, void **array, uint32_t n, size_t elemSize);
+int arena_growArray(
+	struct arenaS *a, void **array, uint32_t n, size_t elemSize);
+void arena_free(struct arenaS *a);
+
+// Allocates an array with room for "n" elements.
+template <class T>
+static inline int arena_newArray(struct arenaS *a, T **array, uint32_t n)
+{
+	void		*tmp;
+	int		ret;
+
+	ret = arena_allocArray(a, &tmp, n, sizeof(**array));
+	*array = (T *)tmp;
+	return ret;
+}
+
+// Makes room for a new element at the end of an array of "n" elements.
+template <class T>
+static inline int arena_grow(struct arenaS *a, T **array, uint32_t n)
+{
+	void		*tmp=*array;
+	int		ret;
+
+	ret = arena_growArray(a, &tmp, n, sizeof(**array));
+	*array = (T *)tmp;
+	return ret;
+}
 
 char *makeFullName(char *reallocMem, const char *path, const char *fileName);
 inline static int printAndReturn(char *progname, const char *msg, int errcode)
@@ -32,6 +96,21 @@ inline static int printAndReturn(char *progname, const char *msg, int errcode)
 	return errcode;
 }
 
+// 64-bit FNV-1a.
+inline static uint64_t hash_fnv1a64(const void *data, size_t len)
+{
+	const uint8_t	*p=(const uint8_t *)data;
+	uint64_t	hash=14695981039346656037ull;
+
+	for (size_t i=0; i<len; i++)
+	{
+		hash ^= p[i];
+		hash *= 1099511628211ull;
+	};
+
+	return hash;
+}
+
 enum parser_lineTypeE {
 	LT_UNKNOWN=0, LT_INVALID, LT_OVERFLOW, LT_LIMIT_EXCEEDED, LT_MISC,
 	LT_DRIVER, LT_MODULE, LT_REGION,
@@ -39,20 +118,205 @@ enum parser_lineTypeE {
 	LT_CHILD_BOPS, LT_INTERNAL_BOPS, LT_PARENT_BOPS,
 	LT_METALANGUAGE, LT_READABLE_FILE, LT_RANK, LT_PROVIDES };
 
-int parser_initializeNewDriverState(uint16_t driverId);
-struct zui::driver::sDriver *parser_getCurrentDriverState(void);
-int parser_getNSupportedDevices(void);
-int parser_getNSupportedMetas(void);
-void parser_releaseState(void);
+#define PARSER_LINEBUFF_SIZE		(515)
+#define PARSER_VERBOSEBUFF_SIZE		(1024)
+
+/**	EXPLANATION:
+ * Everything that is known about the one driver being compiled: its parsed
+ * driver object and the lists of records that index_insert() collected for
+ * it. Each driver gets its own context, so several drivers can be parsed at
+ * once on different threads. See parse.cpp and index.cpp.
+ **/
+struct listElementS;
+struct parserContextS
+{
+	struct zui::driver::sDriver	*driver;
+	// Holds the driver's arrays, and those of its devices and ranks.
+	struct arenaS			arena;
+	// Absolute path of the file the driver is being compiled from.
+	char				*sourcePath;
+	int				hasRequiresUdi, hasRequiresUdiPhysio;
+	// Locale of the messages that follow; see driver::sMessageLocale.
+	char				locale[ZUI_LOCALE_MAXLEN];
+	char				propsLineBuff[PARSER_LINEBUFF_SIZE];
+	char				verboseBuff[PARSER_VERBOSEBUFF_SIZE];
+
+	struct listElementS		*regionList, *deviceList,
+					*messageList, *disasterMessageList,
+					*messageFileList, *readableFileList,
+					*rankList, *provisionList;
+};
+
+int parser_initializeNewDriverState(
+	struct parserContextS *ctxt, uint32_t driverId);
+struct zui::driver::sDriver *parser_getCurrentDriverState(
+	struct parserContextS *ctxt);
+int parser_getNSupportedDevices(struct parserContextS *ctxt);
+int parser_getNSupportedMetas(struct parserContextS *ctxt);
+void parser_releaseState(struct parserContextS *ctxt);
+
+enum parser_lineTypeE parser_parseLine(
+	struct parserContextS *ctxt, const char *line, void **ret);
+
+uint32_t section_tell(struct sectionS *s);
+int section_reserve(struct sectionS *s, uint32_t len);
+int section_append(
+	struct sectionS *s, const void *data, uint32_t len, uint32_t *offset);
+
+	#include "serial.h"
+
+int index_openFiles(void);
+int index_flushFiles(void);
+void index_closeFiles(void);
+void index_initialize(struct parserContextS *ctxt);
+int index_insert(
+	struct parserContextS *ctxt, enum parser_lineTypeE lineType,
+	void *obj);
+int index_writeToDisk(struct parserContextS *ctxt);
+void index_free(struct parserContextS *ctxt);
+
+int strtab_load(struct sectionS *stringS, int fd);
+int strtab_appendRaw(
+	struct sectionS *stringS, const void *data, uint32_t len,
+	uint32_t *offset);
+int strtab_intern(
+	struct sectionS *stringS, const void *data, uint32_t len,
+	uint32_t *offset);
+int strtab_internString(
+	struct sectionS *stringS, const char *str, uint32_t *offset);
+void strtab_setFloor(uint32_t offset);
+void strtab_free(void);
+
+uint32_t crc_compute(uint32_t crc, const void *data, uint32_t len);
+void crc_sealHeader(struct zui::sHeader *h);
+int crc_checkHeader(const struct zui::sHeader *h);
+
+int lz_compress(
+	const uint8_t *src, uint32_t len, uint8_t *dst, uint32_t capacity,
+	uint32_t *outLen);
+
+int elf_findSection(
+	const uint8_t *image, size_t imageSize, const char *name,
+	const char **section, size_t *sectionSize);
+
+int match_addDevice(
+	const char *meta, const struct zui::device::_sDevice *dev,
+	uint32_t deviceOff);
+void match_addToFilter(
+	uint32_t *filter, const struct zui::device::_sDevice *dev);
+int match_removeDevices(uint32_t deviceOff, uint32_t nDevices);
+int match_isRemoved(uint32_t deviceOff);
+int match_loadCommitted(int fd);
+int match_writeTable(struct sectionS *devS, uint32_t *tableLen);
+void match_free(void);
+
+int attrcol_addDevice(
+	const struct zui::device::_sDevice *dev, uint32_t deviceOff);
+int attrcol_loadCommitted(int fd);
+int attrcol_writeTable(struct sectionS *devS);
+void attrcol_free(void);
+
+int attrname_loadCommitted(int fd);
+int attrname_intern(
+	struct sectionS *stringS, const char *name, uint16_t *id);
+int attrname_writeTable(struct sectionS *devS);
+void attrname_free(void);
+
+int provdir_addProvision(const struct zui::driver::_sProvision *prov);
+int provdir_removeDriver(uint32_t driverId);
+int provdir_isRemoved(uint32_t driverId);
+int provdir_loadCommitted(int fd);
+int provdir_writeTable(struct sectionS *provS, uint32_t *tableLen);
+void provdir_free(void);
+
+int closure_writeTable(
+	struct sectionS *provS,
+	const struct zui::driver::sProvisionDirEntry *dir, uint32_t nDir);
+void closure_free(void);
+
+int sync_hashInputFile(const char *fileName, uint64_t *hash);
+int sync_planUpdate(void);
+int sync_removeDriver(uint32_t index);
+void sync_free(void);
+
+/**	EXPLANATION:
+ * Read-only mapping of the committed contents of the index files, or of the
+ * sections of an index container. See image.cpp.
+ **/
+struct indexImageS
+{
+	const uint8_t	*files[IDXF_N_FILES];
+	uint32_t	sizes[IDXF_N_FILES];
+	// The whole container, when the image was mapped from one.
+	const uint8_t	*container;
+	size_t		containerSize;
+};
+
+int image_map(struct indexImageS *img);
+int image_mapContainer(struct indexImageS *img, const char *fileName);
+void image_unmap(struct indexImageS *img);
+uint32_t image_getNDrivers(const struct indexImageS *img);
+const char *image_getString(const struct indexImageS *img, uint32_t offset);
+const char *image_getAttrName(const struct indexImageS *img, uint32_t id);
+int image_findAttrName(
+	const struct indexImageS *img, const char *name, uint16_t *id);
+int image_readMessage(
+	const struct indexImageS *img, const struct zui::driver::sHeader *h,
+	const struct zui::driver::sMessage *msg, char *buff,
+	uint32_t buffSize);
+int image_isSelected(
+	const struct zui::driver::sHeader *h, const char *selector);
+
+// Copies out the i'th record of an array which starts at "offset", in host
+// byte order.
+template <class T>
+static inline int image_readRecord(
+	const struct indexImageS *img, enum indexFileE fileIndex,
+	uint32_t offset, uint32_t i, T *out
+	)
+{
+	uint64_t	start=offset + (uint64_t)i * sizeof(*out);
+
+	if (start + sizeof(*out) > img->sizes[fileIndex]) { return EX_GENERAL; };
+
+	// Records are packed end to end, so they may be unaligned.
+	memcpy(out, &img->files[fileIndex][start], sizeof(*out));
+	serial_decode(out);
+	return EX_SUCCESS;
+}
+
+int pack_writeContainer(const char *fileName);
+
+int verify_checkIndex(void);
+
+int compact_removeDrivers(const char *selector, int *nRemoved);
+void compact_free(void);
+
+/* Filters for list mode. A driver is only listed if it matches all of the
+ * ones that are set.
+ **/
+struct listFiltersS
+{
+	// Metalanguage that the driver uses, and one that it provides.
+	const char	*meta, *provision;
+	// Device attribute, given as "<name>=<value>".
+	const char	*attrName, *attrValue;
+};
 
-enum parser_lineTypeE parser_parseLine(const char *line, void **ret);
+int list_printDrivers(
+	const char *selector, const struct listFiltersS *filters);
 
-void index_initialize(void);
-int index_insert(enum parser_lineTypeE lineType, void *obj);
-int index_writeToDisk(void);
-void index_free(void);
+extern struct zui::sHeader	indexHeader;
 
-int incrementNRecords(void);
+int txn_begin(void);
+int txn_addPatch(
+	enum indexFileE fileIndex, uint32_t offset, const void *data,
+	uint32_t length);
+int txn_commit(void);
+int txn_commitRewrite(void);
+void txn_end(void);
+int txn_lockForCreate(void);
+void txn_unlockForCreate(void);
 
 #endif
 